@@ -0,0 +1,747 @@
+/* ----------------------------------------------------------------------------
+ * @file bench.cpp
+ * @brief Micro-benchmarks of the LaneDetector stages on recorded frames
+ *
+ * Each stage is timed in isolation: the stages before it are run untimed to
+ * prepare its input, then the stage itself is timed. Every stage gets a
+ * number of warm-up runs followed by the measured repetitions, and the
+ * median is reported. Results are written as JSON, and a previous result can
+ * be given as a baseline to flag regressions.
+ *
+ * usage:
+ *   ./bench.out --frames=a.jpg,b.jpg --out=bench.json
+ *   ./bench.out --baseline=bench_baseline.json --tolerance=0.1
+ *   ./bench.out --pool-threads=3   (low-latency detect against sequential)
+ *   ./bench.out --yuv=1            (BGR against YUV420 frame chain)
+ *   ./bench.out --fixed=1          (runtime against fixed geometry detect)
+ *   ./bench.out --scan=16          (Hough against scan-line detect)
+ *   ./bench.out --alloc-check=300  (heap allocations of detect and annotate)
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <vector>
+#include <algorithm>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/utility.hpp>
+
+#include "log.h"
+#include "lane.h"
+#include "taskpool.h"
+#include "perfcnt.h"
+#include "yuv.h"
+#include "fixed_lane.h"
+#include "scan_lane.h"
+
+using namespace cv;
+using namespace std;
+
+// the stages in pipeline order, STAGE_DETECT is input_image+detect as a whole,
+// STAGE_DETECT_LOWLAT the same in low-latency mode (only with --pool-threads),
+// STAGE_DETECT_FIXED on the fixed geometry detector (only with --fixed),
+// STAGE_DETECT_SCAN on the scan-line detector (only with --scan),
+// the chains are decoded I420 to JPEG through BGR or in YUV420 (--yuv)
+enum {
+  STAGE_INPUT,
+  STAGE_GRAY,
+  STAGE_ROI,
+  STAGE_MEDIAN,
+  STAGE_THRESH,
+  STAGE_HOUGH,
+  STAGE_ENDPOINTS,
+  STAGE_DECIDE,
+  STAGE_ANNOTATE,
+  STAGE_DETECT,
+  STAGE_DETECT_LOWLAT,
+  STAGE_DETECT_FIXED,
+  STAGE_DETECT_SCAN,
+  STAGE_CHAIN_BGR,
+  STAGE_CHAIN_YUV,
+  NUM_STAGES
+};
+
+static const char* stage_names[NUM_STAGES] = {
+  "input_image",
+  "to_gray",
+  "extract_roi",
+  "filter_roi",
+  "threshold_roi",
+  "hough_transform",
+  "find_endpoints",
+  "decide",
+  "annotate",
+  "detect_total",
+  "detect_lowlat",
+  "detect_fixed",
+  "detect_scan",
+  "chain_bgr",
+  "chain_yuv"
+};
+
+// whether a stage works on the whole frame or only on the ROI
+static const bool stage_full_frame[NUM_STAGES] = {
+  true, true, false, false, false, false, false, false, true, true, true,
+  true, true, true, true
+};
+
+typedef struct {
+  double ns_per_frame;  // median
+  double min_ns;
+  double mpix_per_s;    // of the pixels the stage works on, at the median
+} stage_result_t;
+
+typedef struct {
+  String name;
+  Mat img;
+  Mat i420;     // the frame as a decoder hands it out
+  stage_result_t stages[NUM_STAGES];
+} bench_frame_t;
+
+//
+// Allocation tracking for --alloc-check: malloc and friends are replaced in
+// this binary and forward to glibc, counting while watched. operator new and
+// OpenCV's fastMalloc end up here as well. The first allocations keep a 
+// backtrace, so the report shows where they came from.
+//
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t align, size_t size);
+void __libc_free(void* p);
+}
+
+#define ALLOC_TRACES (4)
+#define ALLOC_DEPTH  (16)
+
+static volatile int alloc_watch = 0;
+static unsigned long alloc_count = 0;
+static void* alloc_trace[ALLOC_TRACES][ALLOC_DEPTH];
+static int alloc_trace_depth[ALLOC_TRACES];
+static __thread int alloc_in_trace = 0;
+
+static inline void alloc_note() {
+
+  if (!alloc_watch || alloc_in_trace) {
+    return;
+  }
+  unsigned long n = __sync_fetch_and_add(&alloc_count, 1);
+  if (n < ALLOC_TRACES) {
+    alloc_in_trace = 1;
+    alloc_trace_depth[n] = backtrace(alloc_trace[n], ALLOC_DEPTH);
+    alloc_in_trace = 0;
+  }
+}
+
+extern "C" void* malloc(size_t size) {
+
+  alloc_note();
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+
+  alloc_note();
+  return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* p, size_t size) {
+
+  alloc_note();
+  return __libc_realloc(p, size);
+}
+
+extern "C" void* memalign(size_t align, size_t size) {
+
+  alloc_note();
+  return __libc_memalign(align, size);
+}
+
+extern "C" void* aligned_alloc(size_t align, size_t size) {
+
+  alloc_note();
+  return __libc_memalign(align, size);
+}
+
+extern "C" int posix_memalign(void** out, size_t align, size_t size) {
+
+  if (align % sizeof(void*) != 0 || (align & (align - 1)) != 0) {
+    return EINVAL;
+  }
+  alloc_note();
+  void* p = __libc_memalign(align, size);
+  if (p == NULL) {
+    return ENOMEM;
+  }
+  *out = p;
+  return 0;
+}
+
+extern "C" void free(void* p) {
+
+  __libc_free(p);
+}
+
+/* @brief Runs one stage of the detector
+ */
+static void run_stage(LaneDetector& d, int stage, Mat& img,
+                      Vec4i& left, Vec4i& right) {
+
+  // chain buffers, reused like in the pipeline (single threaded)
+  static Mat bgr;
+  static vector<uchar> jpeg;
+
+  switch (stage) {
+    case STAGE_INPUT:     d.input_image(img); break;
+    case STAGE_GRAY:      d.to_gray(); break;
+    case STAGE_ROI:       d.extract_roi(); break;
+    case STAGE_MEDIAN:    d.filter_roi(); break;
+    case STAGE_THRESH:    d.threshold_roi(); break;
+    case STAGE_HOUGH:     d.hough_transform(left, right); break;
+    case STAGE_ENDPOINTS: d.find_endpoints(left, right); break;
+    case STAGE_DECIDE:    d.decide(); break;
+    case STAGE_ANNOTATE:  d.annotate(); break;
+    case STAGE_DETECT:
+    case STAGE_DETECT_LOWLAT:
+    case STAGE_DETECT_FIXED:
+    case STAGE_DETECT_SCAN: d.input_image(img); d.detect(); break;
+    case STAGE_CHAIN_BGR:
+      cvtColor(img, bgr, COLOR_YUV2BGR_I420);
+      d.input_image(bgr); d.detect(); d.annotate();
+      imencode(".jpg", bgr, jpeg);
+      break;
+    case STAGE_CHAIN_YUV:
+      d.input_yuv(img); d.detect(); d.annotate();
+      yuv_encode_jpeg(img, YUV_JPEG_QUALITY, jpeg);
+      break;
+  }
+}
+
+/* @brief Times one stage on one frame
+ *
+ * @return the per-repetition samples in nsec
+ */
+static void time_stage(LaneDetector& d, int stage, const Mat& frame,
+                       int warmup, int reps, vector<double>& samples) {
+
+  Mat work;
+  Vec4i left, right;
+
+  samples.clear();
+
+  for (int r = 0; r < warmup + reps; r++) {
+
+    // annotate draws into the frame, so always start from a fresh copy
+    frame.copyTo(work);
+
+    if (stage < STAGE_DETECT) {
+      for (int s = 0; s < stage; s++) {
+        run_stage(d, s, work, left, right);
+      }
+    }
+
+    double start = get_time_msec();
+    run_stage(d, stage, work, left, right);
+    double end = get_time_msec();
+
+    if (r >= warmup) {
+      samples.push_back((end - start) * MSEC_TO_NSEC);
+    }
+  }
+}
+
+/* @brief Counts the heap allocations of detect and annotate over frames,
+ *        after warm-up frames that may allocate
+ *
+ * The frames are cycled, and copied into the work frame outside of the
+ * counted part, as a decoder would hand them out.
+ *
+ * @return the allocations counted
+ */
+static unsigned long alloc_check(LaneDetector& d, const char* label, 
+                                 vector<bench_frame_t>& frames, bool yuv,
+                                 int warmup, int count) {
+
+  Mat work;
+  Vec4i left, right;
+
+  for (int i = 0; i < warmup + count; i++) {
+
+    bench_frame_t& f = frames[i % frames.size()];
+    (yuv ? f.i420 : f.img).copyTo(work);
+
+    if (i == warmup) {
+      alloc_count = 0;
+      alloc_watch = 1;
+    }
+    if (yuv) {
+      d.input_yuv(work);
+    } else {
+      d.input_image(work);
+    }
+    d.detect();
+    d.annotate();
+  }
+  alloc_watch = 0;
+
+  LOGP("alloc check, %-14s %lu allocations in %i frames\n", label, 
+       alloc_count, count);
+  for (unsigned long n = 0; n < alloc_count && n < ALLOC_TRACES; n++) {
+    LOGP("allocation %lu:\n", n+1);
+    fflush(stdout);
+    backtrace_symbols_fd(alloc_trace[n], alloc_trace_depth[n], STDOUT_FILENO);
+  }
+  return alloc_count;
+}
+
+/* @brief Runs detect on every frame with both detectors and compares the
+ *        lane results
+ *
+ * @return the number of frames with different results
+ */
+static int compare_detectors(LaneDetector& a, LaneDetector& b,
+                             vector<bench_frame_t>& frames) {
+
+  Mat work;
+  lane_state_t sa, sb;
+  int differ = 0;
+
+  for (size_t f = 0; f < frames.size(); f++) {
+
+    frames[f].img.copyTo(work);
+    a.input_image(work);
+    a.detect();
+    a.get_state(sa);
+
+    frames[f].img.copyTo(work);
+    b.input_image(work);
+    b.detect();
+    b.get_state(sb);
+
+    if (sa.is_left_found != sb.is_left_found
+        || sa.is_right_found != sb.is_right_found
+        || sa.left_pt1 != sb.left_pt1 || sa.left_pt2 != sb.left_pt2
+        || sa.right_pt1 != sb.right_pt1 || sa.right_pt2 != sb.right_pt2
+        || sa.candidates[0] != sb.candidates[0]
+        || sa.candidates[1] != sb.candidates[1]
+        || sa.thresh[0] != sb.thresh[0] || sa.thresh[1] != sb.thresh[1]) {
+      fprintf(stderr, "%s: fixed geometry detect differs from the runtime "
+              "detector\n", frames[f].name.c_str());
+      differ++;
+    }
+  }
+  return differ;
+}
+
+/* @brief Runs detect on every frame with the Hough and the scan-line
+ *        detector and prints how far the scan-line lane lines are from the
+ *        Hough ones, at the top and bottom of the ROI
+ */
+static void compare_scan(LaneDetector& hough, LaneDetector& scan,
+                         vector<bench_frame_t>& frames) {
+
+  Mat work;
+  lane_state_t sh, ss;
+  int found[2] = {0, 0}, both = 0;
+  double dist = 0.0;
+
+  LOGP("\n%-16s %-10s %-10s %10s\n", "frame", "hough L/R", "scan L/R",
+       "max dx");
+  for (size_t f = 0; f < frames.size(); f++) {
+
+    frames[f].img.copyTo(work);
+    hough.input_image(work);
+    hough.detect();
+    hough.get_state(sh);
+
+    frames[f].img.copyTo(work);
+    scan.input_image(work);
+    scan.detect();
+    scan.get_state(ss);
+
+    // the larger end point distance of the sides both found
+    double dx = 0.0;
+    bool any = false;
+    if (sh.is_left_found && ss.is_left_found) {
+      dx = max(dx, (double)max(abs(sh.left_pt1.x - ss.left_pt1.x),
+                               abs(sh.left_pt2.x - ss.left_pt2.x)));
+      any = true;
+    }
+    if (sh.is_right_found && ss.is_right_found) {
+      dx = max(dx, (double)max(abs(sh.right_pt1.x - ss.right_pt1.x),
+                               abs(sh.right_pt2.x - ss.right_pt2.x)));
+      any = true;
+    }
+    if (any) {
+      dist += dx;
+      both++;
+    }
+    found[0] += sh.is_left_found + sh.is_right_found;
+    found[1] += ss.is_left_found + ss.is_right_found;
+
+    char dist_text[16] = "-";
+    if (any) {
+      snprintf(dist_text, sizeof(dist_text), "%.0f", dx);
+    }
+    LOGP("%-16s %i/%-8i %i/%-8i %10s\n", frames[f].name.c_str(),
+         sh.is_left_found, sh.is_right_found, ss.is_left_found,
+         ss.is_right_found, dist_text);
+  }
+
+  LOGP("lines found: hough %i, scan %i of %lu, mean max dx %.1f px\n",
+       found[0], found[1], (unsigned long)frames.size()*2,
+       (both > 0) ? dist/both : 0.0);
+}
+
+static String frame_name(const String& path) {
+
+  size_t slash = path.find_last_of('/');
+  String name = (slash == String::npos) ? path : path.substr(slash+1);
+  size_t dot = name.find_last_of('.');
+  if (dot != String::npos) name = name.substr(0, dot);
+
+  // keep the name a valid JSON/FileStorage key
+  for (size_t i = 0; i < name.size(); i++) {
+    char c = name[i];
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+          || (c >= '0' && c <= '9') || c == '_')) {
+      name[i] = '_';
+    }
+  }
+  return name;
+}
+
+static void write_stage(FileStorage& fs, const stage_result_t& r) {
+
+  fs << "{"
+     << "ns_per_frame" << r.ns_per_frame
+     << "min_ns" << r.min_ns
+     << "mpix_per_s" << r.mpix_per_s
+     << "}";
+}
+
+/* @brief Compares the summary against a baseline result file
+ *
+ * @return the number of stages slower than the baseline by more than tol
+ */
+static int compare_baseline(const String& path, const stage_result_t* summary,
+                            double tol) {
+
+  FileStorage fs(path, FileStorage::READ);
+  if (!fs.isOpened()) {
+    fprintf(stderr, "bench: cannot read baseline %s\n", path.c_str());
+    return -1;
+  }
+
+  FileNode base = fs["summary"];
+  int regressions = 0;
+
+  LOGP("\n%-16s %12s %12s %8s\n", "stage", "base ns", "now ns", "ratio");
+  for (int s = 0; s < NUM_STAGES; s++) {
+
+    FileNode node = base[stage_names[s]];
+    if (node.empty() || summary[s].ns_per_frame <= 0.0) continue;
+
+    double base_ns = (double) node["ns_per_frame"];
+    double ratio = (base_ns > 0.0) ? summary[s].ns_per_frame / base_ns : 1.0;
+    bool slower = ratio > 1.0 + tol;
+    if (slower) regressions++;
+
+    LOGP("%-16s %12.0f %12.0f %8.3f %s\n",
+         stage_names[s], base_ns, summary[s].ns_per_frame, ratio,
+         slower ? "REGRESSION" : "");
+  }
+
+  return regressions;
+}
+
+int main(int argc, char **argv) {
+
+  const String parser_keys =
+    "{help h usage ? | | Print help message. }"
+    "{frames   | bench_frames/day.jpg,bench_frames/shadow.jpg,bench_frames/intersection.jpg,bench_frames/missing.jpg | Comma separated list of 1280x720 frames. }"
+    "{warmup   | 20  | Untimed runs per stage and frame. }"
+    "{reps     | 200 | Timed runs per stage and frame. }"
+    "{out o    | bench.json | Output JSON file. }"
+    "{baseline | | JSON result to compare against, regressions give a non-zero exit. }"
+    "{tolerance | 0.10 | Allowed slowdown against the baseline (0.10 = 10%). }"
+    "{perf     | 0 | Also prints perf_event counters per detector step. }"
+    "{yuv      | 0 | Also times the decoded-frame to JPEG chain through BGR and in YUV420. }"
+    "{pool-threads | 0 | Also times detect in low-latency mode with this many pool threads. }"
+    "{scan     | 0 | Also times detect on the scan-line detector with this many scan lines, and compares its lane lines with the Hough ones. }"
+    "{fixed    | 0 | Also times detect on the detector compiled for 1280x720 frames, and checks its results are identical. }"
+    "{alloc-check | 0 | Only counts heap allocations of detect and annotate over this many frames after --warmup (also in low-latency, YUV420, fixed geometry and scan-line mode when enabled), any gives a non-zero exit. }"
+    ;
+
+  CommandLineParser parser(argc, argv, parser_keys);
+  if (parser.has("help")) {
+    parser.printMessage();
+    return 0;
+  }
+
+  String frame_list = parser.get<String>("frames");
+  int warmup = parser.get<int>("warmup");
+  int reps = parser.get<int>("reps");
+  String out = parser.get<String>("out");
+  String baseline = parser.get<String>("baseline");
+  double tol = parser.get<double>("tolerance");
+  int pool_threads = parser.get<int>("pool-threads");
+  bool perf = parser.get<int>("perf") != 0;
+  bool yuv = parser.get<int>("yuv") != 0;
+  bool fixed = parser.get<int>("fixed") != 0;
+  int scan_lines = parser.get<int>("scan");
+  int alloc_frames = parser.get<int>("alloc-check");
+
+  if (reps < 1) reps = 1;
+
+  //
+  // load the frames
+  //
+  vector<bench_frame_t> frames;
+  size_t pos = 0;
+  while (pos <= frame_list.size()) {
+    size_t comma = frame_list.find(',', pos);
+    if (comma == String::npos) comma = frame_list.size();
+    String path = frame_list.substr(pos, comma-pos);
+    pos = comma+1;
+    if (path.empty()) continue;
+
+    bench_frame_t f;
+    f.name = frame_name(path);
+    f.img = imread(path);
+    if (f.img.empty()) {
+      fprintf(stderr, "bench: cannot read %s\n", path.c_str());
+      return 1;
+    }
+    cvtColor(f.img, f.i420, COLOR_BGR2YUV_I420);
+    frames.push_back(f);
+  }
+
+  if (frames.empty()) {
+    fprintf(stderr, "bench: no frames given\n");
+    return 1;
+  }
+
+  //
+  // run the benchmarks
+  //
+  LaneDetector detector, lowlat;
+  LaneDetector720p fixed_detector;
+  ScanLaneDetector scan_detector;
+  Rect roi_rect = detector.get_roi_rect();
+  vector<double> samples;
+  stage_result_t summary[NUM_STAGES];
+  bool enabled[NUM_STAGES];
+
+  TaskPool pool;
+  for (int s = 0; s < NUM_STAGES; s++) {
+    enabled[s] = true;
+  }
+  if (pool_threads > 0 && pool.start(pool_threads)) {
+    lowlat.set_task_pool(&pool, pool.get_threads() + 1);
+  } else {
+    enabled[STAGE_DETECT_LOWLAT] = false;
+  }
+  enabled[STAGE_CHAIN_BGR] = enabled[STAGE_CHAIN_YUV] = yuv;
+  enabled[STAGE_DETECT_FIXED] = fixed;
+  enabled[STAGE_DETECT_SCAN] = scan_lines > 0;
+  if (scan_lines > 0) {
+    scan_detector.set_scan_lines(scan_lines);
+  }
+
+  //
+  // allocation check mode
+  //
+  if (alloc_frames > 0) {
+
+    void* warm[1];
+    backtrace(warm, 1);   // loads the unwinder before anything is counted
+
+    unsigned long allocs = alloc_check(detector, "sequential", frames, false,
+                                       warmup, alloc_frames);
+    if (enabled[STAGE_DETECT_LOWLAT]) {
+      allocs += alloc_check(lowlat, "low-latency", frames, false, warmup,
+                            alloc_frames);
+    }
+    if (fixed) {
+      allocs += alloc_check(fixed_detector, "fixed geometry", frames, false,
+                            warmup, alloc_frames);
+    }
+    if (scan_lines > 0) {
+      allocs += alloc_check(scan_detector, "scan-line", frames, false,
+                            warmup, alloc_frames);
+    }
+    if (yuv) {
+      LaneDetector yuv_detector;
+      allocs += alloc_check(yuv_detector, "yuv420", frames, true, warmup,
+                            alloc_frames);
+    }
+    return (allocs == 0) ? 0 : 1;
+  }
+
+  for (int s = 0; s < NUM_STAGES; s++) {
+    summary[s].ns_per_frame = 0.0;
+    summary[s].min_ns = 0.0;
+    summary[s].mpix_per_s = 0.0;
+  }
+
+  if (perf) {
+    perf_enable(true);
+    if (perf_thread_start() == NULL) {
+      fprintf(stderr, "bench: no perf counters available\n");
+    }
+  }
+
+  LOGP("%-16s %-16s %12s %12s %10s\n",
+       "frame", "stage", "median ns", "min ns", "MPix/s");
+
+  for (size_t f = 0; f < frames.size(); f++) {
+    for (int s = 0; s < NUM_STAGES; s++) {
+
+      if (!enabled[s]) continue;
+      bool chain = (s == STAGE_CHAIN_BGR || s == STAGE_CHAIN_YUV);
+      LaneDetector& d = (s == STAGE_DETECT_LOWLAT) ? lowlat
+                        : (s == STAGE_DETECT_FIXED) ? fixed_detector
+                        : (s == STAGE_DETECT_SCAN) ? scan_detector : detector;
+      time_stage(d, s, 
+                 chain ? frames[f].i420 : frames[f].img, warmup, reps, samples);
+      sort(samples.begin(), samples.end());
+
+      double pixels = stage_full_frame[s]
+        ? (double)frames[f].img.total() : (double)roi_rect.area();
+
+      stage_result_t& r = frames[f].stages[s];
+      r.ns_per_frame = samples[samples.size()/2];
+      r.min_ns = samples[0];
+      r.mpix_per_s = (r.ns_per_frame > 0.0) ? pixels*1000.0/r.ns_per_frame : 0.0;
+
+      summary[s].ns_per_frame += r.ns_per_frame / frames.size();
+      summary[s].min_ns += r.min_ns / frames.size();
+      summary[s].mpix_per_s += r.mpix_per_s / frames.size();
+
+      LOGP("%-16s %-16s %12.0f %12.0f %10.2f\n",
+           frames[f].name.c_str(), stage_names[s],
+           r.ns_per_frame, r.min_ns, r.mpix_per_s);
+    }
+  }
+
+  //
+  // write the JSON result
+  //
+  FileStorage fs(out, FileStorage::WRITE | FileStorage::FORMAT_JSON);
+  if (!fs.isOpened()) {
+    fprintf(stderr, "bench: cannot write %s\n", out.c_str());
+    return 1;
+  }
+
+  fs << "warmup" << warmup;
+  fs << "reps" << reps;
+  fs << "threads" << getNumThreads();
+  fs << "pool_threads" << (enabled[STAGE_DETECT_LOWLAT] ? pool.get_threads() : 0);
+
+  fs << "frames" << "{";
+  for (size_t f = 0; f < frames.size(); f++) {
+    fs << frames[f].name << "{";
+    fs << "width" << frames[f].img.cols;
+    fs << "height" << frames[f].img.rows;
+    fs << "stages" << "{";
+    for (int s = 0; s < NUM_STAGES; s++) {
+      if (!enabled[s]) continue;
+      fs << stage_names[s];
+      write_stage(fs, frames[f].stages[s]);
+    }
+    fs << "}" << "}";
+  }
+  fs << "}";
+
+  fs << "summary" << "{";
+  for (int s = 0; s < NUM_STAGES; s++) {
+    if (!enabled[s]) continue;
+    fs << stage_names[s];
+    write_stage(fs, summary[s]);
+  }
+  fs << "}";
+  fs.release();
+
+  LOGP("results written to %s\n", out.c_str());
+
+  if (perf) {
+    // includes the untimed runs of the earlier steps of every stage
+    LOGP("\n");
+    PERF_PRINT();
+    perf_thread_stop();
+  }
+
+  if (enabled[STAGE_DETECT_LOWLAT] && summary[STAGE_DETECT].ns_per_frame > 0.0) {
+    double seq = summary[STAGE_DETECT].ns_per_frame;
+    double par = summary[STAGE_DETECT_LOWLAT].ns_per_frame;
+    LOGP("\nlow-latency detect, %i pool threads: sequential %.0f ns, "
+         "parallel %.0f ns, latency reduction: %.1f%%\n",
+         pool.get_threads(), seq, par, 100.0*(seq - par)/seq);
+  }
+
+  int fixed_differ = 0;
+  if (fixed && summary[STAGE_DETECT].ns_per_frame > 0.0) {
+    LaneDetector reference;
+    LaneDetector720p compiled;
+    fixed_differ = compare_detectors(reference, compiled, frames);
+    double rt = summary[STAGE_DETECT].ns_per_frame;
+    double fx = summary[STAGE_DETECT_FIXED].ns_per_frame;
+    LOGP("\nfixed geometry detect: runtime %.0f ns, fixed %.0f ns, speedup "
+         "%.2fx, %i of %lu frames differ\n", rt, fx, (fx > 0.0) ? rt/fx : 0.0,
+         fixed_differ, (unsigned long)frames.size());
+  }
+
+  if (scan_lines > 0 && summary[STAGE_DETECT].ns_per_frame > 0.0) {
+    LaneDetector reference;
+    ScanLaneDetector scan;
+    scan.set_scan_lines(scan_lines);
+    double hough_ns = summary[STAGE_DETECT].ns_per_frame;
+    double scan_ns = summary[STAGE_DETECT_SCAN].ns_per_frame;
+    LOGP("\nscan-line detect, %i lines: hough %.0f ns, scan %.0f ns, speedup "
+         "%.2fx\n", scan.get_scan_lines(), hough_ns, scan_ns,
+         (scan_ns > 0.0) ? hough_ns/scan_ns : 0.0);
+    compare_scan(reference, scan, frames);
+  }
+
+  if (yuv && summary[STAGE_CHAIN_BGR].ns_per_frame > 0.0) {
+    double bgr_ns = summary[STAGE_CHAIN_BGR].ns_per_frame;
+    double yuv_ns = summary[STAGE_CHAIN_YUV].ns_per_frame;
+    double mbytes = yuv_saved_bytes(frames[0].img.size()) / 1e6;
+    LOGP("\nYUV420 chain: BGR %.0f ns, YUV420 %.0f ns per frame, CPU saved: "
+         "%.1f%%\n", bgr_ns, yuv_ns, 100.0*(bgr_ns - yuv_ns)/bgr_ns);
+    LOGP("color conversion traffic saved: %.1f MB per frame, %.0f MB/s at "
+         "30 fps\n", mbytes, mbytes*30.0);
+  }
+
+  // the fixed kernels must give the runtime results exactly, any
+  // difference fails the run as a regression of its own
+  if (fixed_differ > 0) {
+    fprintf(stderr, "REGRESSION: fixed geometry detect differs on %i "
+            "frame(s)\n", fixed_differ);
+  }
+
+  //
+  // compare mode
+  //
+  if (!baseline.empty()) {
+    int regressions = compare_baseline(baseline, summary, tol);
+    if (regressions < 0) {
+      return 1;
+    }
+    if (regressions > 0) {
+      LOGP("%i stage(s) regressed against %s\n", regressions, baseline.c_str());
+      return 1;
+    }
+    LOGP("no regressions against %s\n", baseline.c_str());
+  }
+
+  return (fixed_differ == 0) ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+/* ----------------------------------------------------------------------------
+ * @file deadline.cpp
+ * @brief Per-stage deadline budgets and miss accounting, see deadline.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "deadline.h"
+#include "metrics.h"
+
+static const char* deadline_names[DEADLINE_NUM_STAGES] = {
+  "decode", "gray", "filter", "threshold", "hough", "decide", "annotate",
+  "encode", "write", "frame"
+};
+
+/* @brief Budget and statistics of one stage
+ */
+typedef struct {
+  uint64_t budget_ns;     // 0 when not monitored
+  uint64_t count;
+  uint64_t max_ns;
+  uint64_t misses;        // under deadline_lock from here on
+  uint64_t over_sum_ns;
+  uint64_t over_max_ns;
+  unsigned int over_max_frame;
+} deadline_stat_t;
+
+static deadline_stat_t deadline_stats[DEADLINE_NUM_STAGES];
+static pthread_mutex_t deadline_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* deadline_log = NULL;
+static double alarm_interval = 0.0;
+static double last_alarm = 0.0;
+static unsigned long suppressed = 0;
+static __thread unsigned int current_frame = 0;
+static __thread unsigned long thread_misses = 0;
+
+// see .h for more details
+bool deadline_configure(const char* spec) {
+
+  char buf[256];
+  strncpy(buf, spec, sizeof(buf)-1);
+  buf[sizeof(buf)-1] = '\0';
+
+  for (char* save = NULL, *item = strtok_r(buf, ",", &save); item != NULL;
+       item = strtok_r(NULL, ",", &save)) {
+
+    char* eq = strchr(item, '=');
+    if (eq == NULL) {
+      fprintf(stderr, "deadline: expected stage=msec, got '%s'\n", item);
+      return false;
+    }
+    *eq = '\0';
+
+    char* end;
+    double msec = strtod(eq+1, &end);
+    if (*end != '\0' || msec <= 0.0) {
+      fprintf(stderr, "deadline: bad budget '%s' for %s\n", eq+1, item);
+      return false;
+    }
+
+    int s;
+    for (s = 0; s < DEADLINE_NUM_STAGES; s++) {
+      if (strcmp(item, deadline_names[s]) == 0) break;
+    }
+    if (s == DEADLINE_NUM_STAGES) {
+      fprintf(stderr, "deadline: unknown stage '%s'\n", item);
+      return false;
+    }
+    deadline_stats[s].budget_ns = (uint64_t)(msec*MSEC_TO_NSEC);
+  }
+  return true;
+}
+
+// see .h for more details
+bool deadline_is_set(deadline_stage_t stage) {
+
+  return deadline_stats[stage].budget_ns != 0;
+}
+
+// see .h for more details
+bool deadline_open_log(const char* path) {
+
+  deadline_log = fopen(path, "w");
+  if (deadline_log == NULL) {
+    perror("deadline log fopen");
+    return false;
+  }
+  fprintf(deadline_log, "frame,stage,msec,budget_msec,over_msec,t_msec\n");
+  return true;
+}
+
+// see .h for more details
+void deadline_set_alarm_interval(double msec) {
+
+  alarm_interval = msec;
+}
+
+// see .h for more details
+void deadline_set_frame(unsigned int frame_id) {
+
+  current_frame = frame_id;
+}
+
+// see .h for more details
+void deadline_check(deadline_stage_t stage, unsigned int frame_id,
+                    uint64_t ns) {
+
+  deadline_stat_t* st = &deadline_stats[stage];
+  if (st->budget_ns == 0) {
+    return;
+  }
+
+  __sync_fetch_and_add(&st->count, 1);
+  uint64_t max = __atomic_load_n(&st->max_ns, __ATOMIC_RELAXED);
+  while (ns > max) {
+    uint64_t seen = __sync_val_compare_and_swap(&st->max_ns, max, ns);
+    if (seen == max) break;
+    max = seen;
+  }
+
+  if (ns <= st->budget_ns) {
+    return;
+  }
+
+  // a miss, rare enough to take the lock
+  thread_misses++;
+  uint64_t over = ns - st->budget_ns;
+  double now = get_time_msec();
+
+  pthread_mutex_lock(&deadline_lock);
+  metric_add(&st->misses, 1);
+  st->over_sum_ns += over;
+  if (over > st->over_max_ns) {
+    st->over_max_ns = over;
+    st->over_max_frame = frame_id;
+  }
+
+  if (deadline_log != NULL) {
+    fprintf(deadline_log, "%u,%s,%.3f,%.3f,%.3f,%.3f\n", frame_id,
+            deadline_names[stage], (double)ns/MSEC_TO_NSEC,
+            (double)st->budget_ns/MSEC_TO_NSEC, (double)over/MSEC_TO_NSEC,
+            now);
+  }
+
+  if (alarm_interval > 0.0) {
+    if (now - last_alarm >= alarm_interval) {
+      LOGSYS("deadline miss, frame: %u, %s: %.2f msec (budget %.2f), "
+             "misses suppressed: %lu", frame_id, deadline_names[stage],
+             (double)ns/MSEC_TO_NSEC, (double)st->budget_ns/MSEC_TO_NSEC,
+             suppressed);
+      last_alarm = now;
+      suppressed = 0;
+    } else {
+      suppressed++;
+    }
+  }
+  pthread_mutex_unlock(&deadline_lock);
+}
+
+// see .h for more details
+unsigned long deadline_thread_misses() {
+
+  return thread_misses;
+}
+
+// see .h for more details
+void deadline_print() {
+
+  bool header = false;
+
+  for (int s = 0; s < DEADLINE_NUM_STAGES; s++) {
+
+    const deadline_stat_t* st = &deadline_stats[s];
+    if (st->budget_ns == 0 || st->count == 0) {
+      continue;
+    }
+    if (!header) {
+      LOGP("%-10s %8s %8s %7s %7s %8s %9s %10s\n", "deadline", "budget",
+           "frames", "misses", "miss %", "max", "avg over", "worst over");
+      header = true;
+    }
+    LOGP("%-10s %8.2f %8llu %7llu %7.2f %8.2f %9.2f %10.2f @ frame %u\n",
+         deadline_names[s], (double)st->budget_ns/MSEC_TO_NSEC,
+         (unsigned long long)st->count, (unsigned long long)st->misses,
+         100.0*st->misses/st->count, (double)st->max_ns/MSEC_TO_NSEC,
+         st->misses ? (double)st->over_sum_ns/st->misses/MSEC_TO_NSEC : 0.0,
+         (double)st->over_max_ns/MSEC_TO_NSEC, st->over_max_frame);
+  }
+
+  pthread_mutex_lock(&deadline_lock);
+  if (deadline_log != NULL) {
+    fclose(deadline_log);
+    deadline_log = NULL;
+  }
+  pthread_mutex_unlock(&deadline_lock);
+}
+
+DeadlineScope::DeadlineScope(deadline_stage_t s) : stage(s) {
+
+  start = (deadline_stats[s].budget_ns != 0) ? time_now_ns() : 0;
+}
+
+DeadlineScope::~DeadlineScope() {
+
+  if (start != 0) {
+    deadline_check(stage, current_frame, time_now_ns() - start);
+  }
+}
+
+// see .h for more details
+void deadline_collect_metrics(MetricsText& out, void*) {
+
+  char labels[64];
+  bool any = false;
+
+  for (int s = 0; s < DEADLINE_NUM_STAGES; s++) {
+    any = any || deadline_stats[s].budget_ns != 0;
+  }
+  if (!any) {
+    return;
+  }
+
+  out.family("emvia_deadline_checks_total", "counter",
+             "Steps checked against the budget of a stage.");
+  for (int s = 0; s < DEADLINE_NUM_STAGES; s++) {
+    if (deadline_stats[s].budget_ns != 0) {
+      snprintf(labels, sizeof(labels), "stage=\"%s\"", deadline_names[s]);
+      out.count("emvia_deadline_checks_total", labels,
+                metric_load(&deadline_stats[s].count));
+    }
+  }
+  out.family("emvia_deadline_misses_total", "counter",
+             "Steps over the budget of a stage.");
+  for (int s = 0; s < DEADLINE_NUM_STAGES; s++) {
+    if (deadline_stats[s].budget_ns != 0) {
+      snprintf(labels, sizeof(labels), "stage=\"%s\"", deadline_names[s]);
+      out.count("emvia_deadline_misses_total", labels,
+                metric_load(&deadline_stats[s].misses));
+    }
+  }
+}
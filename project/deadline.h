@@ -0,0 +1,125 @@
+/* ----------------------------------------------------------------------------
+ * @file deadline.h
+ * @brief Per-stage deadline budgets, overrun records and miss accounting
+ *
+ * Every monitored stage of a frame has an optional budget in msec:
+ *
+ *   decode     reading a frame from the source (capture)
+ *   gray, filter, threshold, hough, decide
+ *              the detector steps
+ *   annotate   drawing into the frame
+ *   encode     JPEG encoding
+ *   write      writing the frame file and the results row
+ *   frame      capture to written frame, end to end
+ *
+ * set from a spec like "hough=8,annotate=3,frame=33". A stage taking longer
+ * than its budget is a miss: it is counted, the longest overrun is kept
+ * with its frame, and it is appended to the miss log (frame, stage, msec)
+ * if one is open. An alarm goes to syslog at most once per alarm interval,
+ * with the number of misses since the previous alarm.
+ *
+ * The detector steps do not know the frame they work on, the thread that
+ * runs them sets it first with deadline_set_frame() (the pipeline does so
+ * before every Stage::process()). Steps are measured with
+ *
+ *   void f() { DEADLINE_SCOPE(DEADLINE_HOUGH); ... }
+ *
+ * which reads the clock only when a budget is set for the stage.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <stdint.h>
+
+#include "timing.h"
+
+class MetricsText;
+
+typedef enum {
+  DEADLINE_DECODE,
+  DEADLINE_GRAY,
+  DEADLINE_FILTER,
+  DEADLINE_THRESHOLD,
+  DEADLINE_HOUGH,
+  DEADLINE_DECIDE,
+  DEADLINE_ANNOTATE,
+  DEADLINE_ENCODE,
+  DEADLINE_WRITE,
+  DEADLINE_FRAME,
+  DEADLINE_NUM_STAGES
+} deadline_stage_t;
+
+/* @brief Sets the stage budgets
+ *
+ * @param spec, comma separated stage=msec, stages not listed are not
+ *        monitored
+ * @return false on an unknown stage or a malformed budget
+ */
+bool deadline_configure(const char* spec);
+
+/* @brief true if a budget is set for the stage
+ */
+bool deadline_is_set(deadline_stage_t stage);
+
+/* @brief Opens a CSV that gets one row per miss
+ *
+ * @return false if it cannot be created
+ */
+bool deadline_open_log(const char* path);
+
+/* @brief Minimum msec between two syslog alarms, 0 for no alarms
+ */
+void deadline_set_alarm_interval(double msec);
+
+/* @brief The frame the calling thread works on, for DEADLINE_SCOPE
+ */
+void deadline_set_frame(unsigned int frame_id);
+
+/* @brief Checks one stage of a frame against its budget
+ *
+ * @param stage, the stage
+ * @param frame_id, the frame
+ * @param ns, how long the stage took
+ */
+void deadline_check(deadline_stage_t stage, unsigned int frame_id,
+                    uint64_t ns);
+
+/* @brief Misses seen on the calling thread so far, a change tells a step
+ *        of the current frame missed its budget
+ */
+unsigned long deadline_thread_misses();
+
+/* @brief Prints budget, misses and longest overrun of every monitored
+ *        stage and closes the miss log
+ */
+void deadline_print();
+
+/* @brief Appends the checks and misses of every monitored stage, a
+ *        metrics collector (see metrics.h), arg unused
+ */
+void deadline_collect_metrics(MetricsText& out, void* arg);
+
+/* @brief Checks its scope against the budget of a stage, for the frame set
+ *        with deadline_set_frame()
+ */
+class DeadlineScope {
+
+private:
+
+  deadline_stage_t stage;
+  uint64_t start;     // 0 when the stage is not monitored
+
+public:
+
+  DeadlineScope(deadline_stage_t s);
+  ~DeadlineScope();
+};
+
+#define DEADLINE_SCOPE(stage) \
+  DeadlineScope TIMING_CONCAT(deadline_scope_, __LINE__)(stage)
+
+#endif // DEADLINE_H
@@ -0,0 +1,82 @@
+/* ----------------------------------------------------------------------------
+ * @file events.cpp
+ * @brief Lane departure event stream over a Unix datagram socket
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "events.h"
+
+LaneEventSocket::LaneEventSocket() {
+
+  fd = -1;
+  sent = 0;
+  dropped = 0;
+  memset(&addr, 0, sizeof(addr));
+}
+
+LaneEventSocket::~LaneEventSocket() {
+
+  close();
+}
+
+/* @brief Creates the sending socket for the given listener path
+ *
+ * @param path, the socket path the listener is (or will be) bound to
+ * @return true on success, the listener does not need to exist yet
+ */
+bool LaneEventSocket::open(const char* path) {
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "events: socket path too long: %s\n", path);
+    return false;
+  }
+
+  fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("events socket");
+    return false;
+  }
+
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  return true;
+}
+
+void LaneEventSocket::close() {
+
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+/* @brief Formats and sends one event datagram
+ *
+ * @param ev, the transition
+ * @param t_event, msec timestamp of the send, for latency accounting
+ */
+void LaneEventSocket::send(const lane_event_t& ev, double t_event) {
+
+  char msg[192];
+
+  if (fd < 0) return;
+
+  int n = snprintf(msg, sizeof(msg),
+    "LANE level=%i prev=%i frame=%u offset=%i width=%i "
+    "t_capture_ms=%.3f t_event_ms=%.3f\n",
+    (int)ev.warning, (int)ev.prev, ev.frame_num, ev.offset, ev.lane_width,
+    ev.t_capture, t_event);
+
+  if (sendto(fd, msg, n, MSG_DONTWAIT | MSG_NOSIGNAL, 
+             (struct sockaddr*)&addr, sizeof(addr)) == n) {
+    sent++;
+  } else {
+    dropped++;
+  }
+}
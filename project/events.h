@@ -0,0 +1,53 @@
+/* ----------------------------------------------------------------------------
+ * @file events.h
+ * @brief Lane departure event stream over a Unix datagram socket
+ *
+ * Each warning level transition is sent as one datagram, a single text line:
+ *
+ *   LANE level=<0..2> prev=<0..2> frame=<n> offset=<px> width=<px> 
+ *        t_capture_ms=<msec> t_event_ms=<msec>
+ *
+ * Timestamps are CLOCK_MONOTONIC. The listener owns the socket path, e.g.
+ * `socat -u UNIX-RECV:/tmp/lane_events STDOUT`. Sends never block: with no
+ * listener, or a full receive queue, the event is dropped and counted.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "lane.h"
+
+/* @brief The sender side of the lane event stream
+ */
+class LaneEventSocket {
+
+private:
+
+  int fd;
+  struct sockaddr_un addr;
+  unsigned long sent;
+  unsigned long dropped;
+
+public:
+
+  LaneEventSocket();
+  ~LaneEventSocket();
+
+  bool open(const char* path);
+  void close();
+  bool is_open() { return fd >= 0; }
+
+  // sends one event, never blocks
+  void send(const lane_event_t& ev, double t_event);
+
+  unsigned long get_sent() { return sent; }
+  unsigned long get_dropped() { return dropped; }
+};
+
+#endif // EVENTS_H
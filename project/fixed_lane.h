@@ -0,0 +1,98 @@
+/* ----------------------------------------------------------------------------
+ * @file fixed_lane.h
+ * @brief A LaneDetector specialized at compile time for one camera geometry
+ *
+ * The frame and ROI sizes, the threshold parameters and the Hough angle
+ * counts are template parameters, and the steps run the kernels of
+ * kernels_fixed.h instead of the runtime ones. Everything else (ROI, state,
+ * degradation, annotation) is the LaneDetector's, and frames of another
+ * size, or the degraded Hough levels, fall back to the runtime kernels, so
+ * the results are those of a LaneDetector in every case:
+ *
+ *   LaneDetector720p detector;      // 1280x720, ROI 400x137
+ *   detector.input_image(frame);
+ *   detector.detect();
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef FIXED_LANE_H
+#define FIXED_LANE_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "lane.h"
+#include "kernels_fixed.h"
+
+using namespace cv;
+
+// the Hough angles of the left and right theta windows at THETA_STEP
+#define FIXED_ANGLES_LEFT \
+  fixed_num_angle(THETA_LEFT_MIN, THETA_LEFT_MAX, THETA_STEP)
+#define FIXED_ANGLES_RIGHT \
+  fixed_num_angle(THETA_RIGHT_MIN, THETA_RIGHT_MAX, THETA_STEP)
+
+/* @brief LaneDetector for W x H frames with a RoiW x RoiH region of interest
+ */
+template <int W, int H, int RoiW, int RoiH>
+class FixedLaneDetector : public LaneDetector {
+
+private:
+
+  FixedHough<RoiW, RoiH, FIXED_ANGLES_LEFT> hough_left;
+  FixedHough<RoiW, RoiH, FIXED_ANGLES_RIGHT> hough_right;
+
+  // the BGR frame and the ROI have the compiled geometry
+  bool fixed_frame() const { return raw->cols == W && raw->rows == H; }
+  bool fixed_roi() const { return roi.cols == RoiW && roi.rows == RoiH; }
+
+protected:
+
+  void gray_rows(int row0, int row1) {
+    if (fixed_frame()) fixed_bgr2gray<W>(*raw, gray, row0, row1);
+    else LaneDetector::gray_rows(row0, row1);
+  }
+
+  void median_rows(int row0, int row1) {
+    if (fixed_roi()) fixed_median5<RoiW, RoiH>(roi, filtered, row0, row1);
+    else LaneDetector::median_rows(row0, row1);
+  }
+
+  void thresh_rows(int row0, int row1) {
+    if (fixed_roi()) {
+      fixed_thresh_mean5<RoiW, RoiH, THRESH_MAX, THRESH_DELTA>(roi, binary,
+                                                               row0, row1);
+    } else {
+      LaneDetector::thresh_rows(row0, row1);
+    }
+  }
+
+  // the full search only, the degraded levels search other sizes and steps
+  const std::vector<Vec3f>& hough_search(int side, int level, const Mat& img,
+                                         int threshold) {
+    if (level != DEGRADE_NONE || img.cols != RoiW || img.rows != RoiH) {
+      return LaneDetector::hough_search(side, level, img, threshold);
+    }
+    return (side == 0) ? hough_left.search(img, threshold)
+                       : hough_right.search(img, threshold);
+  }
+
+public:
+
+  FixedLaneDetector() {
+
+    set_frame_size(Size(W, H));
+    Rect r = get_roi_rect();
+    CV_Assert(r.width == RoiW && r.height == RoiH);
+
+    hough_left.configure(THETA_LEFT_MIN, THETA_LEFT_MAX, THETA_STEP);
+    hough_right.configure(THETA_RIGHT_MIN, THETA_RIGHT_MAX, THETA_STEP);
+  }
+};
+
+// the camera geometry of the project
+typedef FixedLaneDetector<1280, 720, 400, 137> LaneDetector720p;
+
+#endif // FIXED_LANE_H
@@ -0,0 +1,40 @@
+/* ----------------------------------------------------------------------------
+ * @file frame.h
+ * @brief The frame record passed between the pipeline stages
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "lane.h"
+#include "yuv.h"
+
+using namespace cv;
+
+/* @brief A captured (and later annotated) frame with its metadata
+ */
+typedef struct {
+  Mat img;              // raw frame, or annotated frame after processing
+  unsigned int id;      // capture sequence number
+  double t_capture;     // msec (CLOCK_MONOTONIC) when capture completed
+  lane_state_t state;   // detection result, valid after processing
+  Mat roi;              // binary ROI, between preprocessing and Hough
+  bool roi_skipped;     // preprocessing skipped in budgeted mode, no ROI
+  std::vector<uchar> jpeg;  // encoded frame, when encoded before writing
+  bool yuv;             // img is I420 (see yuv.h) instead of BGR
+} frame_t;
+
+/* @brief The picture size of a frame, BGR or I420
+ */
+static inline Size frame_size(const frame_t& frame) {
+
+  return frame.yuv ? yuv_size(frame.img) : frame.img.size();
+}
+
+#endif // FRAME_H
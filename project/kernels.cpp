@@ -0,0 +1,278 @@
+/* ----------------------------------------------------------------------------
+ * @file kernels.cpp
+ * @brief The image kernels of the lane detector, see kernels.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "kernels.h"
+
+// the median of a 5x5 window is the 13th value, 12 values are below it
+#define MEDIAN5_RANK (12)
+
+/* @brief Weighted B, G and R values (with the rounding term in R), built
+ *        before main() so no thread races on them
+ */
+static struct gray_table_t {
+  int tab[768];
+  gray_table_t() {
+    for (int i = 0; i < 256; i++) {
+      tab[i] = i*GRAY_B;
+      tab[i+256] = i*GRAY_G;
+      tab[i+512] = i*GRAY_R + (1 << (GRAY_SHIFT-1));
+    }
+  }
+} gray_table;
+
+static inline int clamp_index(int i, int n) {
+
+  return (i < 0) ? 0 : (i >= n) ? n-1 : i;
+}
+
+// see .h for more details
+void kern_bgr2gray(const Mat& bgr, Mat& gray, int row0, int row1) {
+
+  const int* tab = gray_table.tab;
+
+  for (int y = row0; y < row1; y++) {
+    const uchar* s = bgr.ptr<uchar>(y);
+    uchar* d = gray.ptr<uchar>(y);
+    for (int x = 0; x < bgr.cols; x++, s += 3) {
+      d[x] = (uchar)((tab[s[0]] + tab[s[1]+256] + tab[s[2]+512])
+                     >> GRAY_SHIFT);
+    }
+  }
+}
+
+// see .h for more details
+void kern_median5(const Mat& src, Mat& dst, int row0, int row1) {
+
+  int w = src.cols;
+  const uchar* rows[5];
+  int hist[256];
+
+  for (int y = row0; y < row1; y++) {
+
+    for (int k = 0; k < 5; k++) {
+      rows[k] = src.ptr<uchar>(clamp_index(y+k-2, src.rows));
+    }
+    uchar* d = dst.ptr<uchar>(y);
+
+    // the window of the first pixel, replicated columns on the left
+    memset(hist, 0, sizeof(hist));
+    for (int dx = -2; dx <= 2; dx++) {
+      int c = clamp_index(dx, w);
+      for (int k = 0; k < 5; k++) {
+        hist[rows[k][c]]++;
+      }
+    }
+
+    // m is the median, lt the count of window values below it
+    int m = 0, lt = 0;
+    while (lt + hist[m] <= MEDIAN5_RANK) {
+      lt += hist[m];
+      m++;
+    }
+    d[0] = (uchar)m;
+
+    for (int x = 1; x < w; x++) {
+
+      int out = clamp_index(x-3, w), in = clamp_index(x+2, w);
+      for (int k = 0; k < 5; k++) {
+        int v = rows[k][out];
+        hist[v]--;
+        lt -= (v < m);
+        v = rows[k][in];
+        hist[v]++;
+        lt += (v < m);
+      }
+
+      // the median moves by little between neighbours
+      while (lt > MEDIAN5_RANK) {
+        m--;
+        lt -= hist[m];
+      }
+      while (lt + hist[m] <= MEDIAN5_RANK) {
+        lt += hist[m];
+        m++;
+      }
+      d[x] = (uchar)m;
+    }
+  }
+}
+
+// see .h for more details
+void kern_thresh_table(uchar* tab, double max_value, double delta) {
+
+  int imax = saturate_cast<uchar>(max_value);
+  int idelta = cvCeil(delta);
+
+  for (int i = 0; i < 768; i++) {
+    tab[i] = (uchar)((i - 255 > -idelta) ? imax : 0);
+  }
+}
+
+/* @brief Sum of a column of the 5 rows around the current one
+ */
+static inline int column5(const uchar* const rows[5], int c) {
+
+  return rows[0][c] + rows[1][c] + rows[2][c] + rows[3][c] + rows[4][c];
+}
+
+// see .h for more details
+void kern_thresh_mean5(const Mat& src, Mat& dst, int row0, int row1,
+                       const uchar* tab) {
+
+  int w = src.cols;
+  const uchar* rows[5];
+  int ring[5];    // column sums of the window, oldest at ring[oldest]
+
+  for (int y = row0; y < row1; y++) {
+
+    for (int k = 0; k < 5; k++) {
+      rows[k] = src.ptr<uchar>(clamp_index(y+k-2, src.rows));
+    }
+    const uchar* s = src.ptr<uchar>(y);
+    uchar* d = dst.ptr<uchar>(y);
+
+    int sum = 0, oldest = 0;
+    for (int dx = -2; dx <= 2; dx++) {
+      ring[dx+2] = column5(rows, clamp_index(dx, w));
+      sum += ring[dx+2];
+    }
+
+    for (int x = 0; x < w; x++) {
+
+      // the rounded mean, as boxFilter() leaves it in the 8 bit mean image
+      int mean = (sum + 12) / 25;
+      d[x] = tab[s[x] - mean + 255];
+
+      sum -= ring[oldest];
+      ring[oldest] = column5(rows, clamp_index(x+3, w));
+      sum += ring[oldest];
+      oldest = (oldest == 4) ? 0 : oldest+1;
+    }
+  }
+}
+
+// see .h for more details
+void kern_half_nearest(const Mat& src, Mat& dst) {
+
+  for (int y = 0; y < dst.rows; y++) {
+    const uchar* s = src.ptr<uchar>(std::min(2*y, src.rows-1));
+    uchar* d = dst.ptr<uchar>(y);
+    for (int x = 0; x < dst.cols; x++) {
+      d[x] = s[std::min(2*x, src.cols-1)];
+    }
+  }
+}
+
+/* @brief Strongest first, the lower accumulator index on a tie
+ */
+struct hough_cmp_t {
+  const int* accum;
+  bool operator()(int a, int b) const {
+    return accum[a] > accum[b] || (accum[a] == accum[b] && a < b);
+  }
+};
+
+// see .h for more details
+void kern_hough_peaks(const int* accum, int numangle, int numrho,
+                      double theta_min, double theta_step, int threshold,
+                      std::vector<int>& sort_buf, std::vector<Vec3f>& lines) {
+
+  int stride = numrho + 2;
+
+  sort_buf.clear();
+  lines.clear();
+
+  // local maxima over the threshold
+  for (int r = 0; r < numrho; r++) {
+    for (int n = 0; n < numangle; n++) {
+      int base = (n+1)*stride + r+1;
+      int v = accum[base];
+      if (v > threshold && v > accum[base-1] && v >= accum[base+1] &&
+          v > accum[base-stride] && v >= accum[base+stride]) {
+        sort_buf.push_back(base);
+      }
+    }
+  }
+
+  hough_cmp_t cmp = {accum};
+  std::sort(sort_buf.begin(), sort_buf.end(), cmp);
+
+  for (size_t i = 0; i < sort_buf.size(); i++) {
+    int idx = sort_buf[i];
+    int n = idx/stride - 1;
+    int r = idx - (n+1)*stride - 1;
+    float rho = r - (numrho - 1)*0.5f;
+    float theta = (float)theta_min + n*theta_step;
+    lines.push_back(Vec3f(rho, theta, (float)accum[idx]));
+  }
+}
+
+HoughSearch::HoughSearch()
+  : theta_min(0.0), theta_step(0.0), numangle(0), numrho(0) {}
+
+// see .h for more details
+void HoughSearch::configure(Size img_size, double min_theta, double max_theta,
+                            double step) {
+
+  size = img_size;
+  theta_min = min_theta;
+  theta_step = step;
+  numangle = cvRound((max_theta - min_theta) / step);
+  numrho = cvRound((size.width + size.height)*2 + 1);
+
+  // one cell of padding around the accumulator, for the local maxima
+  accum.assign((numangle+2) * (numrho+2), 0);
+  sort_buf.clear();
+  sort_buf.reserve(numangle * numrho);
+  lines.clear();
+  lines.reserve(numangle * numrho);
+
+  // the angles accumulate in float, as in HoughLines()
+  tab_sin.resize(numangle);
+  tab_cos.resize(numangle);
+  float ang = (float)min_theta;
+  for (int n = 0; n < numangle; n++, ang += (float)step) {
+    tab_sin[n] = (float)sin((double)ang);
+    tab_cos[n] = (float)cos((double)ang);
+  }
+}
+
+// see .h for more details
+const std::vector<Vec3f>& HoughSearch::search(const Mat& img, int threshold) {
+
+  CV_Assert(img.size() == size && img.type() == CV_8UC1);
+
+  int* acc = &accum[0];
+  const float* ts = &tab_sin[0];
+  const float* tc = &tab_cos[0];
+  int stride = numrho + 2;
+  int rho_ofs = (numrho - 1) / 2;
+
+  memset(acc, 0, accum.size()*sizeof(int));
+
+  // fill the accumulator
+  for (int i = 0; i < size.height; i++) {
+    const uchar* p = img.ptr<uchar>(i);
+    for (int j = 0; j < size.width; j++) {
+      if (p[j] != 0) {
+        for (int n = 0; n < numangle; n++) {
+          int r = kern_hough_rho(j, i, tc[n], ts[n]) + rho_ofs;
+          acc[(n+1)*stride + r+1]++;
+        }
+      }
+    }
+  }
+
+  kern_hough_peaks(acc, numangle, numrho, theta_min, theta_step, threshold,
+                   sort_buf, lines);
+  return lines;
+}
@@ -0,0 +1,141 @@
+/* ----------------------------------------------------------------------------
+ * @file kernels.h
+ * @brief The image kernels of the lane detector, on buffers the caller
+ *        allocates once
+ *
+ * cvtColor, medianBlur, adaptiveThreshold, resize and HoughLines allocate
+ * scratch memory (border copies, the mean image, the accumulator, sort and
+ * output vectors) on every call, several times per frame. These kernels
+ * compute the same results for the parameters the detector uses, and never
+ * allocate: the Hough accumulator, trig tables and line buffers belong to
+ * a HoughSearch set up once per geometry.
+ *
+ * The row range kernels compute rows [row0, row1) of the result of the
+ * whole image, borders replicated at the image edges, so row strips need
+ * no halo copies and can run in parallel into one destination.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+using namespace cv;
+
+// cvtColor's fixed point gray weights, 14 fractional bits
+#define GRAY_SHIFT (14)
+#define GRAY_R     (4899)
+#define GRAY_G     (9617)
+#define GRAY_B     (1868)
+
+/* @brief BGR to gray, as cvtColor(COLOR_BGR2GRAY): 14 bit fixed point
+ *        weights from lookup tables
+ *
+ * @param bgr, CV_8UC3 source
+ * @param gray, CV_8UC1 destination of the same size
+ */
+void kern_bgr2gray(const Mat& bgr, Mat& gray, int row0, int row1);
+
+/* @brief 5x5 median filter, as medianBlur(src, dst, 5), with a sliding
+ *        256 bin histogram per row
+ *
+ * @param src, CV_8UC1 source, not dst
+ * @param dst, CV_8UC1 destination of the same size
+ */
+void kern_median5(const Mat& src, Mat& dst, int row0, int row1);
+
+/* @brief The lookup table of kern_thresh_mean5(), as adaptiveThreshold()
+ *        builds it for THRESH_BINARY: tab[src - mean + 255]
+ *
+ * @param tab, 768 entries
+ */
+void kern_thresh_table(uchar* tab, double max_value, double delta);
+
+/* @brief 5x5 mean adaptive threshold, as adaptiveThreshold(src, dst,
+ *        max_value, ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY, 5, delta)
+ *
+ * @param src, CV_8UC1 source, not dst
+ * @param dst, CV_8UC1 destination of the same size
+ * @param tab, see kern_thresh_table()
+ */
+void kern_thresh_mean5(const Mat& src, Mat& dst, int row0, int row1,
+                       const uchar* tab);
+
+/* @brief Nearest neighbour downscale to half size, as resize(src, dst,
+ *        Size(), 0.5, 0.5, INTER_NEAREST)
+ *
+ * @param dst, CV_8UC1 of kern_half_size(src.size())
+ */
+void kern_half_nearest(const Mat& src, Mat& dst);
+
+static inline Size kern_half_size(Size size) {
+
+  return Size(cvRound(size.width*0.5), cvRound(size.height*0.5));
+}
+
+/* @brief The rho of pixel (x, y) at the angle with cosine c and sine s,
+ *        the vote of every Hough search
+ *
+ * In double the products of the coordinates and the float table entries
+ * are exact, only the sum rounds, with or without a fused multiply-add:
+ * each loop that votes through it votes the same, whatever -ffast-math and
+ * the compiler's contraction of that loop.
+ */
+static inline int kern_hough_rho(int x, int y, float c, float s) {
+
+  return cvRound((double)x*c + (double)y*s);
+}
+
+/* @brief The lines of a filled Hough accumulator: the local maxima over
+ *        the threshold, sorted as HoughSearch::search() returns them
+ *
+ * @param accum, numangle+2 rows of numrho+2 votes, one cell of padding
+ * @param sort_buf, lines, reserved for numangle*numrho entries
+ */
+void kern_hough_peaks(const int* accum, int numangle, int numrho,
+                      double theta_min, double theta_step, int threshold,
+                      std::vector<int>& sort_buf, std::vector<Vec3f>& lines);
+
+/* @brief The standard Hough transform over a theta window, as HoughLines()
+ *        with 1 pixel rho steps (lines sorted by votes, then by theta and
+ *        rho, as Vec3f rho, theta, votes)
+ */
+class HoughSearch {
+
+private:
+
+  Size size;
+  double theta_min, theta_step;
+  int numangle, numrho;
+  std::vector<int> accum;
+  std::vector<int> sort_buf;
+  std::vector<float> tab_sin, tab_cos;
+  std::vector<Vec3f> lines;
+
+public:
+
+  HoughSearch();
+
+  /* @brief Sizes the buffers for an image size and theta window, the only
+   *        call that allocates
+   */
+  void configure(Size img_size, double min_theta, double max_theta,
+                 double step);
+
+  /* @brief Searches a binary image of the configured size
+   *
+   * @param img, CV_8UC1, non-zero pixels vote
+   * @param threshold, lines need more votes than this
+   * @return the lines, valid until the next search
+   */
+  const std::vector<Vec3f>& search(const Mat& img, int threshold);
+
+  // the lines of the last search
+  const std::vector<Vec3f>& get_lines() const { return lines; }
+};
+
+#endif // KERNELS_H
@@ -0,0 +1,284 @@
+/* ----------------------------------------------------------------------------
+ * @file kernels_fixed.h
+ * @brief The image kernels of kernels.h for one image geometry fixed at
+ *        compile time
+ *
+ * With the widths, heights and the number of Hough angles as template
+ * parameters every loop has a known trip count and every stencil fixed
+ * strides, so the compiler unrolls the stencils and vectorizes the rows:
+ *
+ *   fixed_bgr2gray    the weights as constant multiplies instead of the
+ *                     table lookups (a gather per channel)
+ *   fixed_median5     a selection network over blocks of FIXED_LANES
+ *                     columns, min/max on byte vectors, instead of the
+ *                     sliding histogram (a scalar dependency chain)
+ *   fixed_thresh_mean5  separable column and row sums and a compare
+ *                     instead of the running sum and the table
+ *   FixedHough        the votes of a pixel for all angles in one loop of
+ *                     known length, and 8 background pixels skipped at once
+ *
+ * The results equal those of the runtime kernels. Both Hough searches vote
+ * through kern_hough_rho(), which rounds the same in every loop.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef KERNELS_FIXED_H
+#define KERNELS_FIXED_H
+
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "kernels.h"
+
+using namespace cv;
+
+// columns of a block of the median network, a multiple of the vector width
+#define FIXED_LANES (32)
+
+/* @brief Rows of a 5 row stencil around row y, replicated at the edges
+ */
+template <int H>
+static inline void fixed_rows5(const Mat& src, int y, const uchar* rows[5]) {
+
+  for (int k = 0; k < 5; k++) {
+    int r = y + k - 2;
+    rows[k] = src.ptr<uchar>((r < 0) ? 0 : (r >= H) ? H-1 : r);
+  }
+}
+
+/* @brief BGR to gray, see kern_bgr2gray()
+ */
+template <int W>
+void fixed_bgr2gray(const Mat& bgr, Mat& gray, int row0, int row1) {
+
+  for (int y = row0; y < row1; y++) {
+    const uchar* s = bgr.ptr<uchar>(y);
+    uchar* d = gray.ptr<uchar>(y);
+    for (int x = 0; x < W; x++) {
+      d[x] = (uchar)((s[3*x]*GRAY_B + s[3*x+1]*GRAY_G + s[3*x+2]*GRAY_R
+                      + (1 << (GRAY_SHIFT-1))) >> GRAY_SHIFT);
+    }
+  }
+}
+
+// a, b = min(a, b), max(a, b) on every lane
+static inline void fixed_sort2(uchar* __restrict a, uchar* __restrict b) {
+
+  for (int l = 0; l < FIXED_LANES; l++) {
+    uchar x = a[l], y = b[l];
+    a[l] = (x < y) ? x : y;
+    b[l] = (x < y) ? y : x;
+  }
+}
+
+/* @brief 5x5 medians of FIXED_LANES neighbouring interior pixels
+ *
+ * Forgetful selection: of 14 values (half the window plus 2) the smallest
+ * and the largest cannot be the median, both are dropped and the next
+ * value taken in, until all 25 were seen and one value is left.
+ *
+ * @param rows, the 5 rows around the pixels
+ * @param x, the first column, 2 <= x <= width-2-FIXED_LANES
+ */
+static inline void fixed_median5_block(const uchar* const rows[5], int x,
+                                       uchar* dst) {
+
+  uchar a[14][FIXED_LANES];
+
+  for (int k = 0; k < 14; k++) {
+    memcpy(a[k], rows[k/5] + x + k%5 - 2, FIXED_LANES);
+  }
+
+  int lo = 0, hi = 13;
+  for (int k = 14; ; k++) {
+
+    // the minimum of a[lo..hi] to a[lo], the maximum to a[hi]
+    fixed_sort2(a[lo], a[hi]);
+    for (int i = lo+1; i < hi; i++) {
+      fixed_sort2(a[lo], a[i]);
+      fixed_sort2(a[i], a[hi]);
+    }
+    if (k == 25) {
+      break;
+    }
+
+    lo++;
+    memcpy(a[hi], rows[k/5] + x + k%5 - 2, FIXED_LANES);
+  }
+
+  memcpy(dst, a[lo+1], FIXED_LANES);
+}
+
+/* @brief 5x5 median filter, see kern_median5()
+ */
+template <int W, int H>
+void fixed_median5(const Mat& src, Mat& dst, int row0, int row1) {
+
+  static_assert(W >= FIXED_LANES + 4, "ROI narrower than a median block");
+
+  const uchar* rows[5];
+
+  for (int y = row0; y < row1; y++) {
+
+    fixed_rows5<H>(src, y, rows);
+    uchar* d = dst.ptr<uchar>(y);
+
+    // the last block is moved back to end at the last interior column
+    for (int x = 2; x < W-2; x += FIXED_LANES) {
+      int x0 = std::min(x, W-2-FIXED_LANES);
+      fixed_median5_block(rows, x0, d + x0);
+    }
+
+    // two columns at each side, replicated
+    static const int edge[4] = {0, 1, W-2, W-1};
+    for (int e = 0; e < 4; e++) {
+      uchar v[25];
+      for (int k = 0; k < 25; k++) {
+        int c = edge[e] + k%5 - 2;
+        v[k] = rows[k/5][(c < 0) ? 0 : (c >= W) ? W-1 : c];
+      }
+      std::nth_element(v, v + 12, v + 25);
+      d[edge[e]] = v[12];
+    }
+  }
+}
+
+/* @brief 5x5 mean adaptive threshold, see kern_thresh_mean5()
+ *
+ * @param Max, the binary value
+ * @param Delta, subtracted from the mean, integer as the detector uses it
+ */
+template <int W, int H, int Max, int Delta>
+void fixed_thresh_mean5(const Mat& src, Mat& dst, int row0, int row1) {
+
+  const uchar* rows[5];
+  uint16_t col[W+4];    // column sums, 2 replicated columns at each side
+
+  for (int y = row0; y < row1; y++) {
+
+    fixed_rows5<H>(src, y, rows);
+    const uchar* s = src.ptr<uchar>(y);
+    uchar* d = dst.ptr<uchar>(y);
+
+    for (int x = 0; x < W; x++) {
+      col[x+2] = rows[0][x] + rows[1][x] + rows[2][x] + rows[3][x]
+                 + rows[4][x];
+    }
+    col[0] = col[1] = col[2];
+    col[W+3] = col[W+2] = col[W+1];
+
+    // the rounded mean as in the table of kern_thresh_table()
+    for (int x = 0; x < W; x++) {
+      int mean = (col[x] + col[x+1] + col[x+2] + col[x+3] + col[x+4] + 12)
+                 / 25;
+      d[x] = (s[x] - mean > -Delta) ? (uchar)Max : 0;
+    }
+  }
+}
+
+/* @brief The number of angles of a theta window, as HoughSearch rounds it
+ */
+static constexpr int fixed_num_angle(double min_theta, double max_theta,
+                                     double step) {
+
+  return (int)((max_theta - min_theta) / step + 0.5);
+}
+
+/* @brief The standard Hough transform of an image of W x H over NumAngle
+ *        angles, see HoughSearch
+ */
+template <int W, int H, int NumAngle>
+class FixedHough {
+
+public:
+
+  static const int NUM_RHO = (W + H)*2 + 1;
+  static const int STRIDE = NUM_RHO + 2;
+  static const int RHO_OFS = (NUM_RHO - 1) / 2;
+
+private:
+
+  double theta_min, theta_step;
+  float tab_sin[NumAngle], tab_cos[NumAngle];
+  std::vector<int> accum;
+  std::vector<int> sort_buf;
+  std::vector<Vec3f> lines;
+
+  // the votes of pixel (x, y) for every angle
+  inline void vote(int* acc, int x, int y) {
+
+    int r[NumAngle];
+    for (int n = 0; n < NumAngle; n++) {
+      r[n] = kern_hough_rho(x, y, tab_cos[n], tab_sin[n]);
+    }
+    int* a = acc + STRIDE + RHO_OFS + 1;
+    for (int n = 0; n < NumAngle; n++) {
+      a[n*STRIDE + r[n]]++;
+    }
+  }
+
+public:
+
+  FixedHough() : theta_min(0.0), theta_step(0.0) {
+
+    accum.assign((NumAngle+2) * STRIDE, 0);
+    sort_buf.reserve(NumAngle * NUM_RHO);
+    lines.reserve(NumAngle * NUM_RHO);
+  }
+
+  /* @brief Sets the theta window, the trig tables as HoughSearch builds
+   *        them
+   */
+  void configure(double min_theta, double max_theta, double step) {
+
+    CV_Assert(cvRound((max_theta - min_theta) / step) == NumAngle);
+
+    theta_min = min_theta;
+    theta_step = step;
+    float ang = (float)min_theta;
+    for (int n = 0; n < NumAngle; n++, ang += (float)step) {
+      tab_sin[n] = (float)sin((double)ang);
+      tab_cos[n] = (float)cos((double)ang);
+    }
+  }
+
+  /* @brief Searches a binary W x H image, see HoughSearch::search()
+   */
+  const std::vector<Vec3f>& search(const Mat& img, int threshold) {
+
+    CV_Assert(img.cols == W && img.rows == H && img.type() == CV_8UC1);
+
+    int* acc = &accum[0];
+    memset(acc, 0, accum.size()*sizeof(int));
+
+    for (int y = 0; y < H; y++) {
+      const uchar* p = img.ptr<uchar>(y);
+      int x = 0;
+      for (; x + 8 <= W; x += 8) {
+        uint64_t word;
+        memcpy(&word, p + x, 8);
+        if (word == 0) {
+          continue;
+        }
+        for (int i = 0; i < 8; i++) {
+          if (p[x+i] != 0) vote(acc, x+i, y);
+        }
+      }
+      for (; x < W; x++) {
+        if (p[x] != 0) vote(acc, x, y);
+      }
+    }
+
+    kern_hough_peaks(acc, NumAngle, NUM_RHO, theta_min, theta_step, threshold,
+                     sort_buf, lines);
+    return lines;
+  }
+};
+
+#endif // KERNELS_FIXED_H
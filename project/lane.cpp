@@ -8,13 +8,75 @@
  *---------------------------------------------------------------------------*/
 
 #include "lane.h"
+#include "timing.h"
+#include "perfcnt.h"
+#include "deadline.h"
+#include "yuv.h"
+#include "kernels.h"
+#include "snapshot.h"
+
+// the geometry below was tuned for 1280x720 frames of the challenge clips
+#define DEFAULT_WIDTH  (1280)
+#define DEFAULT_HEIGHT (720)
+
+// adaptive threshold: lines a search should return, and the bounds of the
+// threshold relative to the fixed one
+#define ADAPT_CAND_MIN    (2)
+#define ADAPT_CAND_TARGET (8)
+#define ADAPT_CAND_MAX    (16)
+#define ADAPT_THRESH_LO   (0.5)
+#define ADAPT_THRESH_HI   (3.0)
+
+// budgeted mode: EWMA weight of a new cost sample, safety factor on the 
+// predicted costs, and the frames the previous lane lines are held for
+#define BUDGET_ALPHA      (0.125)
+#define BUDGET_MARGIN     (1.25)
+#define BUDGET_HOLD_MAX   (15)
+
+// Hough work of each level relative to the full search: half the theta 
+// steps, then a quarter of the pixels as well
+static const double degrade_work[DEGRADE_PREDICT] = {1.0, 0.5, 0.125};
+
+// theta windows (min, max) of the left and right lane lines
+static const double theta_window[2][2] = {
+  {THETA_LEFT_MIN, THETA_LEFT_MAX}, {THETA_RIGHT_MIN, THETA_RIGHT_MAX}
+};
+
+// the intermediate images a detector holds for the current frame
+#define HAVE_GRAY   (1)
+#define HAVE_MEDIAN (2)
+#define HAVE_BINARY (4)
+
+// the annotation labels, drawn at scale 0.5 (and 0.25 on the chroma planes)
+static const char* label_text[LABELS] = {"ROI", "!"};
+#define LABEL_SCALE (0.5)
+
+// wall/CPU time of the steps, see timing.h
+TIMING_STAT(gray_timing, "to_gray");
+TIMING_STAT(median_timing, "filter_roi");
+TIMING_STAT(thresh_timing, "threshold_roi");
+TIMING_STAT(hough_timing, "hough_transform");
+TIMING_STAT(decide_timing, "decide");
+TIMING_STAT(annotate_timing, "annotate");
+
+// perf counters of the steps, on threads with counters, see perfcnt.h
+PERF_STAT(gray_perf, "to_gray");
+PERF_STAT(median_perf, "filter_roi");
+PERF_STAT(thresh_perf, "threshold_roi");
+PERF_STAT(hough_perf, "hough_transform");
+PERF_STAT(decide_perf, "decide");
+PERF_STAT(annotate_perf, "annotate");
 
 /* @brief The default lane detector constructor
  *
- * assumes 1280x720 BGR color input images, and sets a pre-defined ROI 
+ * assumes 1280x720 BGR color input images, and sets a pre-defined ROI.
+ * Other frame sizes are handled by set_frame_size(), which input_image()
+ * calls when the frame size changes.
  */
 LaneDetector::LaneDetector() {
   
+  frame_size = Size(DEFAULT_WIDTH, DEFAULT_HEIGHT);
+
   // set default ROI
   // . . . . . . . . . . . . 
   // . . (0) . . . . (1) . . 
@@ -34,17 +96,111 @@ LaneDetector::LaneDetector() {
 
   proc_min = DBL_MAX;
   proc_max = 0.0;
+  proc_min_frame = proc_max_frame = 0;
+  proc_elapsed = 0.0;
   frame_num = 0;
   lines_detected = 0;
   is_left_found = false;
   is_right_found = false;
   vcenter = 605; // approximate vertical center 
+
+  // rho windows of the left and right lane lines in the ROI
+  rho_left_min = 90;
+  rho_left_max = 150;
+  rho_right_min = 150;
+  rho_right_max = 300;
+  acc_thresh = ACC_THRESH;
+  acc_base = ACC_THRESH;
+  adaptive = false;
+  for (int i = 0; i < 2; i++) {
+    side_thresh[i] = side_used[i] = acc_thresh;
+    side_cand[i] = 0;
+    side_lines[i] = NULL;
+  }
+
+  center_meas = vcenter;
+  offset = 0;
+  warning = LANE_OK;
+  prev_warning = LANE_OK;
+  event_cb = NULL;
+  event_ctx = NULL;
+  t_capture = 0.0;
+
+  pool = NULL;
+  strips = 1;
+  yuv = false;
+
+  budget = 0.0;
+  deadline = 0.0;
+  pre_cost = hough_cost = 0.0;
+  degrade = DEGRADE_NONE;
+  for (int i = 0; i < DEGRADE_LEVELS; i++) {
+    degrade_count[i] = 0;
+  }
+  budget_misses = 0;
+  held = 0;
+  for (int i = 0; i < 2; i++) {
+    last_found[i] = false;
+  }
+
+  snapshots = NULL;
+  have = 0;
+  snap_found[0] = snap_found[1] = false;
+  snap_warning = LANE_OK;
+  snap_misses = 0;
+  snap_budget_misses = 0;
+
+  // everything a frame needs, so that detection and annotation of the 
+  // frames of this size do not allocate
+  kern_thresh_table(thresh_tab, THRESH_MAX, THRESH_DELTA);
+  render_labels();
+  setup_buffers();
 }
 
-void LaneDetector::show() {
-  
-  imshow("1", roi);
-  imshow("2", annot);
+/* @brief Allocates the step outputs and the Hough searches for the frame
+ *        and ROI size, called again when the frame size changes
+ */
+void LaneDetector::setup_buffers() {
+
+  Size roi_size = get_roi_rect().size();
+
+  gray_bgr.create(frame_size, CV_8UC1);
+  filtered.create(roi_size, CV_8UC1);
+  binary.create(roi_size, CV_8UC1);
+  roi_half.create(kern_half_size(roi_size), CV_8UC1);
+
+  for (int side = 0; side < 2; side++) {
+    for (int level = DEGRADE_NONE; level < DEGRADE_PREDICT; level++) {
+      Size size = (level >= DEGRADE_HALF) ? roi_half.size() : roi_size;
+      double step = (level >= DEGRADE_COARSE) ? 2*THETA_STEP : THETA_STEP;
+      hough[side][level].configure(size, theta_window[side][0],
+                                   theta_window[side][1], step);
+    }
+  }
+}
+
+/* @brief Renders the annotation labels into masks once, putText() builds
+ *        its outline in a vector on every call
+ */
+void LaneDetector::render_labels() {
+
+  for (int l = 0; l < LABELS; l++) {
+    for (int half = 0; half < 2; half++) {
+
+      double scale = half ? LABEL_SCALE/2 : LABEL_SCALE;
+      int baseline = 0;
+      Size size = getTextSize(label_text[l], FONT_HERSHEY_SIMPLEX, scale, 1,
+                              &baseline);
+
+      // a margin for the stroke, the origin is the left end of the baseline
+      int pad = 2;
+      label_org[l][half] = Point(pad, pad + size.height);
+      label_mask[l][half] = Mat::zeros(size.height + baseline + 2*pad,
+                                       size.width + 2*pad, CV_8UC1);
+      putText(label_mask[l][half], label_text[l], label_org[l][half],
+              FONT_HERSHEY_SIMPLEX, scale, Scalar(255), 1);
+    }
+  }
 }
 
 /* @brief Detects left and right lane lines
@@ -52,23 +208,25 @@ void LaneDetector::show() {
  * Upon completion, the Points left_pt<i>, and right_pt<i> will be present
  * denoting the location of the left and right lane lines in the raw frame.
  * Also, if no lane lines were detected, the is_left_found and is_right_found
- * booleans will be set. Frames can be annotated after detection.
+ * booleans will be set. The departure decision is made right away, before
+ * any drawing, and frames can be annotated after detection.
+ *
+ * The steps are public so that they can be timed individually, they must
+ * be called in this order.
+ *
+ * In budgeted mode (set_budget()) the median filter and threshold are 
+ * skipped, and the previous lane lines kept, when they would not fit into
+ * what is left of the budget (see preprocess_roi()), and hough_transform()
+ * picks its level.
  *
  * @param None
  * @return None
  */
 void LaneDetector::detect() {
 
-  cvtColor(*raw, gray, COLOR_BGR2GRAY);
-  
-  // crop the region of interest - just a rectangular region for now
-  roi = gray(Rect(roi_pts[0], roi_pts[2]));
-
-  // apply median filter
-  medianBlur(roi, roi, 5);
-
-  // use 5x5 mean adaptive threshold over binary image, slightly raise
-  adaptiveThreshold(roi, roi, 255, ADAPTIVE_THRESH_MEAN_C, CV_THRESH_BINARY, 5, -2);
+  to_gray();
+  extract_roi();
+  preprocess_roi();
 
   // Begin Hough transform algorithm
   Vec4i left, right;
@@ -76,6 +234,211 @@ void LaneDetector::detect() {
   // run the Hough transform
   hough_transform(left, right);
 
+  find_endpoints(left, right);
+
+  decide();
+
+  if (snapshots != NULL) {
+    snapshot(frame_num);
+  }
+
+} // end detect()
+
+
+/* @brief filter_roi() and threshold_roi(), within the budget
+ *
+ * In budgeted mode both are skipped, and the previous lane lines kept, when
+ * they and a Hough search at half resolution would not fit into what is
+ * left of the budget. A pipeline preprocess node has no Hough cost of its
+ * own, there the two steps alone have to fit, and the hough node picks its
+ * level from what they left.
+ *
+ * @return false when skipped, the ROI is not binary then
+ */
+bool LaneDetector::preprocess_roi() {
+
+  double start = get_time_msec();
+  if (budget > 0.0 && 
+      start + (pre_cost + hough_cost*degrade_work[DEGRADE_HALF])*BUDGET_MARGIN
+      > deadline) {
+    degrade = DEGRADE_PREDICT;
+    pre_cost *= 1.0 - BUDGET_ALPHA;
+    return false;
+  }
+
+  filter_roi();
+  threshold_roi();
+  if (budget > 0.0) {
+    pre_cost += BUDGET_ALPHA*(get_time_msec() - start - pre_cost);
+  }
+  return true;
+}
+
+/* @brief Converts the raw BGR frame to grayscale, in YUV420 mode the Y 
+ *        plane is used as it is
+ */
+void LaneDetector::to_gray() {
+
+  TIMING_SCOPE(gray_timing);
+  PERF_SCOPE(gray_perf);
+  DEADLINE_SCOPE(DEADLINE_GRAY);
+
+  have |= HAVE_GRAY;
+  if (yuv) {
+    gray = raw->rowRange(0, frame_size.height);
+    return;
+  }
+
+  gray = gray_bgr;
+  if (pool == NULL) {
+    gray_rows(0, raw->rows);
+    return;
+  }
+
+  pool->parallel_for(strips, gray_strip, this);
+}
+
+/* @brief Crops the region of interest - just a rectangular region for now
+ */
+void LaneDetector::extract_roi() {
+
+  roi = gray(Rect(roi_pts[0], roi_pts[2]));
+}
+
+/* @brief Applies a 5x5 median filter to the ROI
+ */
+void LaneDetector::filter_roi() {
+
+  TIMING_SCOPE(median_timing);
+  PERF_SCOPE(median_perf);
+  DEADLINE_SCOPE(DEADLINE_FILTER);
+
+  have |= HAVE_MEDIAN;
+  if (pool == NULL) {
+    median_rows(0, roi.rows);
+  } else {
+    pool->parallel_for(strips, median_strip, this);
+  }
+  roi = filtered;
+}
+
+/* @brief Binarizes the ROI with a 5x5 mean adaptive threshold, slightly
+ *        raised
+ */
+void LaneDetector::threshold_roi() {
+
+  TIMING_SCOPE(thresh_timing);
+  PERF_SCOPE(thresh_perf);
+  DEADLINE_SCOPE(DEADLINE_THRESHOLD);
+
+  have |= HAVE_BINARY;
+  if (pool == NULL) {
+    thresh_rows(0, roi.rows);
+  } else {
+    pool->parallel_for(strips, thresh_strip, this);
+  }
+  roi = binary;
+}
+
+/* @brief Rows of strip i out of the strips of an image with the given rows
+ */
+Range LaneDetector::strip_rows(int i, int rows) {
+
+  return Range(rows*i/strips, rows*(i+1)/strips);
+}
+
+//
+// The kernels compute rows of the result of the whole image (see kernels.h),
+// so each strip writes its rows of the shared output directly.
+//
+
+/* @brief Task: grayscale conversion of one strip of the frame
+ */
+void LaneDetector::gray_strip(void* arg, int i) {
+
+  LaneDetector* d = (LaneDetector*) arg;
+  Range r = d->strip_rows(i, d->raw->rows);
+
+  d->gray_rows(r.start, r.end);
+}
+
+/* @brief Task: median filter of one strip of the ROI
+ */
+void LaneDetector::median_strip(void* arg, int i) {
+
+  LaneDetector* d = (LaneDetector*) arg;
+  Range r = d->strip_rows(i, d->roi.rows);
+
+  d->median_rows(r.start, r.end);
+}
+
+/* @brief Task: adaptive threshold of one strip of the ROI
+ */
+void LaneDetector::thresh_strip(void* arg, int i) {
+
+  LaneDetector* d = (LaneDetector*) arg;
+  Range r = d->strip_rows(i, d->roi.rows);
+
+  d->thresh_rows(r.start, r.end);
+}
+
+// see .h for more details
+void LaneDetector::gray_rows(int row0, int row1) {
+
+  kern_bgr2gray(*raw, gray, row0, row1);
+}
+
+// see .h for more details
+void LaneDetector::median_rows(int row0, int row1) {
+
+  kern_median5(roi, filtered, row0, row1);
+}
+
+// see .h for more details
+void LaneDetector::thresh_rows(int row0, int row1) {
+
+  kern_thresh_mean5(roi, binary, row0, row1, thresh_tab);
+}
+
+// see .h for more details
+const std::vector<Vec3f>& LaneDetector::hough_search(int side, int level,
+                                                     const Mat& img,
+                                                     int threshold) {
+
+  return hough[side][level].search(img, threshold);
+}
+
+/* @brief Task: Hough search of one lane line
+ */
+void LaneDetector::hough_task(void* arg, int side) {
+
+  LaneDetector* d = (LaneDetector*) arg;
+  d->side_found[side] = d->hough_side(side, d->side_line[side]);
+}
+
+/*
+ * @brief Enables the low-latency mode
+ *
+ * The results are identical to the sequential path, only the capture to 
+ * decision latency of a single frame changes.
+ *
+ * @param task_pool, the pool to run the tasks on, NULL for sequential
+ * @param num_strips, number of row strips of the preprocessing steps
+ */
+void LaneDetector::set_task_pool(TaskPool* task_pool, int num_strips) {
+
+  pool = task_pool;
+  strips = (num_strips > 1) ? num_strips : 1;
+}
+
+/* @brief Intersects the Hough lane lines with the ROI top and bottom side
+ *
+ * @param left, the left lane line from hough_transform()
+ * @param right, the right lane line from hough_transform()
+ * @return None
+ */
+void LaneDetector::find_endpoints(const Vec4i& left, const Vec4i& right) {
+
   if (is_left_found) {
 
     Point2f ret;
@@ -127,103 +490,310 @@ void LaneDetector::detect() {
     }
   }
 
+}
 
-} // end detect()
 
+/* @brief Makes the lane departure decision from the detected lane lines
+ *
+ * Compares the measured lane center against the vehicle center at the
+ * bottom of the ROI. An offset over 1/4 of the lane width is a departure,
+ * over 1/6 a warning. Fires the event callback on level transitions.
+ *
+ * @param None
+ * @return None
+ */
+void LaneDetector::decide() {
+
+  TIMING_SCOPE(decide_timing);
+  PERF_SCOPE(decide_perf);
+  DEADLINE_SCOPE(DEADLINE_DECIDE);
+
+  center_meas = (right_pt2.x + left_pt2.x)/2;
+  offset = center_meas - vcenter;
+  warning = classify();
+
+  if (warning != prev_warning && event_cb != NULL) {
+    lane_event_t ev;
+    ev.frame_num = frame_num;
+    ev.warning = warning;
+    ev.prev = prev_warning;
+    ev.offset = offset;
+    ev.lane_width = right_pt2.x - left_pt2.x;
+    ev.t_capture = t_capture;
+    ev.t_decision = get_time_msec();
+    event_cb(ev, event_ctx);
+  }
+  prev_warning = warning;
+}
+
+
+/* @brief The warning level of the current lane lines, see decide()
+ */
+lane_warning_t LaneDetector::classify() {
+
+  int off = (right_pt2.x + left_pt2.x)/2 - (int)vcenter;
+
+  if (abs(off) > (right_pt2.x-left_pt2.x)/4) {
+    return LANE_DEPART;
+  } else if (abs(off) > (right_pt2.x-left_pt2.x)/6) {
+    return LANE_WARN;
+  }
+  return LANE_OK;
+}
+
+/* @brief Copies the intermediate images, Hough peaks and the result of the
+ *        current frame into the snapshot ring, when it samples the frame or
+ *        a trigger fires (see snapshot.h)
+ *
+ * The triggers compare against the previous call, the warning is computed
+ * here since decide() may run on another detector.
+ *
+ * @param frame_id, the frame number in the snapshot
+ */
+void LaneDetector::snapshot(unsigned int frame_id) {
+
+  if (snapshots == NULL) {
+    return;
+  }
+
+  int fired = 0;
+  bool found[2] = {is_left_found, is_right_found};
+  for (int i = 0; i < 2; i++) {
+    if (snap_found[i] && !found[i]) {
+      fired |= SNAP_LOST;
+    }
+    snap_found[i] = found[i];
+  }
+
+  lane_warning_t w = classify();
+  if (w > snap_warning) {
+    fired |= SNAP_WARN;
+  }
+  snap_warning = w;
+
+  unsigned long misses = deadline_thread_misses();
+  if (misses != snap_misses || budget_misses != snap_budget_misses) {
+    fired |= SNAP_DEADLINE;
+  }
+  snap_misses = misses;
+  snap_budget_misses = budget_misses;
+
+  int reasons = snapshots->wanted(frame_id, fired);
+  if (reasons == 0) {
+    return;
+  }
+  snap_slot_t* s = snapshots->begin();
+  if (s == NULL) {
+    return;
+  }
+
+  s->frame = frame_id;
+  s->reasons = reasons;
+  s->t_capture = t_capture;
+  get_state(s->state);
+  s->state.frame_num = frame_id;
+  s->state.warning = w;
+
+  s->has_gray = (have & HAVE_GRAY) != 0;
+  s->has_median = (have & HAVE_MEDIAN) != 0;
+  s->has_binary = (have & HAVE_BINARY) != 0;
+  if (s->has_gray) {
+    gray(get_roi_rect()).copyTo(s->gray);
+  }
+  if (s->has_median) {
+    filtered.copyTo(s->median);
+  }
+  if (s->has_binary) {
+    roi.copyTo(s->binary);
+  }
+
+  // the peaks of this frame's search, none when the lines were held
+  int scale = (degrade >= DEGRADE_HALF) ? 2 : 1;
+  for (int side = 0; side < 2; side++) {
+    s->peaks[side] = 0;
+    if (degrade == DEGRADE_PREDICT || side_lines[side] == NULL) {
+      continue;
+    }
+    const std::vector<Vec3f>& lines = *side_lines[side];
+    for (size_t i = 0; i < lines.size() && i < SNAP_PEAKS; i++) {
+      s->peak[side][i] = Vec3f(lines[i][0]*scale, lines[i][1], lines[i][2]);
+      s->peaks[side]++;
+    }
+  }
+
+  snapshots->commit(s);
+}
 
 /* @brief Uses a standard hough transform to return coordinates of 
  *        left/right lane lines
  *
  * Operates on the binary ROI image and uses certain bounds on rho and 
- * theta for detecting left and right lane lines.
+ * theta for detecting left and right lane lines. The two searches are
+ * independent, in low-latency mode they run in parallel.
  *
  * @param left&, reference for the left lane line points - vectorized
  * @param right&, reference for the right lane line points - vectorized 
  *
  * @return None
  */
-#define ACC_THRESH (30)
 void LaneDetector::hough_transform(Vec4i& left, Vec4i& right) {
 
-  std::vector<Vec3f> lines;
-  unsigned int i=0;
- 
-  is_left_found = false;
-  is_right_found = false;
+  TIMING_SCOPE(hough_timing);
+  PERF_SCOPE(hough_perf);
+  DEADLINE_SCOPE(DEADLINE_HOUGH);
 
-  // detects left lane lines:
-  HoughLines(
-      roi,           // image
-      lines,         // lines
-      1,             // rho resolution of accumulator in pixels
-      CV_PI/180,     // theta resolution of accumulator 
-      ACC_THRESH,    // accumulator threshold, only lines >threshold returned
-      0,             // srn - set to 0 for classical Hough
-      0,             // stn - set to 0 for classical Hough
-      0.174533,      // minimum theta 
-      1.134464       // maximum theta 
-  );
+  if (budget > 0.0 && degrade != DEGRADE_PREDICT) {
+    degrade = pick_degrade();
+  }
 
-  
-  while( !(is_left_found) && i < lines.size() ) {
+  if (degrade == DEGRADE_PREDICT) {
 
-    // sourced from OpenCV Hough tutorial:
-    float rho = lines[i][0], theta = lines[i][1];
-    if (abs(rho) > 90 && abs(rho) < 150) {
-      //LOGP("rho: %f, theta: %f, votes: %f\n", rho, theta*180/CV_PI, lines[i][2]);
-      double a = cos(theta), b = sin(theta);
-      double x0 = a*rho, y0 = b*rho;
-      left[0] = cvRound(x0 + 1000*(-b));
-      left[1] = cvRound(y0 + 1000*(a));
-      left[2] = cvRound(x0 - 1000*(-b));
-      left[3] = cvRound(y0 - 1000*(a));
-      is_left_found = true;
+    // keep the previous lines for a while, then report them lost
+    held++;
+    is_left_found = last_found[0] && held <= BUDGET_HOLD_MAX;
+    is_right_found = last_found[1] && held <= BUDGET_HOLD_MAX;
+    left = last_line[0];
+    right = last_line[1];
+    for (int i = 0; i < 2; i++) {
+      side_cand[i] = 0;
+    }
+
+    // forget the cost estimate slowly, so a spike cannot lock out the search
+    hough_cost *= 1.0 - BUDGET_ALPHA;
+
+  } else {
+
+    double start = get_time_msec();
+    if (degrade >= DEGRADE_HALF) {
+      kern_half_nearest(roi, roi_half);
+    }
+
+    if (pool == NULL) {
+      is_left_found = hough_side(0, left);
+      is_right_found = hough_side(1, right);
+    } else {
+      pool->parallel_for(2, hough_task, this);
+      is_left_found = side_found[0];
+      is_right_found = side_found[1];
+      if (is_left_found) left = side_line[0];
+      if (is_right_found) right = side_line[1];
+    }
+
+    // the estimate is kept in full search terms, every level updates it
+    if (budget > 0.0) {
+      double cost = (get_time_msec() - start) / degrade_work[degrade];
+      hough_cost += BUDGET_ALPHA*(cost - hough_cost);
     }
 
-    i++;
+    held = 0;
+    last_found[0] = is_left_found;
+    last_found[1] = is_right_found;
+    if (is_left_found) last_line[0] = left;
+    if (is_right_found) last_line[1] = right;
   }
 
-  lines.clear(); i=0;
+  degrade_count[degrade]++;
+  if (budget > 0.0 && get_time_msec() > deadline) {
+    budget_misses++;
+  }
+}
 
-  // detects right lane lines:
-  HoughLines(
-      roi,           // image
-      lines,         // lines
-      1,             // rho resolution of accumulator in pixels
-      CV_PI/180,     // theta resolution of accumulator 
-      ACC_THRESH,    // accumulator threshold, only lines >threshold returned
-      0,             // srn - set to 0 for classical Hough
-      0,             // stn - set to 0 for classical Hough
-      2.007129,      // minimum theta 
-      2.967060       // maximum theta 
-  );
+/* @brief Picks the best Hough level whose predicted cost fits into what is
+ *        left of the budget of the current frame
+ */
+lane_degrade_t LaneDetector::pick_degrade() {
 
-  
-  while( !(is_right_found) && i < lines.size() ) {
+  double left = deadline - get_time_msec();
+
+  for (int d = DEGRADE_NONE; d < DEGRADE_PREDICT; d++) {
+    if (hough_cost*degrade_work[d]*BUDGET_MARGIN <= left) {
+      return (lane_degrade_t) d;
+    }
+  }
+  return DEGRADE_PREDICT;
+}
+
+/* @brief The Hough search of one lane line
+ *
+ * @param side, 0 for the left and 1 for the right lane line
+ * @param line&, the lane line points, only written if found
+ * @return true if a line was found inside the rho window
+ */
+bool LaneDetector::hough_side(int side, Vec4i& line) {
+
+  int thresh = adaptive ? side_thresh[side] : acc_thresh;
+
+  // degraded levels, the votes shrink with the image
+  const Mat& img = (degrade >= DEGRADE_HALF) ? roi_half : roi;
+  int scale = (degrade >= DEGRADE_HALF) ? 2 : 1;
+
+  int rho_min = side ? rho_right_min : rho_left_min;
+  int rho_max = side ? rho_right_max : rho_left_max;
+
+  // classical Hough, 1 pixel rho steps, 1 (or 2) degree theta steps over
+  // the theta window of the side, only lines > threshold returned
+  const std::vector<Vec3f>& lines = hough_search(side, degrade, img,
+                                                 thresh/scale);
+  side_lines[side] = &lines;
+
+  side_used[side] = thresh/scale;
+  side_cand[side] = lines.size();
+  if (adaptive && degrade == DEGRADE_NONE) {
+    adapt_thresh(side, lines);
+  }
+
+  for (unsigned int i = 0; i < lines.size(); i++) {
 
     // sourced from OpenCV Hough tutorial:
-    float rho = lines[i][0], theta = lines[i][1];
-    if ( abs(rho) > 150 && abs(rho) < 300) {
+    float rho = lines[i][0]*scale, theta = lines[i][1];
+    if (abs(rho) > rho_min && abs(rho) < rho_max) {
       //LOGP("rho: %f, theta: %f, votes: %f\n", rho, theta*180/CV_PI, lines[i][2]);
       double a = cos(theta), b = sin(theta);
       double x0 = a*rho, y0 = b*rho;
-      right[0] = cvRound(x0 + 1000*(-b));
-      right[1] = cvRound(y0 + 1000*(a));
-      right[2] = cvRound(x0 - 1000*(-b));
-      right[3] = cvRound(y0 - 1000*(a));
-      is_right_found = true;
+      line[0] = cvRound(x0 + 1000*(-b));
+      line[1] = cvRound(y0 + 1000*(a));
+      line[2] = cvRound(x0 - 1000*(-b));
+      line[3] = cvRound(y0 - 1000*(a));
+      return true;
     }
+  }
+
+  return false;
+}
+
+/* @brief Picks the threshold of the next search of one side
+ *
+ * The lines come sorted by votes, strongest first. Too many candidates:
+ * move halfway to the votes of the ADAPT_CAND_TARGET-th line, which would
+ * have returned about the target count. Too few (faded paint): lower the
+ * threshold by 1/8. The threshold stays within ADAPT_THRESH_LO..HI of the 
+ * fixed one, so a frame without any paint cannot drag it into the noise.
+ *
+ * @param side, 0 for the left and 1 for the right lane line
+ * @param lines, the lines of this frame's search
+ */
+void LaneDetector::adapt_thresh(int side, const std::vector<Vec3f>& lines) {
 
-    i++;
+  int thresh = side_thresh[side];
+  int n = lines.size();
+
+  if (n > ADAPT_CAND_MAX) {
+    int votes = cvRound(lines[ADAPT_CAND_TARGET-1][2]);
+    thresh = (thresh + votes + 1) / 2;
+  } else if (n < ADAPT_CAND_MIN) {
+    thresh -= std::max(thresh/8, 1);
   }
 
+  int lo = cvRound(acc_thresh*ADAPT_THRESH_LO);
+  int hi = cvRound(acc_thresh*ADAPT_THRESH_HI);
+  side_thresh[side] = std::min(std::max(thresh, lo), hi);
 }
 
 /* @brief Checks if the point is valid within the bounds of annot
  */
 bool LaneDetector::is_inside_annot(Point p) {
 
-  if (0<=p.x && p.x<annot.cols && 0<=p.y && p.y<annot.rows) 
+  if (0<=p.x && p.x<frame_size.width && 0<=p.y && p.y<frame_size.height) 
     return true;
   else
     return false;
@@ -252,6 +822,88 @@ bool intersection(Point2f o1, Point2f p1, Point2f o2, Point2f p2, Point2f &r)
     return true;
 }
 
+/* @brief Draws a line into the BGR frame, or into the Y, U and V planes
+ *        (at half the size on the chroma planes)
+ */
+void LaneDetector::draw_line(Point p1, Point p2, const Scalar& color, 
+                             int thickness, int type) {
+
+  if (!yuv) {
+    line(annot, p1, p2, color, thickness, type);
+    return;
+  }
+
+  Scalar c = yuv_color(color);
+  int half = std::max(thickness/2, 1);
+  Point q1(p1.x/2, p1.y/2), q2(p2.x/2, p2.y/2);
+  line(planes[0], p1, p2, Scalar(c[0]), thickness, type);
+  line(planes[1], q1, q2, Scalar(c[1]), half, type);
+  line(planes[2], q1, q2, Scalar(c[2]), half, type);
+}
+
+/* @brief Draws a rectangle, see draw_line()
+ */
+void LaneDetector::draw_rect(Point p1, Point p2, const Scalar& color,
+                             int thickness, int type) {
+
+  if (!yuv) {
+    rectangle(annot, p1, p2, color, thickness, type);
+    return;
+  }
+
+  Scalar c = yuv_color(color);
+  int half = std::max(thickness/2, 1);
+  Point q1(p1.x/2, p1.y/2), q2(p2.x/2, p2.y/2);
+  rectangle(planes[0], p1, p2, Scalar(c[0]), thickness, type);
+  rectangle(planes[1], q1, q2, Scalar(c[1]), half, type);
+  rectangle(planes[2], q1, q2, Scalar(c[2]), half, type);
+}
+
+/* @brief Draws a label, see draw_line(), from its mask (render_labels())
+ *        with the same pixels as putText() at org
+ */
+void LaneDetector::draw_text(lane_label_t label, Point org,
+                             const Scalar& color) {
+
+  if (!yuv) {
+    stamp(annot, label_mask[label][0], org - label_org[label][0], color);
+    return;
+  }
+
+  Scalar c = yuv_color(color);
+  Point half(org.x/2, org.y/2);
+  stamp(planes[0], label_mask[label][0], org - label_org[label][0], 
+        Scalar(c[0]));
+  stamp(planes[1], label_mask[label][1], half - label_org[label][1], 
+        Scalar(c[1]));
+  stamp(planes[2], label_mask[label][1], half - label_org[label][1], 
+        Scalar(c[2]));
+}
+
+/* @brief Sets the pixels of a mask placed at top left tl to color, clipped
+ *        to the image, 1 or 3 channels
+ */
+void LaneDetector::stamp(Mat& img, const Mat& mask, Point tl, 
+                         const Scalar& color) {
+
+  int cn = img.channels();
+  uchar c[3] = {saturate_cast<uchar>(color[0]), saturate_cast<uchar>(color[1]),
+                saturate_cast<uchar>(color[2])};
+
+  for (int y = std::max(-tl.y, 0); y < mask.rows && tl.y + y < img.rows; y++) {
+    const uchar* m = mask.ptr<uchar>(y);
+    uchar* p = img.ptr<uchar>(tl.y + y);
+    for (int x = std::max(-tl.x, 0); x < mask.cols && tl.x + x < img.cols; 
+         x++) {
+      if (m[x]) {
+        for (int k = 0; k < cn; k++) {
+          p[(tl.x + x)*cn + k] = c[k];
+        }
+      }
+    }
+  }
+}
+
 #define RED    (Scalar( 96,  94, 211))
 #define GREEN  (Scalar( 91, 186, 132))
 #define BLUE   (Scalar(203, 147, 114))
@@ -262,69 +914,290 @@ bool intersection(Point2f o1, Point2f p1, Point2f o2, Point2f p2, Point2f &r)
  */
 void LaneDetector::annotate() {
   
+  TIMING_SCOPE(annotate_timing);
+  PERF_SCOPE(annotate_perf);
+  DEADLINE_SCOPE(DEADLINE_ANNOTATE);
   if (is_left_found 
       && is_inside_annot(left_pt1) 
       && is_inside_annot(left_pt2) ) {
-    line(annot, left_pt1, left_pt2, RED, 3, LINE_4);
+    draw_line(left_pt1, left_pt2, RED, 3, LINE_4);
     lines_detected++;
   }
 
   if (is_right_found
       && is_inside_annot(right_pt1) 
       && is_inside_annot(right_pt2) ) {
-    line(annot, right_pt1, right_pt2, RED, 3, LINE_4);
+    draw_line(right_pt1, right_pt2, RED, 3, LINE_4);
     lines_detected++;
   }
 
   // annotate ROI
-  rectangle(annot, roi_pts[0], roi_pts[2], BLUE, 1, LINE_AA);  
-  putText(annot, "ROI", roi_pts[0], FONT_HERSHEY_SIMPLEX, 0.5, BLUE, 1.5);
+  draw_rect(roi_pts[0], roi_pts[2], BLUE, 1, LINE_AA);  
+  draw_text(LABEL_ROI, roi_pts[0], BLUE);
 
-  unsigned int center_meas = (right_pt2.x + left_pt2.x)/2;
-  int offset = center_meas - vcenter;
   Scalar tick_color;
 
   // annotate bottom black line
-  line(annot, right_pt2, left_pt2, BLACK, LINE_8); 
+  draw_line(right_pt2, left_pt2, BLACK, LINE_8, LINE_8); 
   Point tick_bottom = Point(vcenter, right_pt2.y);
   Point center_meas_bottom = Point(center_meas, right_pt2.y); 
-  if (abs(offset) > (right_pt2.x-left_pt2.x)/4) {
+
+  // the decision was already made in decide(), only draw it here
+  if (warning == LANE_DEPART) {
     tick_color = RED; 
-    putText(annot, "!", roi_pts[1], FONT_HERSHEY_SIMPLEX, 0.5, RED, 1.5);
-  } else if (abs(offset) > (right_pt2.x-left_pt2.x)/6) {
+    draw_text(LABEL_DEPART, roi_pts[1], RED);
+  } else if (warning == LANE_WARN) {
     tick_color = YELLOW;
   } else {
     tick_color = GREEN;
   }
-  line(annot, tick_bottom+Point(0, -8), tick_bottom+Point(0, 8), tick_color, LINE_4); 
+  draw_line(tick_bottom+Point(0, -8), tick_bottom+Point(0, 8), tick_color, LINE_4, LINE_8); 
   
   if (is_left_found && is_right_found) {
-    line(annot, center_meas_bottom+Point(0, -8), center_meas_bottom+Point(0, 8), RED, LINE_4); 
+    draw_line(center_meas_bottom+Point(0, -8), center_meas_bottom+Point(0, 8), RED, LINE_4, LINE_8); 
   }
 
   frame_num++;
 
   proc_end = get_time_msec();
+  // no syslog here: glibc before 2.37 allocates for every message, the
+  // extremes are kept with their frames and logged by the caller at exit
   if (proc_end-proc_start < proc_min) {
     proc_min = proc_end-proc_start;
-    LOGSYS("proc_min: %6.2f, frame: %i", proc_min, frame_num);
+    proc_min_frame = frame_num;
   }
   if (proc_end-proc_start > proc_max) {
     proc_max = proc_end-proc_start;
-    LOGSYS("proc_max: %6.2f, frame: %i", proc_max, frame_num);
+    proc_max_frame = frame_num;
   }
-  LOGSYS("MVPROC %6.2f", get_time_msec()); 
   proc_elapsed += proc_end-proc_start;
 
 }
 
 
+/*
+ * @brief Copies out the detection result of the most recent frame
+ */
+void LaneDetector::get_state(lane_state_t& state) {
+
+  state.frame_num = frame_num;
+  state.is_left_found = is_left_found;
+  state.is_right_found = is_right_found;
+  state.left_pt1 = left_pt1;
+  state.left_pt2 = left_pt2;
+  state.right_pt1 = right_pt1;
+  state.right_pt2 = right_pt2;
+  state.offset = offset;
+  state.warning = warning;
+  for (int i = 0; i < 2; i++) {
+    state.thresh[i] = side_used[i];
+    state.candidates[i] = side_cand[i];
+  }
+  state.degrade = degrade;
+}
+
+/*
+ * @brief Takes over the binary ROI of a frame preprocessed by another
+ *        detector instance
+ *
+ * @param binary_roi, the ROI after threshold_roi(), not modified, empty
+ *        when preprocess_roi() skipped it: the previous lines are kept
+ * @param size, the size of the frame the ROI was taken from
+ * @param capture_time, msec timestamp of the capture, passed on to events
+ */
+void LaneDetector::load_roi(const Mat& binary_roi, Size size, 
+                            double capture_time) {
+
+  t_capture = capture_time;
+  if (size != frame_size) {
+    set_frame_size(size);
+  }
+  roi = binary_roi;
+  have = binary_roi.empty() ? 0 : HAVE_BINARY;
+  start_budget(capture_time);
+  if (binary_roi.empty()) {
+    degrade = DEGRADE_PREDICT;
+  }
+}
+
+/*
+ * @brief Takes over the lane lines (and decision) of a frame detected by 
+ *        another detector instance
+ *
+ * The frame number is taken from the state as well, so that events and 
+ * logs refer to the frame and not to this instance's frame count.
+ *
+ * @param state, the detection result of the frame
+ * @param size, the frame size
+ * @param capture_time, msec timestamp of the capture, passed on to events
+ */
+void LaneDetector::load_state(const lane_state_t& state, Size size,
+                              double capture_time) {
+
+  t_capture = capture_time;
+  if (size != frame_size) {
+    set_frame_size(size);
+  }
+  frame_num = state.frame_num;
+  is_left_found = state.is_left_found;
+  is_right_found = state.is_right_found;
+  left_pt1 = state.left_pt1;
+  left_pt2 = state.left_pt2;
+  right_pt1 = state.right_pt1;
+  right_pt2 = state.right_pt2;
+  offset = state.offset;
+  center_meas = vcenter + offset;
+  warning = state.warning;
+  for (int i = 0; i < 2; i++) {
+    side_used[i] = state.thresh[i];
+    side_cand[i] = state.candidates[i];
+  }
+  degrade = state.degrade;
+}
+
+/*
+ * @brief Scales the ROI, vehicle center, rho windows and accumulator 
+ *        threshold from the 1280x720 defaults to another frame size
+ *
+ * Assumes the same camera placement, i.e. the scene is only resampled.
+ *
+ * @param size, the new frame size
+ * @return None
+ */
+void LaneDetector::set_frame_size(Size size) {
+
+  double sx = (double)size.width / DEFAULT_WIDTH;
+  double sy = (double)size.height / DEFAULT_HEIGHT;
+  double s = (sx + sy) / 2;
+
+  frame_size = size;
+  roi_pts[0] = Point(cvRound(350*sx), cvRound(430*sy)); // top left
+  roi_pts[1] = Point(cvRound(750*sx), cvRound(430*sy)); // top right
+  roi_pts[2] = Point(cvRound(750*sx), cvRound(567*sy)); // bottom right
+  roi_pts[3] = Point(cvRound(350*sx), cvRound(567*sy)); // bottom left
+  vcenter = cvRound(605*sx);
+  center_meas = vcenter;
+
+  rho_left_min = cvRound(90*s);
+  rho_left_max = cvRound(150*s);
+  rho_right_min = cvRound(150*s);
+  rho_right_max = cvRound(300*s);
+
+  // votes grow with the length of a line in the ROI
+  acc_thresh = cvRound(acc_base*sy);
+  for (int i = 0; i < 2; i++) {
+    side_thresh[i] = acc_thresh;
+  }
+
+  setup_buffers();
+}
+
+/*
+ * @brief Sets the accumulator threshold (ACC_THRESH by default)
+ *
+ * @param thresh, the threshold for 1280x720 frames
+ */
+void LaneDetector::set_acc_thresh(int thresh) {
+
+  double sy = (double)frame_size.height / DEFAULT_HEIGHT;
+
+  acc_base = thresh;
+  acc_thresh = cvRound(acc_base*sy);
+  for (int i = 0; i < 2; i++) {
+    side_thresh[i] = acc_thresh;
+  }
+}
+
+/*
+ * @brief Enables the adaptive accumulator threshold
+ *
+ * Each side's threshold follows the vote distribution of its previous 
+ * frame, aiming for ADAPT_CAND_MIN..MAX candidate lines: busy frames 
+ * (shadows, intersections) return fewer lines to walk, faded paint gets a
+ * lower threshold. Starts from the fixed threshold.
+ *
+ * @param enable, false for the fixed threshold
+ */
+void LaneDetector::set_adaptive_thresh(bool enable) {
+
+  adaptive = enable;
+  for (int i = 0; i < 2; i++) {
+    side_thresh[i] = acc_thresh;
+  }
+}
+
+/*
+ * @brief Enables the budgeted mode
+ *
+ * Every frame gets msec for detection up to the lane lines, counted from 
+ * its capture time (from input_image() or load_roi() without one). The 
+ * steps are not interrupted, instead each is only started when its cost 
+ * (an EWMA of the previous frames, with a safety margin) fits into what is
+ * left: the Hough search drops to 2 degree theta steps, then to the ROI at
+ * half resolution, and when not even that fits the lane lines of the 
+ * previous frame are kept (for up to BUDGET_HOLD_MAX frames). The level 
+ * used is in lane_state_t.degrade. Deadlines missed anyway (a step that 
+ * ran over its estimate) are counted, see get_budget_misses().
+ *
+ * @param msec, the budget per frame, 0 to disable
+ */
+void LaneDetector::set_budget(double msec) {
+
+  budget = (msec > 0.0) ? msec : 0.0;
+  pre_cost = hough_cost = 0.0;
+  degrade = DEGRADE_NONE;
+}
+
+/* @brief Sets the deadline of a new frame and resets its level
+ */
+void LaneDetector::start_budget(double capture_time) {
+
+  degrade = DEGRADE_NONE;
+  if (budget > 0.0) {
+    deadline = ((capture_time > 0.0) ? capture_time : get_time_msec()) + budget;
+  }
+}
+
 /*
  * @brief The raw image to use as input for the class
+ *
+ * @param img, the raw BGR frame, annotated in place
+ * @param capture_time, msec timestamp of the capture, passed on to events
  */
-void LaneDetector::input_image(Mat& img) {
+void LaneDetector::input_image(Mat& img, double capture_time) {
 
   proc_start = get_time_msec();
+  t_capture = capture_time;
+  if (img.size() != frame_size) {
+    set_frame_size(img.size());
+  }
   raw = &img;
   annot = Mat(*raw);
+  yuv = false;
+  have = 0;
+  start_budget(capture_time);
+}
+
+/*
+ * @brief The raw image as a YUV420 frame, no BGR image is needed at all
+ *
+ * Detection reads the Y plane directly and 
+ * annotate() draws into the Y, U and V planes.
+ *
+ * @param i420, the I420 frame (see yuv.h), continuous, annotated in place
+ * @param capture_time, msec timestamp of the capture, passed on to events
+ */
+void LaneDetector::input_yuv(Mat& i420, double capture_time) {
+
+  proc_start = get_time_msec();
+  t_capture = capture_time;
+  if (yuv_size(i420) != frame_size) {
+    set_frame_size(yuv_size(i420));
+  }
+  raw = &i420;
+  annot = Mat(*raw);
+  yuv_planes(annot, planes);
+  yuv = true;
+  have = 0;
+  start_budget(capture_time);
 }
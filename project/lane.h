@@ -19,22 +19,116 @@
 #include <opencv2/video.hpp>
 
 #include "log.h"
+#include "taskpool.h"
+#include "kernels.h"
 
 using namespace cv;
 
+// default Hough accumulator threshold at 1280x720, see set_acc_thresh()
+#define ACC_THRESH (30)
+
+// the 5x5 mean adaptive threshold: binary value and the delta subtracted
+// from the mean (a negative delta raises the threshold)
+#define THRESH_MAX   (255)
+#define THRESH_DELTA (-2)
+
+// theta windows of the left and right lane lines, and the theta step of
+// the full Hough search
+#define THETA_LEFT_MIN  (0.174533)
+#define THETA_LEFT_MAX  (1.134464)
+#define THETA_RIGHT_MIN (2.007129)
+#define THETA_RIGHT_MAX (2.967060)
+#define THETA_STEP      (CV_PI/180)
+
+/* @brief Lane departure warning levels, the tick color in the annotation
+ */
+typedef enum {
+  LANE_OK = 0,      // green, close to the center of the lane
+  LANE_WARN,        // yellow, offset more than 1/6 of the lane width
+  LANE_DEPART       // red, offset more than 1/4 of the lane width
+} lane_warning_t;
+
+/* @brief Quality levels of the budgeted mode, see set_budget()
+ */
+typedef enum {
+  DEGRADE_NONE = 0, // full Hough search
+  DEGRADE_COARSE,   // 2 degree theta steps
+  DEGRADE_HALF,     // 2 degree theta steps on the ROI at half resolution
+  DEGRADE_PREDICT,  // no search, the lane lines of the previous frame
+  DEGRADE_LEVELS
+} lane_degrade_t;
+
+/* @brief The text labels of the annotation, rendered once, see draw_text()
+ */
+typedef enum {
+  LABEL_ROI = 0,    // "ROI" at the top left of the ROI
+  LABEL_DEPART,     // "!" at the top right of the ROI
+  LABELS
+} lane_label_t;
+
+/* @brief A snapshot of the lane detection result for one frame
+ */
+typedef struct {
+  unsigned int frame_num;
+  bool is_left_found;
+  bool is_right_found;
+  Point left_pt1, left_pt2;   // left lane line, top and bottom of ROI
+  Point right_pt1, right_pt2; // right lane line, top and bottom of ROI
+  int offset;                 // measured center minus vehicle center (px)
+  lane_warning_t warning;
+  int thresh[2];              // accumulator threshold used, left and right
+  int candidates[2];          // lines the Hough search returned
+  lane_degrade_t degrade;     // quality level of the budgeted mode
+} lane_state_t;
+
+/* @brief A lane departure warning level transition
+ */
+typedef struct {
+  unsigned int frame_num;
+  lane_warning_t warning;     // the new level
+  lane_warning_t prev;        // the level of the previous frame
+  int offset;                 // measured center minus vehicle center (px)
+  int lane_width;             // bottom lane width (px)
+  double t_capture;           // msec, as given to input_image()
+  double t_decision;          // msec, when the decision was made
+} lane_event_t;
+
+// called from detect() on the processing thread, must not block
+typedef void (*lane_event_cb_t)(const lane_event_t& event, void* ctx);
+
+class SnapshotRing;
+
 /* @brief A lane line detection and processing class
  */
 class LaneDetector {
 
+protected:
+
+  Mat* raw;     // raw image, BGR or I420 (see input_yuv())
+  Mat gray;     // grayscale image, a view of gray_bgr or of the Y plane
+  Mat roi;      // region of interest 
+  Mat filtered, binary;   // filter_roi() and threshold_roi() outputs
+
+  // the kernels of the steps, on rows [row0, row1) of the step output 
+  // (from raw, roi and roi, see kernels.h), and the Hough search of one 
+  // side and level. A variant detector specializes them, e.g. for one 
+  // frame geometry (see fixed_lane.h).
+  virtual void gray_rows(int row0, int row1);
+  virtual void median_rows(int row0, int row1);
+  virtual void thresh_rows(int row0, int row1);
+  virtual const std::vector<Vec3f>& hough_search(int side, int level,
+                                                 const Mat& img, 
+                                                 int threshold);
+
 private:
 
-  Mat* raw;     // raw image
   Mat annot;    // annotated image
-  Mat gray;     // grayscale image
-  Mat roi;      // region of interest 
+  Mat gray_bgr; // to_gray() output of BGR frames
   Mat roi_mask; // the white mask for the region of interest
+  uchar thresh_tab[768];  // see kern_thresh_table()
   
   // rectangle which defines the roi within the raw frame
+  Size frame_size;
   Point roi_pts[4];
 
   // lane detected points in frame, ready for drawing
@@ -47,12 +141,97 @@ private:
   unsigned int frame_num;
   unsigned int lines_detected;
   double proc_min, proc_max;
+  unsigned int proc_min_frame, proc_max_frame;  // frames of the extremes
   double proc_start, proc_end, proc_elapsed;
 
   // lane detection
   bool is_left_found, is_right_found;
   unsigned int vcenter;
-  unsigned int offset;
+  unsigned int center_meas;
+  int offset;
+
+  // hough line filtering, see set_frame_size()
+  int rho_left_min, rho_left_max;
+  int rho_right_min, rho_right_max;
+  int acc_thresh;
+  int acc_base;       // acc_thresh at 1280x720, see set_acc_thresh()
+
+  // adaptive accumulator threshold, see set_adaptive_thresh()
+  bool adaptive;
+  int side_thresh[2];     // for the next search of each side
+  int side_used[2];       // used by the last search
+  int side_cand[2];       // lines returned by the last search
+  const std::vector<Vec3f>* side_lines[2];  // of the last search, or NULL
+  void adapt_thresh(int side, const std::vector<Vec3f>& lines);
+
+  // per side and Hough level, sized with the frame, see setup_buffers()
+  HoughSearch hough[2][DEGRADE_PREDICT];
+
+  // budgeted mode, see set_budget()
+  double budget;            // msec per frame, 0 for none
+  double deadline;          // msec, of the current frame
+  double pre_cost;          // msec, filter_roi() + threshold_roi(), EWMA
+  double hough_cost;        // msec, a full Hough search, EWMA
+  lane_degrade_t degrade;   // of the current frame
+  unsigned int degrade_count[DEGRADE_LEVELS];
+  unsigned int budget_misses;
+  unsigned int held;        // frames in a row on the previous lane lines
+  Vec4i last_line[2];
+  bool last_found[2];
+  Mat roi_half;
+  void start_budget(double capture_time);
+  lane_degrade_t pick_degrade();
+
+  // lane departure decision
+  lane_warning_t warning, prev_warning;
+  lane_event_cb_t event_cb;
+  void* event_ctx;
+  double t_capture;
+  lane_warning_t classify();
+
+  // debug snapshots, see set_snapshots()
+  SnapshotRing* snapshots;
+  unsigned int have;          // intermediate images of this frame, HAVE_*
+  bool snap_found[2];         // of the previous snapshot() call
+  lane_warning_t snap_warning;
+  unsigned long snap_misses;
+  unsigned int snap_budget_misses;
+
+  // low-latency mode, see set_task_pool()
+  TaskPool* pool;
+  int strips;
+  Vec4i side_line[2];
+  bool side_found[2];
+
+  // YUV420 mode, see input_yuv()
+  bool yuv;
+  Mat planes[3];    // Y, U and V of annot
+
+  // the label masks at full and at half (chroma plane) scale
+  Mat label_mask[LABELS][2];
+  Point label_org[LABELS][2];   // the text origin in the mask
+  void render_labels();
+
+  // allocates every per-frame buffer for the frame size
+  void setup_buffers();
+
+  // draw into annot, BGR or the three planes
+  void draw_line(Point p1, Point p2, const Scalar& color, int thickness, 
+                 int type);
+  void draw_rect(Point p1, Point p2, const Scalar& color, int thickness,
+                 int type);
+  void draw_text(lane_label_t label, Point org, const Scalar& color);
+  void stamp(Mat& img, const Mat& mask, Point tl, const Scalar& color);
+
+  // one side of the Hough search, 0 left and 1 right
+  bool hough_side(int side, Vec4i& line);
+
+  // task pool jobs
+  static void gray_strip(void* arg, int i);
+  static void median_strip(void* arg, int i);
+  static void thresh_strip(void* arg, int i);
+  static void hough_task(void* arg, int side);
+  Range strip_rows(int i, int rows);
 
   // a friend helper function
   friend bool intersection(Point2f o1, Point2f p1, 
@@ -65,21 +244,83 @@ public:
   
   // default constructor
   LaneDetector();
+  virtual ~LaneDetector() {}
 
   // methods -- further explanation in lane.cpp 
-  void input_image(Mat& img);
+  void input_image(Mat& img, double capture_time = 0.0);
+  void input_yuv(Mat& i420, double capture_time = 0.0);
+  void set_frame_size(Size size);
   void detect();
+  void decide();
   void annotate();
-  void show();
+
+  // the individual steps of detect(), in order
+  void to_gray();
+  void extract_roi();
+  void filter_roi();
+  void threshold_roi();
   void hough_transform(Vec4i& left, Vec4i& right);
+  void find_endpoints(const Vec4i& left, const Vec4i& right);
+
+  // filter_roi() and threshold_roi(), false when skipped in budgeted mode
+  bool preprocess_roi();
+
+  // continue a frame started on another detector instance: load_roi() 
+  // before hough_transform(), load_state() before decide() or annotate()
+  void load_roi(const Mat& binary_roi, Size size, double capture_time = 0.0);
+  void load_state(const lane_state_t& state, Size size, 
+                  double capture_time = 0.0);
+
+  // low-latency mode: preprocessing in row strips and the left/right Hough
+  // searches as parallel tasks on the pool, NULL for sequential
+  void set_task_pool(TaskPool* task_pool, int num_strips);
+
+  // the accumulator threshold at 1280x720, scaled with the frame height
+  void set_acc_thresh(int thresh);
+
+  // adapts the threshold of each side per frame from the votes of the 
+  // previous frame's lines, see adapt_thresh()
+  void set_adaptive_thresh(bool enable);
+
+  // bounds detection (up to the lane lines) of each frame to msec, counted
+  // from the capture time when given, by degrading the Hough search
+  void set_budget(double msec);
 
   // getters inline 
   double get_proc_elapsed() { return proc_elapsed; }
   double get_proc_min() { return proc_min; }
   double get_proc_max() { return proc_max; }
+  unsigned int get_proc_min_frame() { return proc_min_frame; }
+  unsigned int get_proc_max_frame() { return proc_max_frame; }
   unsigned int get_frame_num() { return frame_num; }
   unsigned int get_lines_detected() { return lines_detected; }
+  Rect get_roi_rect() { return Rect(roi_pts[0], roi_pts[2]); }
+  unsigned int get_vcenter() { return vcenter; }
   void get_annot(Mat& annotated_return) { annotated_return = annot.clone(); }
+  void get_roi(Mat& roi_return) { roi_return = roi.clone(); }
+  // into the buffer of roi_return, reallocated only on a size change
+  void copy_roi(Mat& roi_return) { roi.copyTo(roi_return); }
+  void get_state(lane_state_t& state);
+  lane_warning_t get_warning() { return warning; }
+  lane_degrade_t get_degrade() { return degrade; }
+  unsigned int get_degrade_count(lane_degrade_t level) { 
+    return degrade_count[level]; 
+  }
+  unsigned int get_budget_misses() { return budget_misses; }
+
+  // copies the intermediate images of sampled and triggered frames into
+  // the ring, see snapshot.h, NULL to disable
+  void set_snapshots(SnapshotRing* ring) { snapshots = ring; }
+
+  // takes a snapshot of the current frame if the ring wants it, detect()
+  // calls it, others after find_endpoints()
+  void snapshot(unsigned int frame_id);
+
+  // registers the departure transition callback, NULL to disable
+  void set_event_callback(lane_event_cb_t cb, void* ctx) { 
+    event_cb = cb; 
+    event_ctx = ctx; 
+  }
 
 };
 
@@ -7,6 +7,7 @@
  *---------------------------------------------------------------------------*/
 
 #include <time.h>
+#include <float.h>
 #include "log.h"
 
 // see .h for more details
@@ -16,3 +17,33 @@ double get_time_msec(void) {
   clock_gettime(CLOCK_MONOTONIC, &ts);
   return (double)((ts.tv_sec)*1000.0 + (ts.tv_nsec)/1000000.0);
 }
+
+// see .h for more details
+void latency_stat_init(latency_stat_t* stat) {
+
+  stat->count = 0;
+  stat->sum = 0.0;
+  stat->min = DBL_MAX;
+  stat->max = 0.0;
+}
+
+// see .h for more details
+void latency_stat_add(latency_stat_t* stat, double msec) {
+
+  stat->count++;
+  stat->sum += msec;
+  if (msec < stat->min) stat->min = msec;
+  if (msec > stat->max) stat->max = msec;
+}
+
+// see .h for more details
+void latency_stat_print(const char* label, const latency_stat_t* stat) {
+
+  if (stat->count == 0) {
+    LOGP("%s (msec), no samples\n", label);
+    return;
+  }
+
+  LOGP("%s (msec), n: %lu, min: %6.2f, avg: %6.2f, max: %6.2f\n",
+       label, stat->count, stat->min, stat->sum/stat->count, stat->max);
+}
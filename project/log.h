@@ -43,4 +43,36 @@
  */
 double get_time_msec(void);
 
+/* @brief Running min/avg/max of a latency, in msec
+ */
+typedef struct {
+  unsigned long count;
+  double sum;
+  double min;
+  double max;
+} latency_stat_t;
+
+/* @brief  Resets a latency statistic
+ *
+ * @param  stat, the statistic to reset
+ * @return None
+ */
+void latency_stat_init(latency_stat_t* stat);
+
+/* @brief  Adds one latency sample
+ *
+ * @param  stat, the statistic to update
+ * @param  msec, the sample
+ * @return None
+ */
+void latency_stat_add(latency_stat_t* stat, double msec);
+
+/* @brief  Prints a latency statistic with LOGP
+ *
+ * @param  label, printed in front of the statistic
+ * @param  stat, the statistic to print
+ * @return None
+ */
+void latency_stat_print(const char* label, const latency_stat_t* stat);
+
 #endif // LOG_H_
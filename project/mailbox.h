@@ -0,0 +1,80 @@
+/*------------------------------------------------------------------------------
+ * @file mailbox.h
+ * @brief Single-slot, overwrite-on-write mailbox for passing the latest value
+ *        between threads
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *----------------------------------------------------------------------------*/
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <pthread.h>
+#include <algorithm>
+
+//
+//  The producer never waits for the consumer: a Post() on a full mailbox
+//  simply replaces the unread value and counts it as skipped. The lock is
+//  only held for an assignment, so for cv::Mat this is a header/refcount copy.
+//  Old values are released outside of the lock.
+//
+template <class T>
+class Mailbox
+{
+public:
+    Mailbox()
+        : m_full(false), m_posted(0), m_taken(0), m_skipped(0)
+        { pthread_mutex_init(&m_lock, NULL); }
+
+    ~Mailbox()
+        { pthread_mutex_destroy(&m_lock); }
+
+    void Post(const T& value)
+    {
+        T old;
+        pthread_mutex_lock(&m_lock);
+        std::swap(old, m_slot);
+        m_slot = value;
+        if (m_full)
+            m_skipped++;
+        m_full = true;
+        m_posted++;
+        pthread_mutex_unlock(&m_lock);
+    }
+
+    bool Take(T& value)
+    {
+        T old;
+        pthread_mutex_lock(&m_lock);
+        if (!m_full) {
+            pthread_mutex_unlock(&m_lock);
+            return false;
+        }
+        std::swap(old, value);
+        std::swap(value, m_slot);
+        m_full = false;
+        m_taken++;
+        pthread_mutex_unlock(&m_lock);
+        return true;
+    }
+
+    unsigned long Posted() const
+        { return m_posted; }
+    unsigned long Taken() const
+        { return m_taken; }
+    unsigned long Skipped() const
+        { return m_skipped; }
+
+private:
+    pthread_mutex_t m_lock;
+    T               m_slot;
+    bool            m_full;
+
+    // statistics, written under the lock
+    unsigned long   m_posted;
+    unsigned long   m_taken;
+    unsigned long   m_skipped;
+};
+
+#endif // MAILBOX_H
@@ -31,15 +31,30 @@
 
 #include "log.h"
 #include "lane.h"
-#include "ringbuf.h"
+#include "mailbox.h"
+#include "preview.h"
+#include "frame.h"
+#include "shmring.h"
+#include "events.h"
+#include "viewer.h"
+#include "source.h"
+#include "pipeline.h"
+#include "stages.h"
+#include "offline.h"
+#include "multistream.h"
+#include "timing.h"
+#include "perfcnt.h"
+#include "deadline.h"
+#include "rtmem.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "metrics.h"
 
 using namespace cv;
 using namespace std;
 
 enum {
-  CAPTURE_THREAD, 
-  PROCESS_THREAD,
-  WRITE_THREAD,
+  DISPLAY_THREAD,
   NUM_THREADS
 };
 
@@ -57,174 +72,158 @@ pthread_attr_t main_attr;
 struct sched_param rt_param[NUM_THREADS];
 struct sched_param main_param;
 
-// lock-free SPSC ring buffers
-RingBuffer<Mat> raw_buf = RingBuffer<Mat>(16); 
-RingBuffer<Mat> annot_buf = RingBuffer<Mat>(16);
-//RingBuffer<Mat, 8> raw_buf; //= RingBuffer<Mat>(8); 
-//RingBuffer<Mat, 8> annot_buf; //= RingBuffer<Mat>(8);
+// latest-frame mailbox for the display thread, overwritten if not yet shown
+Mailbox<display_frame_t> display_box;
 
 // 
 // interrupt handler for ctrl-c finish-up and output
 //
 static volatile int exit_signal_g = 0;
+static int show_pipeline_g = 0;
 static void int_handler(int signum) {
   
   exit_signal_g = true;
 }
 
+// debug snapshots, dumped on SIGUSR1
+static SnapshotRing snapshot_ring;
 
-/* @brief
+static void usr1_handler(int signum) {
+
+  snapshot_ring.dump();
+}
+
+/* @brief Shows the latest processed frame, capped at a fixed refresh rate
  *
+ * Owns all of the HighGUI windows so that imshow/waitKey (slow over remote X)
+ * never run on the capture or processing threads.
  */
-void *capture_thread(void *param) {
-  
-  //
-  // algorithm begin  
-  //
-  double start, end, elapsed = 0.0;
-  unsigned int framecnt = 0;
-  // wait time is 1 msec
-  struct timespec wait_time = {0, 1*MSEC_TO_NSEC};
+void *display_thread(void* param) {
 
-  thread_params_t *arg = (thread_params_t*) param;
+  display_frame_t disp;
+  unsigned int shown = 0;
+  double next, remaining;
 
-  String *input_image = (String*) arg->payload;
-  VideoCapture cap(*input_image);
-  cap.set(CAP_PROP_POS_MSEC, 10000);
+  thread_params_t *arg = (thread_params_t*) param;
+  int *show_rate = (int *) arg->payload;
+  double period = 1000.0 / ((*show_rate > 0) ? *show_rate : 10);
 
-  Mat temp;
+  cvNamedWindow("1", CV_WINDOW_AUTOSIZE);
+  cvNamedWindow("2", CV_WINDOW_AUTOSIZE);
 
   while(!exit_signal_g) {
 
-    start = get_time_msec();
-    cap >> temp;
-    if( temp.empty() ) {
-      LOGSYS("capture_thread, cap empty, nframes: %i\n", framecnt);
-      break;
-    }
+    next = get_time_msec() + period;
 
-    while (!raw_buf.Put(temp)) { 
-      if (nanosleep(&wait_time, NULL) < 0) {
-        perror("capture_thread nanosleep");
-      }
+    if (display_box.Take(disp)) {
+      if (!disp.roi.empty()) imshow("1", disp.roi);
+      imshow("2", disp.annot);
+      shown++;
     }
 
-    char user_input = waitKey(20);
+    // waitKey services the GUI and sleeps out the rest of the period
+    remaining = next - get_time_msec();
+    char user_input = waitKey((remaining >= 1.0) ? (int)remaining : 1);
     if ( user_input == 'q' ) break;
-
-    framecnt++;
-    end = get_time_msec();
-    elapsed += end-start;
-
-    // uncomment if you only want a fixed amount of time
-    //if (elapsed > 20*MSEC_TO_SEC) {break;}
   }
 
   exit_signal_g = 1;
-  cap.release();
-  
-  return nullptr;
-}
-
-void *process_thread(void *param) {
 
-  Mat image, annotated;
-  LaneDetector detector;
-  double start, end;
-  start = get_time_msec();
-
-  thread_params_t *arg = (thread_params_t*) param;
+  LOGP("display_thread, frames shown: %i, skipped: %lu\n", 
+       shown, display_box.Skipped());
 
-  int *show_pipeline = (int *) arg->payload;
+  return nullptr;
+}
 
-  while(!exit_signal_g) {
+/* @brief Interactive frame-by-frame viewer over a prefetched frame source
+ *
+ * @param source, folder of %08d.jpg frames (ending in '/') or a video file
+ * @param jump, number of frames to move with f/b
+ */
+static void frame_analysis(const String& source, int jump) {
 
-    if(raw_buf.Get(image)) {
-      detector.input_image(image);
-      detector.detect();
-      detector.annotate();
-      if (*show_pipeline) {
-        detector.show();
-      }
-      detector.get_annot(annotated);
-      while(!annot_buf.Put(annotated)) {;} 
-    }
+  FramePrefetcher frames;
+  Mat img;
+  latency_stat_t key_lat;
+  int i = 0, goto_frame = -1;
+  double t_key;
 
+  if (!frames.open(source, 2*jump, jump, 4*jump)) {
+    fprintf(stderr, "frame-analysis: no frames in %s\n", source.c_str());
+    return;
   }
+  latency_stat_init(&key_lat);
+  cvNamedWindow("frame-analysis", CV_WINDOW_AUTOSIZE);
 
-  end = get_time_msec();
-
-  unsigned int nframes = detector.get_frame_num();
-  unsigned int lines = detector.get_lines_detected();
-  double proc_time = detector.get_proc_elapsed();
-
-  LOGP(
-       "proc_thread, frames: %i, msec total: %6.2f, FPS: %6.2f\n", 
-       nframes, end-start, nframes*1000/(end-start)
-      );
+  int last = frames.get_num_frames()-1;
+  LOGP("frame-analysis: %i frames\n", last+1);
 
-  LOGP(
-       "proc_thread (msec), proc_min: %6.2f, proc_max: %6.2f\n", 
-       detector.get_proc_min(),
-       detector.get_proc_max()
-      );
-  LOGP("proc_thread (msec), total proc time: %6.2f\n", proc_time);
-  LOGP("proc_thread, lane lines detected: %i\n", lines);
-
-  return nullptr;
-} 
+  t_key = get_time_msec();
+  while (!exit_signal_g) {
 
+    if (!frames.get(i, img)) {
+      LOGP("frame %08d could not be read\n", i);
+    } else {
+      imshow("frame-analysis", img);
+      latency_stat_add(&key_lat, get_time_msec() - t_key);
+    }
+    LOGP("%08d\n", i);
 
-void *write_thread(void* param) {
+    char user_input = waitKey(0);
+    t_key = get_time_msec();
 
-  Mat img;
-  unsigned int i=0;
-  String output_frame_path;
-  stringstream ss;
-  double start, end, elapsed = 0.0;
+    // g<digits><enter> jumps to a frame number
+    if (goto_frame >= 0) {
+      if (user_input >= '0' && user_input <= '9') {
+        goto_frame = goto_frame*10 + (user_input - '0');
+        continue;
+      }
+      if (user_input == '\n' || user_input == '\r') {
+        i = (goto_frame > last) ? last : goto_frame;
+      }
+      goto_frame = -1;
+      continue;
+    }
+    
+    switch(user_input) {
+    
+      case 'n':
+      case 'N':
+        if (i<last) {i++;}
+        break;
 
-  thread_params_t *arg = (thread_params_t*) param;
-  String* output_folder = (String *) arg->payload;
-  char number[20];
-  number[19] = '\0';
-
-  // does not work as expected: 
-  //VideoWriter video_out(
-  //  *output_video,
-  //  CV_FOURCC('a','v','c','1'),
-  //  30.0, 
-  //  Size(1280, 720),
-  //  true
-  //);
+      case 'p':
+      case 'P':
+        if (i>0) {i--;}
+        break;
 
-  while(!exit_signal_g) {
+      case 'f':
+      case 'F':
+        i = (i+jump > last) ? last : i+jump;
+        break;
 
-    if (annot_buf.Get(img)) {
-    
-      start = get_time_msec();
+      case 'b':
+      case 'B':
+        i = (i-jump < 0) ? 0 : i-jump;
+        break;
 
-      //video_out.write(img); 
-      sprintf(number, "%08d.jpg", i);
-      ss << *output_folder << number; 
-      //cout << ss.str() << endl;
-      imwrite(ss.str(), img);
-      ss.str("");
-      ss.clear();
-      i++;
+      case 'g':
+      case 'G':
+        LOGP("go to frame: type the number and press enter\n");
+        goto_frame = 0;
+        break;
 
-      end = get_time_msec();
-      elapsed += end-start;
-    } 
+      case 'q':
+      case 'Q':
+        exit_signal_g = 1;
+        break;
+    }
 
   }
-  
-  LOGP("write_thread (msec), total elapsed: %6.2f\n", elapsed);
-  LOGP("write_thread, FPS: %6.2f\n", i*1000/elapsed);
 
-  // clean up
-  //video_out.release();
-
-  return nullptr;
+  latency_stat_print("frame-analysis, keypress->display", &key_lat);
+  LOGP("frame-analysis, cache hits: %lu, misses: %lu, decodes: %lu\n",
+       frames.get_hits(), frames.get_misses(), frames.get_decodes());
 }
 
 //
@@ -235,16 +234,73 @@ int main(int argc, char **argv) {
   // the keys for the command line arguments
   const String parser_keys =
     "{help h usage ? | | Print help message. }"
-    "{input i  | input_video/clip1.avi       | Full filepath to input video.  }"
+    "{input i  | input_video/clip1.avi       | Full filepath to input video, a synthetic road spec synth:WxH,... (see synth.h), an uncompressed .y4m file or raw:WxH,fmt=bgr|gray|i420|nv12,fps=N,path=file.  }"
+    "{truth    | | Ground truth CSV written for a synthetic input. }"
+    "{results  | | Per-frame lane detection results CSV. }"
     "{output o | output_frames/              | Folder for output video frames. }"
     "{show     | 0 | Shows intermediate image pipeline steps. }"
-    "{frame-analysis-mode | 0 | Displayes images from the output folder with key commands: \n \t\t n (next), p (previous) and q (quit). }"
+    "{show-rate | 10 | Maximum display refresh rate (Hz) when --show=1. }"
+    "{preview-port | 0 | Serves an MJPEG preview and lane state over HTTP on this port (0 disables). }"
+    "{preview-addr | 127.0.0.1 | Interface address for the HTTP preview. }"
+    "{preview-fps | 5 | Maximum frame rate of the HTTP preview. }"
+    "{preview-scale | 0.5 | Downscale factor of the HTTP preview frames. }"
+    "{preview-quality | 70 | JPEG quality of the HTTP preview frames. }"
+    "{shm-name | | Publishes annotated frames to this POSIX shm ring, e.g. /emvia_frames (empty disables). }"
+    "{shm-slots | 4 | Number of frame slots in the shm ring. }"
+    "{event-socket | | Sends lane departure transitions as datagrams to this Unix socket path (empty disables). }"
+    "{metrics-port | 0 | Serves live metrics (frames and drops per stage, queue depths, latency percentiles, lanes found, warnings) in the Prometheus text format at /metrics on this port (0 disables), see metrics.h. }"
+    "{metrics-addr | 127.0.0.1 | Interface address for the metrics endpoint. }"
+    "{metrics-file | | Rewrites the live metrics into this file every --metrics-interval (empty disables). }"
+    "{metrics-interval | 1000 | Msec between rewrites of the metrics file. }"
+    "{yuv      | 0 | YUV420 mode: frames stay I420 from decode to JPEG encode, no BGR conversions (fastest with a .y4m or raw i420 input). }"
+    "{acc-thresh | 30 | Hough accumulator threshold at 1280x720 (scaled with the frame height). }"
+    "{adaptive-thresh | 0 | Adapts the Hough threshold per frame and side to keep the candidate lines few (starts at --acc-thresh). }"
+    "{scan-lines | 0 | Scan-line engine: finds lane markers on this many rows of the ROI instead of the Hough search over all of it, for the smallest targets (0 uses Hough), see scan_lane.h. }"
+    "{budget   | 0 | Detection budget per frame in msec from capture, degrades the Hough search to meet it (0 disables). }"
+    "{deadlines | | Per-stage budgets in msec, e.g. hough=8,annotate=3,frame=33 (stages: decode, gray, filter, threshold, hough, decide, annotate, encode, write, frame), see deadline.h. }"
+    "{deadline-log | | CSV with one row per deadline miss: frame, stage, msec. }"
+    "{deadline-alarm | 1000 | Minimum msec between deadline miss alarms in syslog (0 disables). }"
+    "{rt-mem   | 0 | Real-time memory: mlockall, prefaulted heap and recycled, prefaulted frame buffers; reports steady-state page faults, see rtmem.h. }"
+    "{rt-heap  | 64 | Heap prefaulted in real-time memory mode (MB). }"
+    "{rt-hugepages | 0 | Huge pages behind the heap and frame buffers in real-time memory mode: 0 none, 1 transparent, 2 explicit (hugetlbfs). }"
+    "{replay   | 0 | Paced replay: releases the input frames at its native rate (or --replay-fps) like a camera, with optional jitter and bursts, see replay.h. }"
+    "{replay-fps | 0 | Replay frame rate (0 = the rate of the input). }"
+    "{replay-jitter | 0 | Replay arrival jitter, standard deviation in msec. }"
+    "{replay-burst-every | 0 | Replay bursts: every this many frames a burst arrives at once (0 disables). }"
+    "{replay-burst-len | 3 | Frames held back and released with the last frame of a burst. }"
+    "{replay-drop | 0 | Drops replayed frames that were not taken before the next one arrived, like a camera overwriting its buffer. }"
+    "{replay-seed | 1 | Seed of the replay jitter. }"
+    "{snapshots | 0 | Debug snapshot ring: keeps the gray, median and binary ROI and Hough peaks of this many sampled/triggered frames, written on SIGUSR1 and at exit (0 disables), see snapshot.h. }"
+    "{snapshot-every | 30 | Samples every Nth frame into the snapshot ring (0 for triggers only). }"
+    "{snapshot-triggers | all | Frames the snapshot ring also takes: lost, warn, deadline, all or none, comma separated. }"
+    "{snapshot-dir | snapshots | Folder of the snapshot dumps. }"
+    "{perf     | 0 | Counts cycles, instructions, cache/branch misses, context switches and page faults per stage and thread (perf_event). }"
+    "{low-latency | 0 | Worker threads for splitting each frame into parallel tasks (0 disables). }"
+    "{pipeline | " STAGES_DEFAULT_SPEC " | Stage nodes in order, name[*replicas][:depth][@group], see stages.h and pipeline.h. }"
+    "{inputs   | | Multi-stream mode: comma separated video files processed in one process (synth/raw specs go in a manifest), see multistream.h. }"
+    "{manifest | | Multi-stream mode: file with one 'input [output_folder [results]]' per line. }"
+    "{stream-threads | 0 | Worker threads shared by the streams in multi-stream mode (0 = one per core). }"
+    "{offline  | 0 | Offline mode: splits the input into this many segments, each processed on its own core (0 disables). }"
+    "{offline-overlap | 30 | Warm-up frames before each offline segment boundary. }"
+    "{offline-gop | 0 | Keyframe interval of the input, offline segments start on keyframes (0 disables). }"
+    "{offline-sweep | 0 | Also runs 1, 2, 4, .. offline segments and reports the scaling efficiency. }"
+    "{frame-analysis-mode | 0 | Displayes images from the output folder with key commands: \n \t\t n (next), p (previous), f/b (jump forward/back), g<number><enter> (go to frame) and q (quit). }"
+    "{frame-analysis-input | | Video file to analyze instead of the output folder frames, e.g. out.mp4. }"
+    "{frame-analysis-jump | 30 | Number of frames to jump with f/b in frame-analysis-mode. }"
     ;
   // variables extracted from the parser - application settings
   String input_video;
   String output_folder;
   int frame_analysis_mode;
-  int show_pipeline;
+  int show_rate;
+  preview_config_t preview_cfg;
+  PreviewServer preview;
+  ShmRingWriter shm;
+  LaneEventSocket events;
+  stage_context_t stage_ctx;
+  Pipeline pipeline;
+  TaskPool pool;
+  MetricsExporter metrics;
 
 
   // 
@@ -265,65 +321,182 @@ int main(int argc, char **argv) {
     output_folder += '/';
   }
 
+  if (!deadline_configure(parser.get<String>("deadlines").c_str())) {
+    return 1;
+  }
+  String deadline_log = parser.get<String>("deadline-log");
+  if (!deadline_log.empty() && !deadline_open_log(deadline_log.c_str())) {
+    return 1;
+  }
+  deadline_set_alarm_interval(parser.get<double>("deadline-alarm"));
+
+  // before any thread exists, so that all of them share the locked heap
+  if (parser.get<int>("rt-mem") != 0) {
+    rtmem_init((size_t)parser.get<int>("rt-heap")*1024*1024,
+               (rtmem_pages_t)parser.get<int>("rt-hugepages"));
+  }
+
   frame_analysis_mode = parser.get<int>("frame-analysis-mode");
 
   if (frame_analysis_mode) {
 
     // mode which simply does frame-by-frame analysis (on preset frame sequence)
-    cvNamedWindow("frame-analysis", CV_WINDOW_AUTOSIZE);
-    Mat temp;
-    String filename;
-    ifstream file;
-    char number_ext[15];
-    int i=0;
-
-    while (!exit_signal_g) {
+    String source = parser.get<String>("frame-analysis-input");
+    if (source.empty()) {
+      source = output_folder;
+    }
+    frame_analysis(source, parser.get<int>("frame-analysis-jump"));
+    
+    return 0;
+  }
 
-      sprintf(number_ext, "%08d.jpg", i);
-      String filename = output_folder + number_ext;
-      cout << number_ext << endl;
+  String inputs = parser.get<String>("inputs");
+  String manifest = parser.get<String>("manifest");
+  if (!inputs.empty() || !manifest.empty()) {
+
+    // many streams on one worker pool, outputs per stream
+    multistream_config_t multi_cfg;
+    multi_cfg.threads = parser.get<int>("stream-threads");
+    multi_cfg.yuv = parser.get<int>("yuv") != 0;
+    multi_cfg.acc_thresh = parser.get<int>("acc-thresh");
+    multi_cfg.adaptive_thresh = parser.get<int>("adaptive-thresh") != 0;
+    multi_cfg.budget = parser.get<double>("budget");
+    if (!multistream_add(multi_cfg, inputs, manifest, output_folder,
+                         !parser.get<String>("results").empty())) {
+      return 1;
+    }
 
-      Mat temp = imread(filename);
-      if (temp.empty()) {
-        exit_signal_g = 1;
-        break;
-      }
+    signal(SIGINT, int_handler);
+    int rc = multistream_run(multi_cfg, &exit_signal_g);
+    TIMING_PRINT();
+    deadline_print();
+    return rc;
+  }
 
-      imshow("frame-analysis", temp);
-
-      char user_input = waitKey(0);
-      
-      switch(user_input) {
-      
-        case 'n':
-        case 'N':
-          i++;
-          break;
-
-        case 'p':
-        case 'P':
-          if (i>0) {i--;}
-          break;
-
-        case 'q':
-        case 'Q':
-          exit_signal_g = 1;
-          break;
-      }
+  if (parser.get<int>("offline") > 0) {
 
+    // batch processing of a recording, no pipeline or outputs other than 
+    // the frames and the results
+    if (parser.get<double>("budget") > 0.0) {
+      fprintf(stderr, "--budget does not apply to --offline, the output "
+              "has to match a single pass\n");
+      return 1;
     }
-    
-    return 0;
+    offline_config_t offline_cfg;
+    offline_cfg.input = input_video;
+    offline_cfg.segments = parser.get<int>("offline");
+    offline_cfg.overlap = parser.get<int>("offline-overlap");
+    offline_cfg.gop = parser.get<int>("offline-gop");
+    offline_cfg.sweep = parser.get<int>("offline-sweep") != 0;
+    offline_cfg.yuv = parser.get<int>("yuv") != 0;
+    offline_cfg.acc_thresh = parser.get<int>("acc-thresh");
+    offline_cfg.adaptive_thresh = parser.get<int>("adaptive-thresh") != 0;
+    offline_cfg.output_folder = output_folder;
+    offline_cfg.results_path = parser.get<String>("results");
+
+    signal(SIGINT, int_handler);
+    int rc = offline_run(offline_cfg, &exit_signal_g);
+    TIMING_PRINT();
+    deadline_print();
+    return rc;
   }
 
-  show_pipeline = parser.get<int>("show");
+  show_pipeline_g = parser.get<int>("show");
+  show_rate = parser.get<int>("show-rate");
 
-  if (show_pipeline) {
-    cvNamedWindow("1", CV_WINDOW_AUTOSIZE);
-    cvNamedWindow("2", CV_WINDOW_AUTOSIZE);
-    cvNamedWindow("3", CV_WINDOW_AUTOSIZE);
+  preview_cfg.port = parser.get<int>("preview-port");
+  preview_cfg.addr = parser.get<String>("preview-addr");
+  preview_cfg.fps = parser.get<double>("preview-fps");
+  preview_cfg.scale = parser.get<double>("preview-scale");
+  preview_cfg.quality = parser.get<int>("preview-quality");
+
+  bool preview_enabled = false;
+  if (preview_cfg.port > 0) {
+    preview_enabled = preview.start(preview_cfg);
   }
   
+  FrameSource *source = open_source(input_video, parser.get<String>("truth"));
+  if (source == NULL) {
+    return 1;
+  }
+
+  stages_init_context(&stage_ctx);
+  stage_ctx.source = source;
+  stage_ctx.show_pipeline = show_pipeline_g;
+  stage_ctx.display_box = show_pipeline_g ? &display_box : NULL;
+  stage_ctx.preview = preview_enabled ? &preview : NULL;
+  stage_ctx.shm_name = parser.get<String>("shm-name");
+  stage_ctx.shm_slots = parser.get<int>("shm-slots");
+  if (!stage_ctx.shm_name.empty()) {
+    stage_ctx.shm = &shm;
+  }
+  String event_path = parser.get<String>("event-socket");
+  if (!event_path.empty() && events.open(event_path.c_str())) {
+    stage_ctx.events = &events;
+  }
+  stage_ctx.output_folder = output_folder;
+  stage_ctx.results_path = parser.get<String>("results");
+  stage_ctx.yuv = parser.get<int>("yuv") != 0;
+  stage_ctx.acc_thresh = parser.get<int>("acc-thresh");
+  stage_ctx.adaptive_thresh = parser.get<int>("adaptive-thresh") != 0;
+  stage_ctx.budget = parser.get<double>("budget");
+  stage_ctx.scan_lines = parser.get<int>("scan-lines");
+
+  ReplayClock *replay = NULL;
+  if (parser.get<int>("replay") != 0) {
+    replay_config_t replay_cfg;
+    replay_cfg.fps = parser.get<double>("replay-fps");
+    replay_cfg.jitter_ms = parser.get<double>("replay-jitter");
+    replay_cfg.burst_every = parser.get<int>("replay-burst-every");
+    replay_cfg.burst_len = parser.get<int>("replay-burst-len");
+    replay_cfg.drop = parser.get<int>("replay-drop") != 0;
+    replay_cfg.seed = (uint64_t)parser.get<int>("replay-seed");
+    replay = new ReplayClock(replay_cfg, source->get_fps());
+    stage_ctx.replay = replay;
+  }
+
+  if (parser.get<int>("snapshots") > 0) {
+    int triggers = snapshot_parse_triggers(
+        parser.get<String>("snapshot-triggers").c_str());
+    if (triggers < 0) {
+      delete source;
+      return 1;
+    }
+    if (snapshot_ring.start(parser.get<int>("snapshots"),
+                            stages_roi_size(&stage_ctx),
+                            parser.get<int>("snapshot-every"), triggers,
+                            parser.get<String>("snapshot-dir"))) {
+      stage_ctx.snapshots = &snapshot_ring;
+      signal(SIGUSR1, usr1_handler);
+    }
+  }
+
+  perf_enable(parser.get<int>("perf") != 0);
+
+  int pool_threads = parser.get<int>("low-latency");
+  if (pool_threads > 0 && pool.start(pool_threads)) {
+    // the calling stage thread runs tasks as well
+    stage_ctx.pool = &pool;
+    stage_ctx.strips = pool.get_threads() + 1;
+  }
+
+  if (!stages_build(pipeline, parser.get<String>("pipeline"), &stage_ctx)) {
+    delete source;
+    return 1;
+  }
+
+  // frames the source hands out may be drawn into until they leave the
+  // chain, plus the few the display and preview hold on to
+  source->set_frames_held(pipeline.get_max_in_flight() + 4);
+
+  if (rtmem_is_enabled()) {
+    // a few spare slots for the frames the display and preview hold on to
+    int frames = pipeline.get_max_in_flight();
+    stage_ctx.frame_pool = rtmem_frame_pool(stages_frame_bytes(&stage_ctx),
+                                            frames + 4);
+    pipeline.prealloc_frames(stages_prealloc_frame, &stage_ctx);
+  }
+
   signal(SIGINT, int_handler);
 
   // Begin pthreads setup
@@ -336,42 +509,97 @@ int main(int argc, char **argv) {
     }
   }
 
-  // start the capture thread
-  thread_params[CAPTURE_THREAD].tid = 1;
-  thread_params[CAPTURE_THREAD].payload = (void*)(&input_video);
-
-  pthread_create( &threads[CAPTURE_THREAD],
-                  &rt_sched_attr[CAPTURE_THREAD],
-                  capture_thread,
-                  &thread_params[CAPTURE_THREAD]
-                 );
+  // start the stage threads, the source stops on exit_signal_g and the
+  // frames already captured drain through the chain
+  if (!pipeline.start(&exit_signal_g)) {
+    delete source;
+    return 1;
+  }
 
+  // live metrics, read from the running stages
+  metrics_config_t metrics_cfg;
+  metrics_cfg.port = parser.get<int>("metrics-port");
+  metrics_cfg.addr = parser.get<String>("metrics-addr");
+  metrics_cfg.path = parser.get<String>("metrics-file");
+  metrics_cfg.interval = parser.get<double>("metrics-interval");
+  metrics.add_collector(Pipeline::metrics_collector, &pipeline);
+  metrics.add_collector(stages_collect_metrics, &stage_ctx);
+  metrics.add_collector(deadline_collect_metrics, NULL);
+  bool metrics_enabled = metrics.start(metrics_cfg);
+
+  // start the display thread, only when showing the pipeline
+  if (show_pipeline_g) {
+    thread_params[DISPLAY_THREAD].tid = 1;
+    thread_params[DISPLAY_THREAD].payload = (void*)(&show_rate);
+
+    pthread_create( &threads[DISPLAY_THREAD],
+                    &rt_sched_attr[DISPLAY_THREAD],
+                    display_thread,
+                    &thread_params[DISPLAY_THREAD]
+                   );
+  }
   
-  // start the processing thread
-  thread_params[PROCESS_THREAD].tid = 2;
-  thread_params[PROCESS_THREAD].payload = (void*)(&show_pipeline);
-
-  pthread_create( &threads[PROCESS_THREAD],
-                  &rt_sched_attr[PROCESS_THREAD],
-                  process_thread,
-                  &thread_params[PROCESS_THREAD]
-                 );
-
-  // start the video writing thread
-  thread_params[WRITE_THREAD].tid = 3;
-  thread_params[WRITE_THREAD].payload = (void*)(&output_folder);
-
-  pthread_create( &threads[WRITE_THREAD],
-                  &rt_sched_attr[WRITE_THREAD],
-                  write_thread,
-                  &thread_params[WRITE_THREAD]
-                 );
+  pipeline.join();
 
-  
-  for (int i=0; i<NUM_THREADS; i++) {
-    pthread_join(threads[i], NULL);
+  // stops the display thread once the stream has ended
+  exit_signal_g = 1;
+  if (show_pipeline_g) {
+    pthread_join(threads[DISPLAY_THREAD], NULL);
   }
 
+  // the last dump of the snapshot ring
+  snapshot_ring.stop();
+
+  // the final counts into the metrics file
+  if (metrics_enabled) {
+    metrics.stop();
+  }
+
+  pipeline.print_stats();
+  TIMING_PRINT();
+  PERF_PRINT();
+  deadline_print();
+  rtmem_print();
+  if (replay != NULL) {
+    replay->print();
+  }
+  LOGP("lane lines detected: %u\n", stage_ctx.lines_detected);
+  latency_stat_print("capture->decision", &stage_ctx.decision_lat);
+  latency_stat_print("capture->event", &stage_ctx.event_lat);
+  latency_stat_print("capture->file", &stage_ctx.file_lat);
+
+  if (stage_ctx.pool) {
+    LOGP("low-latency pool, threads: %i, tasks: %lu, stolen: %lu\n",
+         pool.get_threads(), pool.get_tasks_run(), pool.get_tasks_stolen());
+  }
+
+  if (preview_enabled) {
+    LOGP("preview, frames encoded: %u, skipped: %lu, encode msec: %6.2f\n",
+         preview.get_frames_encoded(),
+         preview.get_frames_skipped(),
+         preview.get_encode_elapsed());
+    preview.stop();
+  }
+
+  if (metrics_enabled) {
+    LOGP("metrics, scrapes: %lu, files written: %lu\n",
+         metrics.get_scrapes(), metrics.get_files_written());
+  }
+
+  if (events.is_open()) {
+    LOGP("lane events, sent: %lu, dropped: %lu\n", 
+         events.get_sent(), events.get_dropped());
+  }
+
+  if (shm.is_open()) {
+    LOGP("shm ring, frames published: %llu\n", 
+         (unsigned long long)shm.get_published());
+    shm.destroy();
+  }
+
+  delete replay;
+  delete source;
+
   return 0;
 }
 
@@ -0,0 +1,416 @@
+/* ----------------------------------------------------------------------------
+ * @file metrics.cpp
+ * @brief Live metrics of the running pipeline, see metrics.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "metrics.h"
+#include "net.h"
+#include "log.h"
+
+#define SEND_TIMEOUT_MS (200)
+
+// around the 33 msec of a 30 FPS frame, then coarser up to a second
+const double MetricHistogram::bounds[METRICS_BUCKETS] = {
+  1, 2, 3, 5, 8, 12, 16, 20, 25, 33, 40, 50, 66, 100, 150, 250, 500, 1000,
+  INFINITY
+};
+
+static const char not_found[] =
+  "HTTP/1.0 404 Not Found\r\n"
+  "Content-Type: text/plain\r\n\r\n"
+  "not found\n";
+
+// see .h for more details
+void MetricHistogram::reset() {
+
+  for (int i = 0; i < METRICS_BUCKETS; i++) {
+    buckets[i] = 0;
+  }
+  sum_us = 0;
+}
+
+// see .h for more details
+void MetricHistogram::observe(double msec) {
+
+  int i = 0;
+  while (msec > bounds[i]) {
+    i++;
+  }
+  __atomic_fetch_add(&buckets[i], 1, __ATOMIC_RELAXED);
+  if (msec > 0.0) {
+    __atomic_fetch_add(&sum_us, (uint64_t)(msec*1000.0), __ATOMIC_RELAXED);
+  }
+}
+
+// see .h for more details
+uint64_t MetricHistogram::read(uint64_t counts[METRICS_BUCKETS],
+                               double* sum_msec) const {
+
+  uint64_t total = 0;
+  for (int i = 0; i < METRICS_BUCKETS; i++) {
+    counts[i] = metric_load(&buckets[i]);
+    total += counts[i];
+  }
+  if (sum_msec != NULL) {
+    *sum_msec = metric_load(&sum_us) / 1000.0;
+  }
+  return total;
+}
+
+// see .h for more details
+double MetricHistogram::percentile(const uint64_t counts[METRICS_BUCKETS],
+                                   double q) {
+
+  uint64_t total = 0;
+  for (int i = 0; i < METRICS_BUCKETS; i++) {
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0.0;
+  }
+
+  double rank = q * total;
+  uint64_t below = 0;
+  for (int i = 0; i < METRICS_BUCKETS; i++) {
+    if (counts[i] > 0 && below + counts[i] >= rank) {
+      if (i == METRICS_BUCKETS-1) {
+        // past the last bound, no better estimate
+        return bounds[i-1];
+      }
+      double lo = (i > 0) ? bounds[i-1] : 0.0;
+      return lo + (bounds[i] - lo) * (rank - below) / counts[i];
+    }
+    below += counts[i];
+  }
+  return bounds[METRICS_BUCKETS-2];
+}
+
+/* @brief Appends 'name suffix{labels,extra} value'
+ */
+void MetricsText::line(const char* name, const char* suffix,
+                       const char* labels, const char* extra,
+                       const char* value) {
+
+  bool has_labels = labels != NULL && labels[0] != '\0';
+  bool has_extra = extra != NULL && extra[0] != '\0';
+
+  text += name;
+  text += suffix;
+  if (has_labels || has_extra) {
+    text += '{';
+    if (has_labels) text += labels;
+    if (has_labels && has_extra) text += ',';
+    if (has_extra) text += extra;
+    text += '}';
+  }
+  text += ' ';
+  text += value;
+  text += '\n';
+}
+
+// see .h for more details
+void MetricsText::family(const char* name, const char* type,
+                         const char* help) {
+
+  text += "# HELP ";
+  text += name;
+  text += ' ';
+  text += help;
+  text += "\n# TYPE ";
+  text += name;
+  text += ' ';
+  text += type;
+  text += '\n';
+}
+
+// see .h for more details
+void MetricsText::sample(const char* name, const char* labels, double value) {
+
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.6g", value);
+  line(name, "", labels, NULL, buf);
+}
+
+// see .h for more details
+void MetricsText::count(const char* name, const char* labels,
+                        unsigned long value) {
+
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%lu", value);
+  line(name, "", labels, NULL, buf);
+}
+
+// see .h for more details
+void MetricsText::histogram(const char* name, const char* labels,
+                            const MetricHistogram& hist) {
+
+  uint64_t counts[METRICS_BUCKETS];
+  double sum;
+  uint64_t total = hist.read(counts, &sum);
+
+  char le[32], value[32];
+  uint64_t cumulative = 0;
+  for (int i = 0; i < METRICS_BUCKETS; i++) {
+    cumulative += counts[i];
+    if (i == METRICS_BUCKETS-1) {
+      snprintf(le, sizeof(le), "le=\"+Inf\"");
+    } else {
+      snprintf(le, sizeof(le), "le=\"%g\"", MetricHistogram::bounds[i]/1000.0);
+    }
+    snprintf(value, sizeof(value), "%llu", (unsigned long long)cumulative);
+    line(name, "_bucket", labels, le, value);
+  }
+
+  snprintf(value, sizeof(value), "%.6f", sum/1000.0);
+  line(name, "_sum", labels, NULL, value);
+  snprintf(value, sizeof(value), "%llu", (unsigned long long)total);
+  line(name, "_count", labels, NULL, value);
+}
+
+// see .h for more details
+void MetricsText::quantiles(const char* name, const char* labels,
+                            const MetricHistogram& hist) {
+
+  static const double qs[] = {0.5, 0.9, 0.99, 0.999};
+  static const char* q_labels[] = {
+    "quantile=\"0.5\"", "quantile=\"0.9\"", "quantile=\"0.99\"",
+    "quantile=\"0.999\""
+  };
+
+  uint64_t counts[METRICS_BUCKETS];
+  hist.read(counts, NULL);
+
+  char value[32];
+  for (int i = 0; i < 4; i++) {
+    snprintf(value, sizeof(value), "%.3f",
+             MetricHistogram::percentile(counts, qs[i]));
+    line(name, "", labels, q_labels[i], value);
+  }
+}
+
+/* @brief The default exporter constructor, does not start anything
+ */
+MetricsExporter::MetricsExporter() {
+
+  running = false;
+  listen_fd = -1;
+  t_start = 0.0;
+  num_collectors = 0;
+  scrapes = files_written = 0;
+}
+
+MetricsExporter::~MetricsExporter() {
+
+  stop();
+}
+
+// see .h for more details
+bool MetricsExporter::add_collector(metrics_collector_t fn, void* arg) {
+
+  if (running || num_collectors == METRICS_MAX_COLLECTORS) {
+    return false;
+  }
+  collectors[num_collectors] = fn;
+  collector_args[num_collectors] = arg;
+  num_collectors++;
+  return true;
+}
+
+// see .h for more details
+bool MetricsExporter::start(const metrics_config_t& config) {
+
+  cfg = config;
+  if (cfg.interval <= 0.0) cfg.interval = 1000.0;
+  if (cfg.port <= 0 && cfg.path.empty()) {
+    return false;
+  }
+
+  if (cfg.port > 0) {
+    listen_fd = net_tcp_listen(cfg.addr.c_str(), cfg.port);
+    if (listen_fd < 0) {
+      return false;
+    }
+  }
+
+  t_start = get_time_msec();
+  running = true;
+  if (pthread_create(&thread, NULL, thread_entry, this) != 0) {
+    perror("metrics pthread_create");
+    running = false;
+    if (listen_fd >= 0) {
+      close(listen_fd);
+      listen_fd = -1;
+    }
+    return false;
+  }
+
+  if (cfg.port > 0) {
+    LOGP("metrics: http://%s:%i/metrics\n", cfg.addr.c_str(), cfg.port);
+  }
+  if (!cfg.path.empty()) {
+    LOGP("metrics: %s, every %.0f msec\n", cfg.path.c_str(), cfg.interval);
+  }
+  return true;
+}
+
+// see .h for more details
+void MetricsExporter::stop() {
+
+  if (!running) return;
+
+  running = false;
+  pthread_join(thread, NULL);
+
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    listen_fd = -1;
+  }
+
+  // the final counts of the run
+  if (!cfg.path.empty()) {
+    write_file();
+  }
+}
+
+void *MetricsExporter::thread_entry(void *param) {
+
+  MetricsExporter *exporter = (MetricsExporter*) param;
+
+  // the exporter must only use otherwise idle CPU
+  struct sched_param sp;
+  sp.sched_priority = 0;
+  if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp) != 0) {
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+  }
+
+  exporter->run();
+  return nullptr;
+}
+
+/* @brief The exporter thread loop: serves scrapes, and every interval
+ *        rewrites the stats file
+ */
+void MetricsExporter::run() {
+
+  double next = get_time_msec();
+  struct pollfd pfd;
+
+  while (running) {
+
+    double now = get_time_msec();
+    int timeout = 100;
+    if (!cfg.path.empty()) {
+      int until = (next > now) ? (int)(next - now) + 1 : 0;
+      if (until < timeout) timeout = until;
+    }
+
+    if (listen_fd >= 0) {
+      pfd.fd = listen_fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if (poll(&pfd, 1, timeout) > 0) {
+        int fd;
+        while ((fd = net_accept(listen_fd, SEND_TIMEOUT_MS)) >= 0) {
+          handle_request(fd);
+        }
+      }
+    } else {
+      usleep(timeout*1000);
+    }
+
+    now = get_time_msec();
+    if (!cfg.path.empty() && now >= next) {
+      write_file();
+      next += cfg.interval;
+      if (next < now) next = now + cfg.interval;
+    }
+  }
+}
+
+/* @brief Runs every collector into the text
+ */
+void MetricsExporter::collect() {
+
+  text.clear();
+  text.family("emvia_uptime_seconds", "gauge",
+              "Seconds since the metrics exporter started.");
+  text.sample("emvia_uptime_seconds", NULL,
+              (get_time_msec() - t_start) / 1000.0);
+
+  for (int i = 0; i < num_collectors; i++) {
+    collectors[i](text, collector_args[i]);
+  }
+}
+
+/* @brief Answers one request, /metrics (or /) with the exposition text
+ */
+void MetricsExporter::handle_request(int fd) {
+
+  char path[256];
+  char head[160];
+
+  if (!net_read_get_path(fd, path, sizeof(path))) {
+    close(fd);
+    return;
+  }
+
+  if (strcmp(path, "/metrics") != 0 && strcmp(path, "/") != 0) {
+    net_send_all(fd, not_found, sizeof(not_found)-1);
+    close(fd);
+    return;
+  }
+
+  collect();
+  scrapes++;
+
+  const std::string& body = text.str();
+  int m = snprintf(head, sizeof(head),
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: text/plain; version=0.0.4\r\n"
+    "Content-Length: %lu\r\n\r\n", (unsigned long)body.size());
+
+  if (net_send_all(fd, head, m)) {
+    net_send_all(fd, body.data(), body.size());
+  }
+  close(fd);
+}
+
+/* @brief Writes the exposition text to <path>.tmp and renames it over
+ *        the stats file
+ */
+void MetricsExporter::write_file() {
+
+  collect();
+
+  std::string tmp = cfg.path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (f == NULL) {
+    perror("metrics fopen");
+    return;
+  }
+  const std::string& body = text.str();
+  bool ok = fwrite(body.data(), 1, body.size(), f) == body.size();
+  if (fclose(f) != 0 || !ok) {
+    perror("metrics write");
+    unlink(tmp.c_str());
+    return;
+  }
+  if (rename(tmp.c_str(), cfg.path.c_str()) != 0) {
+    perror("metrics rename");
+    unlink(tmp.c_str());
+    return;
+  }
+  files_written++;
+}
@@ -0,0 +1,183 @@
+/* ----------------------------------------------------------------------------
+ * @file metrics.h
+ * @brief Live metrics of the running pipeline, in the Prometheus text
+ *        exposition format over HTTP and/or a periodically rewritten file
+ *
+ * The hot path only ever updates plain counters with relaxed atomic
+ * stores or adds, no locks and no allocation:
+ *
+ *   metric_add(&task->frames, 1);   // counter with a single writer
+ *   hist.observe(msec);             // latency histogram, any thread
+ *
+ * Everything else happens on the exporter thread, at idle priority: on a
+ * scrape of /metrics, and every interval when writing the file, it calls
+ * the collectors, which read the counters with relaxed atomic loads and
+ * format them. Percentiles are estimated from the histogram buckets at
+ * that time. A collector reads counters the modules keep anyway (the
+ * pipeline's per-node frames and queues, the stage context, the deadline
+ * statistics), so a scrape sees each counter exactly, but the set of them
+ * not at one instant.
+ *
+ * The file is written to <path>.tmp and renamed over <path>, so readers
+ * never see a partial file, e.g. for node_exporter's textfile collector.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+
+#define METRICS_MAX_COLLECTORS (8)
+#define METRICS_BUCKETS        (19)   // latency buckets, the last is +Inf
+
+/* @brief Adds to a counter only one thread writes, without a locked
+ *        instruction, for the exporter to read with metric_load()
+ */
+template <typename T, typename N>
+static inline void metric_add(T* counter, N n) {
+  __atomic_store_n(counter, (T)(*counter + n), __ATOMIC_RELAXED);
+}
+
+// sets a gauge only one thread writes
+template <typename T, typename V>
+static inline void metric_set(T* gauge, V value) {
+  __atomic_store_n(gauge, (T)value, __ATOMIC_RELAXED);
+}
+
+// reads a counter or gauge from the exporter thread
+template <typename T>
+static inline T metric_load(const T* v) {
+  return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+/* @brief Latency histogram with fixed buckets in msec, safe to update
+ *        from any thread
+ */
+class MetricHistogram {
+
+private:
+
+  uint64_t buckets[METRICS_BUCKETS];
+  uint64_t sum_us;
+
+public:
+
+  // the upper bounds of the buckets in msec, the last is +Inf
+  static const double bounds[METRICS_BUCKETS];
+
+  MetricHistogram() { reset(); }
+
+  void reset();
+
+  void observe(double msec);
+
+  /* @brief Copies the bucket counts (not cumulative)
+   *
+   * @return the number of samples
+   */
+  uint64_t read(uint64_t counts[METRICS_BUCKETS], double* sum_msec) const;
+
+  /* @brief Estimates a percentile from bucket counts, interpolated
+   *        linearly inside the bucket
+   *
+   * @param q, 0..1
+   * @return msec, 0 without samples
+   */
+  static double percentile(const uint64_t counts[METRICS_BUCKETS], double q);
+};
+
+/* @brief Builds an exposition text, on the exporter thread only
+ */
+class MetricsText {
+
+private:
+
+  std::string text;
+
+  void line(const char* name, const char* suffix, const char* labels,
+            const char* extra, const char* value);
+
+public:
+
+  void clear() { text.clear(); }
+  const std::string& str() const { return text; }
+
+  // the HELP and TYPE lines, once before the samples of a metric
+  void family(const char* name, const char* type, const char* help);
+
+  // one sample, labels as 'a="x",b="y"' or NULL
+  void sample(const char* name, const char* labels, double value);
+  void count(const char* name, const char* labels, unsigned long value);
+
+  // the buckets (le in seconds), sum and count of a histogram family
+  void histogram(const char* name, const char* labels,
+                 const MetricHistogram& hist);
+
+  // p50, p90, p99 and p999 of a histogram, in msec, as a gauge family
+  void quantiles(const char* name, const char* labels,
+                 const MetricHistogram& hist);
+};
+
+// appends the metrics of one module
+typedef void (*metrics_collector_t)(MetricsText& out, void* arg);
+
+/* @brief Exporter settings
+ */
+typedef struct {
+  std::string addr;   // interface to bind, 127.0.0.1 by default
+  int port;           // TCP port of /metrics, 0 disables the endpoint
+  std::string path;   // stats file, empty disables the file
+  double interval;    // msec between rewrites of the file
+} metrics_config_t;
+
+/* @brief Serves /metrics and rewrites the stats file from one idle
+ *        priority thread
+ */
+class MetricsExporter {
+
+private:
+
+  metrics_config_t cfg;
+  pthread_t thread;
+  volatile bool running;
+  int listen_fd;
+  double t_start;
+
+  metrics_collector_t collectors[METRICS_MAX_COLLECTORS];
+  void* collector_args[METRICS_MAX_COLLECTORS];
+  int num_collectors;
+
+  MetricsText text;
+  unsigned long scrapes, files_written;
+
+  static void *thread_entry(void *param);
+  void run();
+  void collect();
+  void handle_request(int fd);
+  void write_file();
+
+public:
+
+  MetricsExporter();
+  ~MetricsExporter();
+
+  // registers a collector, before start()
+  bool add_collector(metrics_collector_t fn, void* arg);
+
+  // binds the endpoint and starts the thread, false if neither the
+  // endpoint nor the file is configured or the bind failed
+  bool start(const metrics_config_t& config);
+
+  // stops the thread, then writes the file a last time
+  void stop();
+
+  unsigned long get_scrapes() { return scrapes; }
+  unsigned long get_files_written() { return files_written; }
+};
+
+#endif // METRICS_H
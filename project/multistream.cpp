@@ -0,0 +1,346 @@
+/* ----------------------------------------------------------------------------
+ * @file multistream.cpp
+ * @brief Many input streams on a shared worker pool, see multistream.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
+#include <opencv2/imgcodecs.hpp>
+
+#include "log.h"
+#include "lane.h"
+#include "source.h"
+#include "stages.h"
+#include "timing.h"
+#include "deadline.h"
+#include "yuv.h"
+#include "multistream.h"
+
+/* @brief The state of one stream, only touched by the worker holding it
+ */
+typedef struct {
+  const stream_desc_t* desc;
+  FrameSource* source;
+  LaneDetector detector;
+  FILE* results;
+  Mat img;
+  std::vector<uchar> jpeg;
+  unsigned int frames;
+  double t_start, t_end;     // msec, first frame taken to end of stream
+  uint64_t busy_ns;
+  bool busy;                 // held by a worker, under the scheduler lock
+  bool done;
+} stream_t;
+
+/* @brief The round-robin scheduler shared by the workers
+ */
+typedef struct {
+  const multistream_config_t* cfg;
+  volatile int* stop;
+  std::vector<stream_t*> streams;
+  size_t cursor;             // the stream to offer next
+  size_t active;             // streams not done
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} scheduler_t;
+
+static bool make_folder(const String& folder) {
+
+  if (mkdir(folder.c_str(), 0755) < 0 && errno != EEXIST) {
+    perror("multistream mkdir");
+    return false;
+  }
+  return true;
+}
+
+static void add_stream(multistream_config_t& cfg, const String& input,
+                       const String& folder, const String& results) {
+
+  stream_desc_t desc;
+  desc.input = input;
+  desc.output_folder = folder;
+  if (!desc.output_folder.empty()
+      && desc.output_folder[desc.output_folder.size()-1] != '/') {
+    desc.output_folder += '/';
+  }
+  desc.results_path = results;
+  cfg.streams.push_back(desc);
+}
+
+// see .h for more details
+bool multistream_add(multistream_config_t& cfg, const String& inputs,
+                     const String& manifest, const String& output_folder,
+                     bool results) {
+
+  size_t first = cfg.streams.size();
+
+  // inputs list
+  size_t pos = 0;
+  while (pos < inputs.size()) {
+    size_t comma = inputs.find(',', pos);
+    if (comma == String::npos) comma = inputs.size();
+    String input = inputs.substr(pos, comma-pos);
+    pos = comma+1;
+    if (!input.empty()) {
+      add_stream(cfg, input, "", "");
+    }
+  }
+
+  // manifest, "input [output_folder [results]]" per line
+  if (!manifest.empty()) {
+    FILE* f = fopen(manifest.c_str(), "r");
+    if (f == NULL) {
+      perror("multistream manifest fopen");
+      return false;
+    }
+    char line[1024], input[512], folder[512], csv[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+      char* hash = strchr(line, '#');
+      if (hash != NULL) *hash = '\0';
+      folder[0] = csv[0] = '\0';
+      if (sscanf(line, "%511s %511s %511s", input, folder, csv) >= 1) {
+        add_stream(cfg, input, folder, csv);
+      }
+    }
+    fclose(f);
+  }
+
+  // default outputs
+  for (size_t i = first; i < cfg.streams.size(); i++) {
+    stream_desc_t& desc = cfg.streams[i];
+    if (desc.output_folder.empty()) {
+      char name[32];
+      sprintf(name, "stream%lu/", (unsigned long)i);
+      desc.output_folder = output_folder + name;
+      if (results) {
+        desc.results_path = desc.output_folder + "results.csv";
+      }
+    }
+    if (!make_folder(desc.output_folder)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* @brief Takes the next free stream round-robin, waits while all streams
+ *        are busy
+ *
+ * @return the stream, or NULL once all streams are done or on stop
+ */
+static stream_t* take_stream(scheduler_t* sched) {
+
+  stream_t* st = NULL;
+  size_t n = sched->streams.size();
+
+  pthread_mutex_lock(&sched->lock);
+  while (st == NULL && sched->active > 0 && !*sched->stop) {
+
+    for (size_t k = 0; k < n; k++) {
+      size_t i = (sched->cursor + k) % n;
+      stream_t* s = sched->streams[i];
+      if (!s->busy && !s->done) {
+        s->busy = true;
+        sched->cursor = i + 1;
+        st = s;
+        break;
+      }
+    }
+
+    if (st == NULL) {
+      // fewer free streams than workers, wait for one to be released
+      pthread_cond_wait(&sched->cond, &sched->lock);
+    }
+  }
+  pthread_mutex_unlock(&sched->lock);
+
+  return st;
+}
+
+static void release_stream(scheduler_t* sched, stream_t* st, bool done) {
+
+  pthread_mutex_lock(&sched->lock);
+  st->busy = false;
+  if (done) {
+    st->done = true;
+    st->t_end = get_time_msec();
+    sched->active--;
+  }
+  pthread_cond_broadcast(&sched->cond);
+  pthread_mutex_unlock(&sched->lock);
+}
+
+/* @brief One frame of a stream: decode, detect, annotate, encode, write
+ *
+ * @return false at the end of the stream
+ */
+static bool process_frame(stream_t* st, bool yuv) {
+
+  if (st->frames == 0) {
+    st->t_start = get_time_msec();
+  }
+  deadline_set_frame(st->frames);
+
+  bool got = yuv ? st->source->read_yuv(st->img) : st->source->read(st->img);
+  if (!got) {
+    return false;
+  }
+
+  if (yuv) {
+    st->detector.input_yuv(st->img);
+  } else {
+    st->detector.input_image(st->img);
+  }
+  st->detector.detect();
+  st->detector.annotate();
+
+  bool ok = yuv ? yuv_encode_jpeg(st->img, YUV_JPEG_QUALITY, st->jpeg)
+                : imencode(".jpg", st->img, st->jpeg);
+  if (ok) {
+    char name[20];
+    sprintf(name, "%08u.jpg", st->frames);
+    String path = st->desc->output_folder + name;
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == NULL) {
+      perror("multistream fopen");
+    } else {
+      fwrite(st->jpeg.data(), 1, st->jpeg.size(), f);
+      fclose(f);
+    }
+  }
+
+  if (st->results != NULL) {
+    lane_state_t state;
+    st->detector.get_state(state);
+    stages_results_row(st->results, st->frames, state);
+  }
+
+  st->frames++;
+  return true;
+}
+
+static void* worker_main(void* arg) {
+
+  scheduler_t* sched = (scheduler_t*) arg;
+  stream_t* st;
+
+  while ((st = take_stream(sched)) != NULL) {
+    uint64_t start = time_now_ns();
+    bool more = process_frame(st, sched->cfg->yuv);
+    st->busy_ns += time_now_ns() - start;
+    release_stream(sched, st, !more);
+  }
+
+  // wake the others, the last stream may have just finished
+  pthread_mutex_lock(&sched->lock);
+  pthread_cond_broadcast(&sched->cond);
+  pthread_mutex_unlock(&sched->lock);
+  return NULL;
+}
+
+// see .h for more details
+int multistream_run(const multistream_config_t& cfg, volatile int* stop) {
+
+  scheduler_t sched;
+  sched.cfg = &cfg;
+  sched.stop = stop;
+  sched.cursor = 0;
+  pthread_mutex_init(&sched.lock, NULL);
+  pthread_cond_init(&sched.cond, NULL);
+
+  int rc = 0;
+  for (size_t i = 0; i < cfg.streams.size(); i++) {
+
+    stream_t* st = new stream_t();
+    st->desc = &cfg.streams[i];
+    st->detector.set_acc_thresh(cfg.acc_thresh);
+    st->detector.set_adaptive_thresh(cfg.adaptive_thresh);
+    st->detector.set_budget(cfg.budget);
+    st->source = open_source(st->desc->input, "");
+    st->results = NULL;
+    st->frames = 0;
+    st->t_start = st->t_end = 0.0;
+    st->busy_ns = 0;
+    st->busy = false;
+    st->done = (st->source == NULL);
+    sched.streams.push_back(st);
+
+    if (st->source == NULL) {
+      rc = 1;
+      continue;
+    }
+    if (!st->desc->results_path.empty()) {
+      st->results = fopen(st->desc->results_path.c_str(), "w");
+      if (st->results == NULL) {
+        perror("multistream results fopen");
+      } else {
+        stages_results_header(st->results);
+      }
+    }
+  }
+
+  sched.active = 0;
+  for (size_t i = 0; i < sched.streams.size(); i++) {
+    if (!sched.streams[i]->done) sched.active++;
+  }
+
+  int threads = (cfg.threads > 0) ? cfg.threads : get_nprocs();
+  std::vector<pthread_t> workers(threads);
+  double start = get_time_msec();
+  int started = 0;
+
+  LOGP("multistream, streams: %lu, worker threads: %i\n",
+       (unsigned long)sched.streams.size(), threads);
+
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&workers[i], NULL, worker_main, &sched) != 0) {
+      perror("multistream pthread_create");
+      break;
+    }
+    started++;
+  }
+  for (int i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  double wall = (get_time_msec() - start) / 1000.0;
+  unsigned long total = 0;
+
+  for (size_t i = 0; i < sched.streams.size(); i++) {
+
+    stream_t* st = sched.streams[i];
+    double end = (st->t_end > 0.0) ? st->t_end : get_time_msec();
+    double secs = (st->frames > 0) ? (end - st->t_start) / 1000.0 : 0.0;
+    total += st->frames;
+
+    LOGP("stream %2lu, frames: %6u, FPS: %7.2f, busy msec/frame: %6.2f, "
+         "lines: %u, %s\n",
+         (unsigned long)i, st->frames, (secs > 0) ? st->frames/secs : 0.0,
+         st->frames ? st->busy_ns/1e6/st->frames : 0.0,
+         st->detector.get_lines_detected(), st->desc->input.c_str());
+    if (cfg.budget > 0.0) {
+      stages_print_degrade("stream", st->detector);
+    }
+
+    if (st->results != NULL) {
+      fclose(st->results);
+    }
+    delete st->source;
+    delete st;
+  }
+
+  LOGP("multistream aggregate, frames: %lu, wall sec: %.2f, FPS: %.2f, "
+       "FPS per worker: %.2f\n", total, wall, (wall > 0) ? total/wall : 0.0,
+       (wall > 0) ? total/wall/threads : 0.0);
+
+  pthread_mutex_destroy(&sched.lock);
+  pthread_cond_destroy(&sched.cond);
+  return (rc == 0 && !*stop) ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+/* ----------------------------------------------------------------------------
+ * @file multistream.h
+ * @brief Many input streams in one process on a shared, fixed-size pool of
+ *        worker threads
+ *
+ * Every stream has its own source, LaneDetector (decision state), output
+ * folder and results. A job is one frame of one stream: decode, detect,
+ * annotate, encode and write. The workers take the streams round-robin, and
+ * a stream is worked on by one worker at a time, so its frames stay in
+ * order and its decision state needs no locking. Workers that find every
+ * stream busy sleep on a condition variable instead of spinning, so the
+ * process never uses more cores than it has workers.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef MULTISTREAM_H
+#define MULTISTREAM_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+using namespace cv;
+
+/* @brief One input stream and where its outputs go
+ */
+typedef struct {
+  String input;           // see open_source()
+  String output_folder;   // annotated frames, ending in '/'
+  String results_path;    // per-frame results CSV, may be empty
+} stream_desc_t;
+
+/* @brief Multi-stream mode settings
+ */
+typedef struct {
+  std::vector<stream_desc_t> streams;
+  int threads;            // worker threads, 0 for one per core
+  bool yuv;               // YUV420 mode, see LaneDetector::input_yuv()
+  int acc_thresh;         // see LaneDetector::set_acc_thresh()
+  bool adaptive_thresh;   // see LaneDetector::set_adaptive_thresh()
+  double budget;          // msec per frame, see LaneDetector::set_budget()
+} multistream_config_t;
+
+/* @brief Adds the streams of a comma separated input list or a manifest
+ *
+ * A manifest has one stream per line, "input [output_folder [results]]",
+ * '#' starts a comment. Streams without an output folder write to
+ * <output_folder>stream<i>/, and with results set to results.csv in it.
+ *
+ * @param cfg, the settings to add the streams to
+ * @param inputs, comma separated inputs, may be empty
+ * @param manifest, manifest file, may be empty
+ * @param output_folder, base folder of the per-stream folders
+ * @param results, true to write a results CSV per stream
+ * @return false if the manifest cannot be read or a folder not created
+ */
+bool multistream_add(multistream_config_t& cfg, const String& inputs,
+                     const String& manifest, const String& output_folder,
+                     bool results);
+
+/* @brief Processes all streams and prints per-stream and aggregate FPS
+ *
+ * @param cfg, the settings
+ * @param stop, set to non-zero (e.g. on SIGINT) to stop all streams
+ * @return the process exit code
+ */
+int multistream_run(const multistream_config_t& cfg, volatile int* stop);
+
+#endif // MULTISTREAM_H
@@ -0,0 +1,127 @@
+/* ----------------------------------------------------------------------------
+ * @file net.cpp
+ * @brief Minimal socket helpers for the local HTTP endpoints
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "net.h"
+
+// see .h for more details
+int net_tcp_listen(const char* addr, int port) {
+
+  struct sockaddr_in sa;
+  int one = 1;
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("net_tcp_listen socket");
+    return -1;
+  }
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(port);
+  if (inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+    fprintf(stderr, "net_tcp_listen: bad address %s\n", addr);
+    close(fd);
+    return -1;
+  }
+
+  if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+    perror("net_tcp_listen bind");
+    close(fd);
+    return -1;
+  }
+
+  if (listen(fd, 4) < 0) {
+    perror("net_tcp_listen listen");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+// see .h for more details
+int net_accept(int listen_fd, int send_timeout_ms) {
+
+  int one = 1;
+  struct timeval tv;
+
+  int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  tv.tv_sec = send_timeout_ms / 1000;
+  tv.tv_usec = (send_timeout_ms % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  return fd;
+}
+
+// see .h for more details
+bool net_send_all(int fd, const void* buf, size_t len) {
+
+  const char* p = (const char*)buf;
+
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+// see .h for more details
+bool net_read_get_path(int fd, char* path, size_t len) {
+
+  char req[1024];
+  size_t used = 0;
+  struct pollfd pfd = {fd, POLLIN, 0};
+
+  // read until the end of the request head, the body is never needed
+  while (used < sizeof(req)-1) {
+    if (poll(&pfd, 1, 200) <= 0) return false;
+    ssize_t n = recv(fd, req+used, sizeof(req)-1-used, 0);
+    if (n <= 0) return false;
+    used += n;
+    req[used] = '\0';
+    if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+  }
+
+  if (strncmp(req, "GET ", 4) != 0) return false;
+
+  const char* start = req + 4;
+  const char* end = strchr(start, ' ');
+  if (end == NULL) return false;
+
+  size_t n = end - start;
+  if (n >= len) n = len-1;
+  memcpy(path, start, n);
+  path[n] = '\0';
+
+  return true;
+}
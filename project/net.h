@@ -0,0 +1,45 @@
+/* ----------------------------------------------------------------------------
+ * @file net.h
+ * @brief Minimal socket helpers for the local HTTP endpoints
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef NET_H
+#define NET_H
+
+#include <stddef.h>
+
+/* @brief Opens a non-blocking TCP listening socket
+ *
+ * @param addr, the IPv4 interface address to bind, e.g. "127.0.0.1"
+ * @param port, the TCP port to listen on
+ * @return the socket fd, or -1 on error
+ */
+int net_tcp_listen(const char* addr, int port);
+
+/* @brief Accepts a pending client and sets a send timeout on it
+ *
+ * @param listen_fd, the listening socket
+ * @param send_timeout_ms, clients that stall a send longer than this fail
+ * @return the client fd, or -1 if none is pending
+ */
+int net_accept(int listen_fd, int send_timeout_ms);
+
+/* @brief Sends the full buffer, handling short writes
+ *
+ * @return true on success, false if the peer went away or timed out
+ */
+bool net_send_all(int fd, const void* buf, size_t len);
+
+/* @brief Reads an HTTP request head and extracts the GET path
+ *
+ * @param fd, the client socket
+ * @param path, output buffer for the request path
+ * @param len, size of the path buffer
+ * @return true if a GET request was parsed
+ */
+bool net_read_get_path(int fd, char* path, size_t len);
+
+#endif // NET_H
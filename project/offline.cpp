@@ -0,0 +1,316 @@
+/* ----------------------------------------------------------------------------
+ * @file offline.cpp
+ * @brief Chunk-parallel offline processing of long recordings, see offline.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/sysinfo.h>
+#include <vector>
+#include <opencv2/imgcodecs.hpp>
+
+#include "log.h"
+#include "lane.h"
+#include "source.h"
+#include "stages.h"
+#include "timing.h"
+#include "deadline.h"
+#include "yuv.h"
+#include "offline.h"
+
+/* @brief One segment of a run
+ */
+typedef struct {
+  const offline_config_t* cfg;
+  volatile int* stop;
+  bool write;                         // write the output frames
+  bool last;                          // runs to the end of the input
+  int core;
+  unsigned int warm, start, end;      // warm-up [warm, start), out [start, end)
+  std::vector<lane_state_t> states;   // of the output frames, in order
+  unsigned int lines;
+  uint64_t wall_ns, cpu_ns;
+  bool ok;
+} segment_t;
+
+/* @brief Result of one run with a given number of segments
+ */
+typedef struct {
+  int segments;
+  unsigned int frames;       // output frames
+  unsigned int warm_frames;  // decoded and detected, but not output
+  double wall_s;
+} run_t;
+
+/* @brief Rounds a frame number down to a keyframe
+ */
+static unsigned int align_gop(unsigned int frame, int gop) {
+
+  return (gop > 1) ? frame - frame % gop : frame;
+}
+
+/* @brief Processes one segment with its own source and detector
+ */
+static void* segment_main(void* arg) {
+
+  segment_t* seg = (segment_t*) arg;
+  const offline_config_t* cfg = seg->cfg;
+  uint64_t wall_start = time_now_ns();
+  uint64_t cpu_start = time_thread_cpu_ns();
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(seg->core, &cpus);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+  FrameSource* source = open_source(cfg->input, "");
+  if (source == NULL || !source->seek(seg->warm)) {
+    fprintf(stderr, "offline: cannot seek to frame %u\n", seg->warm);
+    delete source;
+    return NULL;
+  }
+
+  LaneDetector detector;
+  lane_state_t state;
+  Mat img;
+  std::vector<uchar> jpeg;
+  char name[20];
+  unsigned int f;
+  unsigned int lines_start = 0;
+  bool eos = false;
+
+  // the adaptive threshold warms up along with the decision state
+  detector.set_acc_thresh(cfg->acc_thresh);
+  detector.set_adaptive_thresh(cfg->adaptive_thresh);
+
+  seg->states.reserve(seg->end - seg->start);
+
+  for (f = seg->warm; f < seg->end && !*seg->stop; f++) {
+
+    bool got = cfg->yuv ? source->read_yuv(img) : source->read(img);
+    if (!got) {
+      eos = true;
+      break;
+    }
+    deadline_set_frame(f);
+
+    if (cfg->yuv) {
+      detector.input_yuv(img);
+    } else {
+      detector.input_image(img);
+    }
+    detector.detect();
+
+    // warm-up, only the decision state carries over
+    if (f < seg->start) {
+      continue;
+    }
+    if (f == seg->start) {
+      lines_start = detector.get_lines_detected();
+    }
+
+    if (!cfg->output_folder.empty()) {
+      detector.annotate();
+      bool ok = cfg->yuv ? yuv_encode_jpeg(img, YUV_JPEG_QUALITY, jpeg)
+                         : imencode(".jpg", img, jpeg);
+      if (ok && seg->write) {
+        sprintf(name, "%08u.jpg", f);
+        String path = cfg->output_folder + name;
+        FILE* out = fopen(path.c_str(), "wb");
+        if (out == NULL) {
+          perror("offline fopen");
+        } else {
+          fwrite(jpeg.data(), 1, jpeg.size(), out);
+          fclose(out);
+        }
+      }
+    }
+
+    detector.get_state(state);
+    state.frame_num = f;
+    seg->states.push_back(state);
+  }
+
+  // the frame count of a video file is often an estimate, the last segment
+  // ends with the input
+  if (eos && seg->last && f >= seg->start) {
+    seg->end = f;
+  }
+  seg->ok = (f == seg->end);
+  seg->lines = detector.get_lines_detected() - lines_start;
+  seg->wall_ns = time_now_ns() - wall_start;
+  seg->cpu_ns = time_thread_cpu_ns() - cpu_start;
+  delete source;
+  return NULL;
+}
+
+/* @brief Splits [0, total) into segments and processes them in parallel
+ *
+ * @return false if a segment could not be processed
+ */
+static bool run_segments(const offline_config_t& cfg, volatile int* stop,
+                         unsigned int total, int n, bool write,
+                         std::vector<segment_t>& segs, run_t& run) {
+
+  int cores = get_nprocs();
+  segs.clear();
+
+  for (int i = 0; i < n; i++) {
+
+    segment_t seg;
+    seg.cfg = &cfg;
+    seg.stop = stop;
+    seg.write = write;
+    seg.last = false;
+    seg.core = i % cores;
+    seg.start = align_gop((unsigned int)((uint64_t)total*i/n), cfg.gop);
+    seg.end = total;
+    seg.warm = (seg.start > (unsigned int)cfg.overlap)
+             ? align_gop(seg.start - cfg.overlap, cfg.gop) : 0;
+    seg.lines = 0;
+    seg.wall_ns = seg.cpu_ns = 0;
+    seg.ok = false;
+
+    if (!segs.empty()) {
+      if (seg.start <= segs.back().start) {
+        // a keyframe interval longer than the segment, merge them
+        continue;
+      }
+      segs.back().end = seg.start;
+    }
+    segs.push_back(seg);
+  }
+  segs.back().last = true;
+
+  std::vector<pthread_t> threads(segs.size());
+  double start = get_time_msec();
+
+  for (size_t i = 0; i < segs.size(); i++) {
+    if (pthread_create(&threads[i], NULL, segment_main, &segs[i]) != 0) {
+      perror("offline pthread_create");
+      *stop = 1;
+      segs.resize(i);
+      break;
+    }
+  }
+  for (size_t i = 0; i < segs.size(); i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  run.segments = segs.size();
+  run.wall_s = (get_time_msec() - start) / 1000.0;
+  run.frames = run.warm_frames = 0;
+
+  bool ok = true;
+  for (size_t i = 0; i < segs.size(); i++) {
+    run.frames += segs[i].states.size();
+    run.warm_frames += segs[i].start - segs[i].warm;
+    ok = ok && segs[i].ok;
+  }
+  return ok;
+}
+
+/* @brief Prints the segments of a run
+ */
+static void print_segments(const std::vector<segment_t>& segs) {
+
+  for (size_t i = 0; i < segs.size(); i++) {
+    const segment_t& s = segs[i];
+    double wall_s = s.wall_ns / 1e9;
+    LOGP("offline segment %2lu, core %2i, frames %7u - %7u, warm-up: %4u, "
+         "FPS: %7.2f, cpu: %5.1f%%\n",
+         (unsigned long)i, s.core, s.start, s.end, s.start - s.warm,
+         (wall_s > 0) ? s.states.size()/wall_s : 0.0,
+         s.wall_ns ? 100.0*s.cpu_ns/s.wall_ns : 0.0);
+  }
+}
+
+// see .h for more details
+int offline_run(const offline_config_t& cfg, volatile int* stop) {
+
+  // the length of the input, from a probe source
+  FrameSource* probe = open_source(cfg.input, "");
+  if (probe == NULL) {
+    return 1;
+  }
+  unsigned int total = probe->get_frame_count();
+  bool seekable = probe->seek(0);
+  delete probe;
+
+  if (total == 0 || !seekable) {
+    fprintf(stderr, "offline: %s is not seekable or of unknown length\n",
+            cfg.input.c_str());
+    return 1;
+  }
+
+  int n = (cfg.segments > 0) ? cfg.segments : 1;
+  std::vector<int> counts;
+  if (cfg.sweep) {
+    for (int c = 1; c < n; c *= 2) {
+      counts.push_back(c);
+    }
+  }
+  counts.push_back(n);
+
+  LOGP("offline, %u frames, segments: %i, overlap: %i, gop: %i\n",
+       total, n, cfg.overlap, cfg.gop);
+
+  std::vector<segment_t> segs;
+  std::vector<run_t> runs;
+  bool ok = true;
+
+  for (size_t r = 0; r < counts.size() && !*stop; r++) {
+
+    run_t run;
+    bool last = (r + 1 == counts.size());
+
+    // the sweep runs do the same work, only the last one writes files
+    ok = run_segments(cfg, stop, total, counts[r], last, segs, run);
+    runs.push_back(run);
+    print_segments(segs);
+    if (!ok) {
+      break;
+    }
+  }
+
+  // scaling against one segment, when it was run
+  LOGP("%-9s %8s %8s %9s %9s %8s %8s\n", "segments", "frames", "warm-up",
+       "wall s", "FPS", "speedup", "eff %");
+  for (size_t r = 0; r < runs.size(); r++) {
+    double fps = (runs[r].wall_s > 0) ? runs[r].frames / runs[r].wall_s : 0.0;
+    double speedup = (runs[0].segments == 1 && runs[r].wall_s > 0)
+                   ? runs[0].wall_s / runs[r].wall_s : 0.0;
+    LOGP("%-9i %8u %8u %9.2f %9.2f %8.2f %8.1f\n",
+         runs[r].segments, runs[r].frames, runs[r].warm_frames,
+         runs[r].wall_s, fps, speedup, 100.0*speedup/runs[r].segments);
+  }
+
+  // merge the results of the last run, in segment order
+  if (!cfg.results_path.empty() && !segs.empty()) {
+    FILE* results = fopen(cfg.results_path.c_str(), "w");
+    if (results == NULL) {
+      perror("offline results fopen");
+      return 1;
+    }
+    stages_results_header(results);
+    for (size_t i = 0; i < segs.size(); i++) {
+      for (size_t k = 0; k < segs[i].states.size(); k++) {
+        const lane_state_t& st = segs[i].states[k];
+        stages_results_row(results, st.frame_num, st);
+      }
+    }
+    fclose(results);
+  }
+
+  unsigned int lines = 0;
+  for (size_t i = 0; i < segs.size(); i++) {
+    lines += segs[i].lines;
+  }
+  LOGP("lane lines detected: %u\n", lines);
+
+  return (ok && !*stop) ? 0 : 1;
+}
@@ -0,0 +1,59 @@
+/* ----------------------------------------------------------------------------
+ * @file offline.h
+ * @brief Chunk-parallel offline processing of long recordings
+ *
+ * The input is split into N time segments, each processed on its own
+ * thread with its own decoder (FrameSource) and LaneDetector:
+ *
+ *   frames   0 ........................................... total
+ *   seg 0    [out.......)
+ *   seg 1        [warm][out.......)
+ *   seg 2                    [warm][out.......)
+ *
+ * Every segment but the first starts overlap frames early. Those warm-up
+ * frames run through detect() only, so the decision state (the previous
+ * warning level) at the boundary is the one a single pass would have, and
+ * they are not output. With a keyframe interval (gop) the boundaries and
+ * the warm-up starts are rounded down to keyframes, where the decoder can
+ * start without decoding frames it throws away.
+ *
+ * Output frames are written as %08d.jpg numbered by their position in the
+ * input, so the segments together form one ordered frame stream. The
+ * results CSV is merged in segment order once all segments are done.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef OFFLINE_H
+#define OFFLINE_H
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+
+/* @brief Offline mode settings
+ */
+typedef struct {
+  String input;           // a seekable source of known length, see source.h
+  int segments;           // parallel segments, one thread (and core) each
+  int overlap;            // warm-up frames before each segment boundary
+  int gop;                // keyframe interval to align to, 0 for none
+  bool sweep;             // runs 1, 2, 4, .. segments for the scaling report
+  bool yuv;               // YUV420 mode, see LaneDetector::input_yuv()
+  int acc_thresh;         // see LaneDetector::set_acc_thresh()
+  bool adaptive_thresh;   // see LaneDetector::set_adaptive_thresh()
+  String output_folder;   // annotated frames, empty for none
+  String results_path;    // merged per-frame results CSV, may be empty
+} offline_config_t;
+
+/* @brief Processes the input in parallel segments and prints the per
+ *        segment throughput and the scaling efficiency
+ *
+ * @param cfg, the settings
+ * @param stop, set to non-zero (e.g. on SIGINT) to stop all segments early
+ * @return the process exit code
+ */
+int offline_run(const offline_config_t& cfg, volatile int* stop);
+
+#endif // OFFLINE_H
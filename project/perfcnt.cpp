@@ -0,0 +1,319 @@
+/* ----------------------------------------------------------------------------
+ * @file perfcnt.cpp
+ * @brief Optional Linux perf_event counters, see perfcnt.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "log.h"
+#include "perfcnt.h"
+
+static const char* perf_names[PERF_NUM_COUNTERS] = {
+  "cycles", "instr", "cache-miss", "branch-miss", "ctx-sw", "page-flt",
+  "task-usec"
+};
+
+static const uint32_t perf_types[PERF_NUM_COUNTERS] = {
+  PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+  PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE,
+  PERF_TYPE_SOFTWARE
+};
+
+static const uint64_t perf_configs[PERF_NUM_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+  PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_PAGE_FAULTS,
+  PERF_COUNT_SW_TASK_CLOCK
+};
+
+static bool perf_enabled = false;
+static unsigned int perf_available = 0;
+static __thread PerfCounters* perf_counters = NULL;
+static PerfStat* perf_stats = NULL;
+
+static int perf_event_open(struct perf_event_attr* attr, int group_fd) {
+
+  // this thread (pid 0), any CPU
+  return syscall(__NR_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+PerfCounters::PerfCounters() {
+
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+    fd[i] = -1;
+    order[i] = -1;
+  }
+  num_open = 0;
+  leader = -1;
+}
+
+PerfCounters::~PerfCounters() {
+
+  close();
+}
+
+/* @brief Opens a group led by cycles (hardware) or the task clock
+ */
+bool PerfCounters::open_group(bool hardware) {
+
+  int first = hardware ? PERF_CYCLES : PERF_TASK_CLOCK;
+
+  for (int n = 0; n < PERF_NUM_COUNTERS; n++) {
+
+    // the leader first, then the others in order
+    int i = (n == 0) ? first : ((n <= first) ? n-1 : n);
+    if (!hardware && perf_types[i] == PERF_TYPE_HARDWARE) continue;
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_types[i];
+    attr.config = perf_configs[i];
+    attr.disabled = (n == 0);
+    // hardware counters in user space only, allowed up to
+    // perf_event_paranoid 2; the software events (context switches, page
+    // faults) are counted in the kernel and would always read 0 without it
+    attr.exclude_kernel = (perf_types[i] == PERF_TYPE_HARDWARE);
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                     | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    fd[i] = perf_event_open(&attr, (n == 0) ? -1 : leader);
+    if (fd[i] < 0 && errno == EACCES && !attr.exclude_kernel) {
+      // paranoid 2 refuses kernel counts for every type, user space only
+      // keeps the event open (context switches then read 0)
+      attr.exclude_kernel = 1;
+      fd[i] = perf_event_open(&attr, (n == 0) ? -1 : leader);
+    }
+    if (fd[i] < 0) {
+      if (n == 0) {
+        return false;
+      }
+      // this counter is not supported, count the others
+      continue;
+    }
+    if (n == 0) {
+      leader = fd[i];
+    }
+    order[num_open++] = i;
+  }
+
+  return true;
+}
+
+// see .h for more details
+bool PerfCounters::open() {
+
+  close();
+
+  if (!open_group(true)) {
+    close();
+    if (!open_group(false)) {
+      close();
+      return false;
+    }
+  }
+
+  ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return true;
+}
+
+// see .h for more details
+void PerfCounters::close() {
+
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+    if (fd[i] >= 0) {
+      ::close(fd[i]);
+    }
+    fd[i] = -1;
+    order[i] = -1;
+  }
+  num_open = 0;
+  leader = -1;
+}
+
+// see .h for more details
+unsigned int PerfCounters::get_available() {
+
+  unsigned int mask = 0;
+  for (int n = 0; n < num_open; n++) {
+    mask |= 1u << order[n];
+  }
+  return mask;
+}
+
+// see .h for more details
+bool PerfCounters::read(uint64_t values[PERF_NUM_COUNTERS]) {
+
+  // nr, time_enabled, time_running, value[nr]
+  uint64_t buf[3 + PERF_NUM_COUNTERS];
+
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+    values[i] = 0;
+  }
+  if (leader < 0 || ::read(leader, buf, sizeof(buf)) < (ssize_t)(3*sizeof(uint64_t))) {
+    return false;
+  }
+
+  uint64_t nr = buf[0], enabled = buf[1], running = buf[2];
+  double scale = (running > 0 && running < enabled)
+               ? (double)enabled / running : 1.0;
+
+  for (uint64_t n = 0; n < nr && n < (uint64_t)num_open; n++) {
+    values[order[n]] = (uint64_t)(buf[3+n] * scale);
+  }
+  return true;
+}
+
+/* @brief Registers the statistic, only call at static init (single thread)
+ */
+PerfStat::PerfStat(const char* stat_name) {
+
+  name = stat_name;
+  count = 0;
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+    sum[i] = 0;
+  }
+  next = perf_stats;
+  perf_stats = this;
+}
+
+// see .h for more details
+void PerfStat::add(const uint64_t delta[PERF_NUM_COUNTERS]) {
+
+  __atomic_add_fetch(&count, 1, __ATOMIC_RELAXED);
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+    __atomic_add_fetch(&sum[i], delta[i], __ATOMIC_RELAXED);
+  }
+}
+
+// see .h for more details
+void PerfStat::print() {
+
+  if (count > 0) {
+    perf_print(name, sum, count);
+  }
+}
+
+// see .h for more details
+void PerfStat::print_all() {
+
+  for (PerfStat* s = perf_stats; s != NULL; s = s->next) {
+    s->print();
+  }
+}
+
+PerfScope::PerfScope(PerfStat& s) : stat(s), pc(perf_counters) {
+
+  if (pc != NULL && !pc->read(start)) {
+    pc = NULL;
+  }
+}
+
+PerfScope::~PerfScope() {
+
+  uint64_t end[PERF_NUM_COUNTERS];
+
+  if (pc != NULL && pc->read(end)) {
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+      end[i] -= start[i];
+    }
+    stat.add(end);
+  }
+}
+
+// see .h for more details
+void perf_enable(bool enable) {
+
+  perf_enabled = enable;
+}
+
+// see .h for more details
+bool perf_is_enabled() {
+
+  return perf_enabled;
+}
+
+// see .h for more details
+PerfCounters* perf_thread_start() {
+
+  if (!perf_enabled || perf_counters != NULL) {
+    return perf_counters;
+  }
+
+  PerfCounters* pc = new PerfCounters();
+  if (!pc->open()) {
+    delete pc;
+    return NULL;
+  }
+
+  // the same counters open on every thread, remember them once
+  __sync_val_compare_and_swap(&perf_available, 0, pc->get_available());
+  perf_counters = pc;
+  return pc;
+}
+
+// see .h for more details
+void perf_thread_stop() {
+
+  delete perf_counters;
+  perf_counters = NULL;
+}
+
+// see .h for more details
+PerfCounters* perf_thread() {
+
+  return perf_counters;
+}
+
+// see .h for more details
+unsigned int perf_get_available() {
+
+  return perf_available;
+}
+
+// see .h for more details
+void perf_print(const char* label, const uint64_t sum[PERF_NUM_COUNTERS],
+                uint64_t calls) {
+
+  char line[512];
+  int len = 0;
+
+  if (calls == 0) {
+    return;
+  }
+
+  len += snprintf(line+len, sizeof(line)-len, "perf %-16s", label);
+  for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+    if (!(perf_available & (1u << i))) {
+      len += snprintf(line+len, sizeof(line)-len, " %s: n/a,", perf_names[i]);
+    } else if (i == PERF_TASK_CLOCK) {
+      len += snprintf(line+len, sizeof(line)-len, " %s: %.1f,",
+                      perf_names[i], sum[i]/1000.0/calls);
+    } else {
+      len += snprintf(line+len, sizeof(line)-len, " %s: %.1f,",
+                      perf_names[i], (double)sum[i]/calls);
+    }
+  }
+
+  // instructions per cycle, the quickest check of a kernel change
+  if ((perf_available & (1u << PERF_CYCLES))
+      && (perf_available & (1u << PERF_INSTRUCTIONS)) && sum[PERF_CYCLES]) {
+    snprintf(line+len, sizeof(line)-len, " IPC: %.2f,",
+             (double)sum[PERF_INSTRUCTIONS]/sum[PERF_CYCLES]);
+  }
+
+  len = strlen(line);
+  if (len > 0 && line[len-1] == ',') line[len-1] = '\0';
+  LOGP("%s (per call, %llu calls)\n", line, (unsigned long long)calls);
+}
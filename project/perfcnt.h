@@ -0,0 +1,141 @@
+/* ----------------------------------------------------------------------------
+ * @file perfcnt.h
+ * @brief Optional Linux perf_event counters around stages and threads
+ *
+ * Every thread that wants counts opens its own counter group with
+ * perf_thread_start(), which counts only the calling thread. The hardware
+ * group is led by the cycle counter and also holds instructions, cache
+ * misses and branch misses. Where no PMU is available (VMs, some kernels,
+ * perf_event_paranoid), a software-only group with task clock, context
+ * switches and page faults is used instead, and the hardware counters read
+ * as n/a. Multiplexed counts are scaled by the enabled/running times.
+ *
+ * Detector steps are measured with
+ *
+ *   PERF_STAT(gray_perf, "to_gray");   // at file scope
+ *   void f() { PERF_SCOPE(gray_perf); ... }
+ *   PERF_PRINT();                       // per-call averages, at exit
+ *
+ * A scope costs two read() syscalls on threads with counters, and a
+ * thread-local load on threads without. Nothing is counted unless
+ * perf_enable() was called.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef PERFCNT_H
+#define PERFCNT_H
+
+#include <stdint.h>
+
+enum {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_CTX_SWITCHES,
+  PERF_PAGE_FAULTS,
+  PERF_TASK_CLOCK,      // nsec on the CPU
+  PERF_NUM_COUNTERS
+};
+
+/* @brief A counter group of one thread
+ */
+class PerfCounters {
+
+private:
+
+  int fd[PERF_NUM_COUNTERS];
+  int order[PERF_NUM_COUNTERS];   // counter of each value in a group read
+  int num_open;
+  int leader;
+
+  bool open_group(bool hardware);
+
+public:
+
+  PerfCounters();
+  ~PerfCounters();
+
+  // opens the counters of the calling thread, false if none is available
+  bool open();
+  void close();
+
+  // bit i set if counter i is counted
+  unsigned int get_available();
+
+  // current totals, scaled for multiplexing, 0 for unavailable counters
+  bool read(uint64_t values[PERF_NUM_COUNTERS]);
+};
+
+/* @brief Counter sums of a named scope, safe to update from any thread
+ */
+class PerfStat {
+
+private:
+
+  const char* name;
+  uint64_t count;
+  uint64_t sum[PERF_NUM_COUNTERS];
+  PerfStat* next;   // all statistics, registered at static init
+
+public:
+
+  PerfStat(const char* stat_name);
+
+  void add(const uint64_t delta[PERF_NUM_COUNTERS]);
+  void print();
+
+  // prints every statistic with samples
+  static void print_all();
+};
+
+/* @brief Adds the counts of its scope to a statistic, if the calling
+ *        thread has counters
+ */
+class PerfScope {
+
+private:
+
+  PerfStat& stat;
+  PerfCounters* pc;
+  uint64_t start[PERF_NUM_COUNTERS];
+
+public:
+
+  PerfScope(PerfStat& s);
+  ~PerfScope();
+};
+
+// enables counting for threads calling perf_thread_start() afterwards
+void perf_enable(bool enable);
+bool perf_is_enabled();
+
+// opens the counters of the calling thread if enabled, NULL otherwise
+PerfCounters* perf_thread_start();
+void perf_thread_stop();
+
+// the counters of the calling thread, NULL if it has none
+PerfCounters* perf_thread();
+
+// counters available on the first thread that opened them
+unsigned int perf_get_available();
+
+/* @brief Prints counter sums as per-call averages
+ *
+ * @param label, printed in front
+ * @param sum, the counter sums
+ * @param calls, number of calls (e.g. frames) to average over
+ */
+void perf_print(const char* label, const uint64_t sum[PERF_NUM_COUNTERS],
+                uint64_t calls);
+
+#define PERF_STAT(var, name) static PerfStat var(name)
+#define PERF_SCOPE(var) PerfScope PERF_CONCAT(perf_scope_, __LINE__)(var)
+#define PERF_PRINT() PerfStat::print_all()
+
+#define PERF_CONCAT2(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT2(a, b)
+
+#endif // PERFCNT_H
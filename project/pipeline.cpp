@@ -0,0 +1,725 @@
+/* ----------------------------------------------------------------------------
+ * @file pipeline.cpp
+ * @brief A small stage-graph runtime, see pipeline.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <map>
+
+#include "log.h"
+#include "timing.h"
+#include "deadline.h"
+#include "rtmem.h"
+#include "pipeline.h"
+
+// sleep of a thread that found nothing to do in any of its nodes
+#define PIPELINE_POLL_USEC (100)
+
+// see .h for more details
+bool pipeline_parse_node(const String& spec, node_desc_t& desc) {
+
+  size_t end = spec.find_first_of("*:@");
+  desc.name = spec.substr(0, end);
+  desc.replicas = 1;
+  desc.depth = PIPELINE_DEFAULT_DEPTH;
+  desc.group = -1;
+
+  if (desc.name.empty()) {
+    return false;
+  }
+
+  while (end != String::npos) {
+
+    char key = spec[end];
+    size_t next = spec.find_first_of("*:@", end+1);
+    String value = spec.substr(end+1,
+                               (next == String::npos) ? String::npos : next-end-1);
+    char* stop;
+    long v = strtol(value.c_str(), &stop, 10);
+    if (value.empty() || *stop != '\0' || v < 0) {
+      return false;
+    }
+
+    switch (key) {
+      case '*': desc.replicas = (int)v; break;
+      case ':': desc.depth = (int)v; break;
+      case '@': desc.group = (int)v; break;
+    }
+    end = next;
+  }
+
+  return (desc.replicas >= 1 && desc.depth >= 1);
+}
+
+Pipeline::Pipeline() {
+
+  stop = NULL;
+  recycle_next = 0;
+  frames_allocated = 0;
+  source_seq = 0;
+  start_time = end_time = 0.0;
+  running = false;
+}
+
+Pipeline::~Pipeline() {
+
+  if (running) {
+    join();
+  }
+
+  for (size_t n = 0; n < in.size(); n++) {
+    for (size_t a = 0; a < in[n].size(); a++) {
+      for (size_t b = 0; b < in[n][a].size(); b++) {
+        // end-of-stream markers no consumer needed, or frames left after
+        // a failed start
+        item_t* item;
+        while (in[n][a][b]->buf->Get(item)) {
+          delete item;
+        }
+        delete in[n][a][b]->buf;
+        delete in[n][a][b];
+      }
+    }
+  }
+
+  for (size_t n = 0; n < tasks.size(); n++) {
+    for (size_t r = 0; r < tasks[n].size(); r++) {
+      for (size_t i = 0; i < tasks[n][r]->pending.size(); i++) {
+        delete tasks[n][r]->pending[i];
+      }
+      delete tasks[n][r]->stage;
+      delete tasks[n][r];
+    }
+  }
+
+  for (size_t w = 0; w < workers.size(); w++) {
+    delete workers[w];
+  }
+
+  for (size_t r = 0; r < recycled.size(); r++) {
+    item_t* item;
+    while (recycled[r]->Get(item)) {
+      delete item;
+    }
+    delete recycled[r];
+  }
+}
+
+// see .h for more details
+bool Pipeline::add_node(const node_desc_t& desc) {
+
+  if (running) {
+    return false;
+  }
+  if (desc.factory == NULL || desc.replicas < 1 || desc.depth < 1) {
+    fprintf(stderr, "pipeline: bad node %s\n", desc.name.c_str());
+    return false;
+  }
+  if (desc.replicas > PIPELINE_MAX_REPLICAS) {
+    fprintf(stderr, "pipeline: node %s, at most %i replicas\n",
+            desc.name.c_str(), PIPELINE_MAX_REPLICAS);
+    return false;
+  }
+  if (nodes.empty() && desc.replicas > 1) {
+    fprintf(stderr, "pipeline: the source node %s cannot be replicated\n",
+            desc.name.c_str());
+    return false;
+  }
+  if (desc.stateful && desc.replicas > 1) {
+    fprintf(stderr, "pipeline: node %s depends on the frame order and "
+                    "cannot be replicated\n", desc.name.c_str());
+    return false;
+  }
+
+  nodes.push_back(desc);
+  return true;
+}
+
+// see .h for more details
+int Pipeline::prealloc_frames(void (*init)(frame_t& frame, void* arg),
+                              void* arg) {
+
+  if (running || nodes.empty() || !recycled.empty()) {
+    return 0;
+  }
+
+  int frames = get_max_in_flight();
+
+  int last = nodes.back().replicas;
+  for (int r = 0; r < last; r++) {
+    recycled.push_back(new RingBuffer<item_t*>(frames + 1));
+  }
+  for (int i = 0; i < frames; i++) {
+    item_t* item = new item_t;
+    init(item->frame, arg);
+    recycled[i % last]->Put(item);
+  }
+  return frames;
+}
+
+// see .h for more details
+int Pipeline::get_max_in_flight() {
+
+  // every queue full, plus one frame in every replica (in process or 
+  // waiting for queue space) and one the source is about to read into
+  int frames = 1;
+  for (size_t n = 0; n < nodes.size(); n++) {
+    frames += nodes[n].replicas;
+    if (n > 0) {
+      frames += nodes[n-1].replicas * nodes[n].replicas * nodes[n].depth;
+    }
+  }
+  return frames;
+}
+
+// see .h for more details
+bool Pipeline::start(volatile int* stop_flag) {
+
+  if (running || nodes.empty()) {
+    return false;
+  }
+  stop = stop_flag;
+
+  //
+  // one task (and Stage instance) per replica
+  //
+  tasks.resize(nodes.size());
+  for (size_t n = 0; n < nodes.size(); n++) {
+    for (int r = 0; r < nodes[n].replicas; r++) {
+      task_t* t = new task_t;
+      t->node = n;
+      t->replica = r;
+      t->stage = nodes[n].factory(r, nodes[n].arg);
+      t->next_seq = r;
+      t->done = false;
+      t->received = t->frames = t->dropped = 0;
+      t->busy_ns = t->busy_max_ns = t->busy_cpu_ns = 0;
+      for (int i = 0; i < PERF_NUM_COUNTERS; i++) t->perf[i] = 0;
+      tasks[n].push_back(t);
+      if (t->stage == NULL) {
+        fprintf(stderr, "pipeline: cannot create node %s\n",
+                nodes[n].name.c_str());
+        return false;
+      }
+    }
+  }
+
+  //
+  // a queue between every replica pair of neighbouring nodes
+  //
+  in.resize(nodes.size());
+  for (size_t n = 1; n < nodes.size(); n++) {
+    in[n].resize(nodes[n-1].replicas);
+    for (int a = 0; a < nodes[n-1].replicas; a++) {
+      for (int b = 0; b < nodes[n].replicas; b++) {
+        queue_t* q = new queue_t;
+        q->buf = new RingBuffer<item_t*>(nodes[n].depth + 1);
+        q->puts = q->occupancy_sum = q->occupancy_max = q->full = 0;
+        in[n][a].push_back(q);
+      }
+    }
+  }
+
+  //
+  // threads: replicas and ungrouped nodes get their own, groups share one
+  //
+  std::map<int, worker_t*> groups;
+  for (size_t n = 0; n < nodes.size(); n++) {
+    for (int r = 0; r < nodes[n].replicas; r++) {
+
+      worker_t* w = NULL;
+      bool shared = nodes[n].group >= 0 && nodes[n].replicas == 1;
+      if (shared && groups.count(nodes[n].group)) {
+        w = groups[nodes[n].group];
+      } else {
+        w = new worker_t;
+        w->pipeline = this;
+        w->wall_ns = w->cpu_ns = 0;
+        for (int i = 0; i < PERF_NUM_COUNTERS; i++) w->perf[i] = 0;
+        workers.push_back(w);
+        if (shared) {
+          groups[nodes[n].group] = w;
+        }
+      }
+      w->tasks.push_back(tasks[n][r]);
+    }
+  }
+
+  start_time = get_time_msec();
+  running = true;
+
+  for (size_t w = 0; w < workers.size(); w++) {
+    if (pthread_create(&workers[w]->thread, NULL, worker_main, workers[w]) != 0) {
+      perror("pipeline pthread_create");
+      // the source will not run without its thread, stop what was started
+      *stop = 1;
+      for (size_t i = 0; i < w; i++) {
+        pthread_join(workers[i]->thread, NULL);
+      }
+      running = false;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// see .h for more details
+void Pipeline::join() {
+
+  if (!running) {
+    return;
+  }
+  for (size_t w = 0; w < workers.size(); w++) {
+    pthread_join(workers[w]->thread, NULL);
+  }
+  end_time = get_time_msec();
+  running = false;
+}
+
+/* @brief Samples the occupancy of a queue after a Put()
+ */
+void Pipeline::queue_sampled(queue_t* q) {
+
+  size_t count = q->buf->Count();
+  metric_add(&q->puts, 1);
+  q->occupancy_sum += count;
+  if (count > q->occupancy_max) metric_set(&q->occupancy_max, count);
+}
+
+/* @brief Hands an item to replica 'to' of the next node, or parks it until
+ *        that queue has space
+ */
+void Pipeline::emit(task_t* task, item_t* item, int to) {
+
+  queue_t* q = in[task->node+1][task->replica][to];
+
+  if (task->pending.empty()) {
+    if (q->buf->Put(item)) {
+      queue_sampled(q);
+      return;
+    }
+    metric_add(&q->full, 1);
+  }
+
+  // queued behind earlier parked outputs to keep the order
+  task->pending.push_back(item);
+  task->pending_to.push_back(to);
+}
+
+/* @brief Retries the parked outputs of a task, in order
+ *
+ * @return true once nothing is parked anymore
+ */
+bool Pipeline::flush(task_t* task) {
+
+  while (!task->pending.empty()) {
+
+    queue_t* q = in[task->node+1][task->replica][task->pending_to.front()];
+    if (!q->buf->Put(task->pending.front())) {
+      return false;
+    }
+
+    queue_sampled(q);
+
+    task->pending.erase(task->pending.begin());
+    task->pending_to.erase(task->pending_to.begin());
+  }
+
+  return true;
+}
+
+/* @brief Moves one frame through one replica of a node, never blocks
+ *
+ * @return true if any progress was made
+ */
+bool Pipeline::step(task_t* task) {
+
+  int n = task->node;
+  bool last = (n+1 == (int)nodes.size());
+  item_t* item = NULL;
+
+  if (!flush(task) || task->done) {
+    return false;
+  }
+
+  if (n == 0) {
+
+    item = new_item();
+    item->seq = source_seq++;
+    item->dropped = false;
+    item->eos = (*stop != 0);
+
+  } else {
+
+    // the producer replica of the frame this replica expects next
+    queue_t* q = in[n][task->next_seq % nodes[n-1].replicas][task->replica];
+    if (!q->buf->Get(item)) {
+      return false;
+    }
+    if (!item->eos) {
+      task->next_seq += nodes[n].replicas;
+      metric_add(&task->received, 1);
+    }
+  }
+
+  if (!item->eos && !item->dropped) {
+
+    PerfCounters* pc = perf_thread();
+    uint64_t perf_start[PERF_NUM_COUNTERS], perf_end[PERF_NUM_COUNTERS];
+    if (pc != NULL) pc->read(perf_start);
+
+    // the source sets the frame id itself, see deadline.h
+    deadline_set_frame(item->frame.id);
+
+    uint64_t start = time_now_ns();
+    uint64_t cpu_start = time_thread_cpu_ns();
+    bool ok = task->stage->process(item->frame);
+    uint64_t busy = time_now_ns() - start;
+
+    if (pc != NULL && pc->read(perf_end)) {
+      for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        task->perf[i] += perf_end[i] - perf_start[i];
+      }
+    }
+
+    if (!ok && n == 0) {
+      item->eos = true;
+    } else {
+      metric_add(&task->frames, 1);
+      metric_add(&task->busy_ns, busy);
+      task->busy_cpu_ns += time_thread_cpu_ns() - cpu_start;
+      if (busy > task->busy_max_ns) task->busy_max_ns = busy;
+      item->dropped = !ok;
+      if (!ok) {
+        metric_add(&task->dropped, 1);
+      }
+    }
+  }
+
+  if (item->eos) {
+
+    task->done = true;
+    task->stage->finish();
+
+    if (last) {
+      free_item(task, item);
+    } else {
+      // every replica of the next node waits for its own marker
+      for (int to = 0; to < nodes[n+1].replicas; to++) {
+        item_t* marker = item;
+        if (to > 0) {
+          marker = new item_t;
+          marker->seq = item->seq;
+          marker->dropped = false;
+          marker->eos = true;
+        }
+        emit(task, marker, to);
+      }
+    }
+    return true;
+  }
+
+  if (last) {
+    free_item(task, item);
+  } else {
+    emit(task, item, item->seq % nodes[n+1].replicas);
+  }
+
+  return true;
+}
+
+/* @brief A frame for the source, a recycled one if there is one
+ */
+Pipeline::item_t* Pipeline::new_item() {
+
+  item_t* item;
+  for (size_t i = 0; i < recycled.size(); i++) {
+    size_t r = (recycle_next + i) % recycled.size();
+    if (recycled[r]->Get(item)) {
+      recycle_next = r + 1;
+      return item;
+    }
+  }
+  frames_allocated++;
+  return new item_t;
+}
+
+/* @brief Hands a frame that left the last node back to the source, or 
+ *        frees it without recycling (and for the extra end-of-stream markers)
+ */
+void Pipeline::free_item(task_t* task, item_t* item) {
+
+  if (recycled.empty() || !recycled[task->replica]->Put(item)) {
+    delete item;
+  }
+}
+
+/* @brief Runs the tasks of one thread round-robin until all have seen the
+ *        end of stream
+ */
+void* Pipeline::worker_main(void* param) {
+
+  worker_t* w = (worker_t*) param;
+  struct timespec poll_time = {0, PIPELINE_POLL_USEC*USEC_TO_NSEC};
+  uint64_t wall_start = time_now_ns();
+  uint64_t cpu_start = time_thread_cpu_ns();
+  PerfCounters* pc = perf_thread_start();
+  rtmem_thread_start();
+
+  while (true) {
+
+    bool progress = false, finished = true;
+
+    for (size_t i = 0; i < w->tasks.size(); i++) {
+      if (w->pipeline->step(w->tasks[i])) {
+        progress = true;
+      }
+      if (!w->tasks[i]->done || !w->tasks[i]->pending.empty()) {
+        finished = false;
+      }
+    }
+
+    if (finished) {
+      break;
+    }
+    if (!progress) {
+      nanosleep(&poll_time, NULL);
+    }
+  }
+
+  w->wall_ns = time_now_ns() - wall_start;
+  w->cpu_ns = time_thread_cpu_ns() - cpu_start;
+  if (pc != NULL) {
+    pc->read(w->perf);
+    perf_thread_stop();
+  }
+
+  return nullptr;
+}
+
+// see .h for more details
+void Pipeline::print_stats() {
+
+  double wall = ((end_time > 0.0) ? end_time : get_time_msec()) - start_time;
+
+  LOGP("pipeline, %lu node(s) on %lu thread(s), msec total: %6.2f\n",
+       (unsigned long)nodes.size(), (unsigned long)workers.size(), wall);
+  if (!recycled.empty()) {
+    LOGP("pipeline, recycled frames, frames allocated past the pool: %lu\n",
+         frames_allocated);
+  }
+
+  for (size_t n = 0; n < nodes.size(); n++) {
+
+    unsigned long frames = 0;
+    uint64_t busy = 0, busy_cpu = 0, busy_max = 0;
+    for (size_t r = 0; r < tasks[n].size(); r++) {
+      frames += tasks[n][r]->frames;
+      busy += tasks[n][r]->busy_ns;
+      busy_cpu += tasks[n][r]->busy_cpu_ns;
+      if (tasks[n][r]->busy_max_ns > busy_max) busy_max = tasks[n][r]->busy_max_ns;
+    }
+
+    // utilization of the replicas, near 100% marks the bottleneck. CPU time
+    // well below the wall time means the stage was preempted or blocked.
+    LOGP("node %-10s x%i, frames: %lu, FPS: %6.2f, avg msec: %6.2f, "
+         "avg cpu msec: %6.2f, max msec: %6.2f, busy: %5.1f%%\n",
+         nodes[n].name.c_str(), nodes[n].replicas, frames,
+         (wall > 0.0) ? frames*1000/wall : 0.0,
+         frames ? busy/1e6/frames : 0.0, frames ? busy_cpu/1e6/frames : 0.0,
+         busy_max/1e6,
+         (wall > 0.0) ? 100.0*busy/1e6/(wall*nodes[n].replicas) : 0.0);
+
+    if (n == 0) continue;
+
+    unsigned long puts = 0, sum = 0, max = 0, full = 0;
+    for (size_t a = 0; a < in[n].size(); a++) {
+      for (size_t b = 0; b < in[n][a].size(); b++) {
+        puts += in[n][a][b]->puts;
+        sum += in[n][a][b]->occupancy_sum;
+        full += in[n][a][b]->full;
+        if (in[n][a][b]->occupancy_max > max) max = in[n][a][b]->occupancy_max;
+      }
+    }
+
+    // a queue that is often full points at a slow consumer, an empty one
+    // at a slow producer
+    LOGP("  edge %s -> %s, depth: %i, avg occupancy: %5.2f, max: %lu, "
+         "full: %lu\n",
+         nodes[n-1].name.c_str(), nodes[n].name.c_str(), nodes[n].depth,
+         puts ? (double)sum/puts : 0.0, max, full);
+  }
+
+  //
+  // per thread: CPU time outside of the stages is queue polling and
+  // spinning, wall time not spent on the CPU is sleeping, blocking or
+  // preemption
+  //
+  for (size_t w = 0; w < workers.size(); w++) {
+
+    String names;
+    uint64_t stage_cpu = 0;
+    for (size_t i = 0; i < workers[w]->tasks.size(); i++) {
+      task_t* t = workers[w]->tasks[i];
+      if (i > 0) names += ",";
+      names += nodes[t->node].name;
+      stage_cpu += t->busy_cpu_ns;
+    }
+
+    double wall_ms = workers[w]->wall_ns/1e6;
+    double cpu_ms = workers[w]->cpu_ns/1e6;
+    double stage_ms = stage_cpu/1e6;
+
+    LOGP("thread %lu [%s], wall msec: %9.2f, cpu msec: %9.2f (%5.1f%%), "
+         "in stages: %9.2f, polling: %9.2f\n",
+         (unsigned long)w, names.c_str(), wall_ms, cpu_ms,
+         (wall_ms > 0.0) ? 100.0*cpu_ms/wall_ms : 0.0,
+         stage_ms, (cpu_ms > stage_ms) ? cpu_ms - stage_ms : 0.0);
+  }
+
+  if (!perf_is_enabled()) {
+    return;
+  }
+
+  // per frame of the stream
+  unsigned long frames = tasks.empty() ? 0 : tasks[0][0]->frames;
+  char label[64];
+
+  for (size_t n = 0; n < nodes.size(); n++) {
+    uint64_t sum[PERF_NUM_COUNTERS] = {0};
+    for (size_t r = 0; r < tasks[n].size(); r++) {
+      for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        sum[i] += tasks[n][r]->perf[i];
+      }
+    }
+    snprintf(label, sizeof(label), "node %s", nodes[n].name.c_str());
+    perf_print(label, sum, frames);
+  }
+
+  for (size_t w = 0; w < workers.size(); w++) {
+    snprintf(label, sizeof(label), "thread %lu", (unsigned long)w);
+    perf_print(label, workers[w]->perf, frames);
+  }
+}
+
+// see .h for more details
+void Pipeline::collect_metrics(MetricsText& out) {
+
+  if (tasks.size() != nodes.size()) {
+    return;
+  }
+
+  // sums over the replicas of each node, read once
+  size_t num = nodes.size();
+  std::vector<unsigned long> in_frames(num, 0), out_frames(num, 0);
+  std::vector<unsigned long> dropped(num, 0);
+  std::vector<uint64_t> busy(num, 0);
+
+  for (size_t n = 0; n < num; n++) {
+    for (size_t r = 0; r < tasks[n].size(); r++) {
+      const task_t* t = tasks[n][r];
+      unsigned long frames = metric_load(&t->frames);
+      unsigned long drops = metric_load(&t->dropped);
+      in_frames[n] += (n == 0) ? frames : metric_load(&t->received);
+      out_frames[n] += frames - drops;
+      dropped[n] += drops;
+      busy[n] += metric_load(&t->busy_ns);
+    }
+  }
+
+  char labels[128];
+
+  out.family("emvia_node_frames_in_total", "counter",
+             "Frames taken by a node, dropped ones included.");
+  for (size_t n = 0; n < num; n++) {
+    snprintf(labels, sizeof(labels), "node=\"%s\"", nodes[n].name.c_str());
+    out.count("emvia_node_frames_in_total", labels, in_frames[n]);
+  }
+  out.family("emvia_node_frames_out_total", "counter",
+             "Frames a node processed and passed on.");
+  for (size_t n = 0; n < num; n++) {
+    snprintf(labels, sizeof(labels), "node=\"%s\"", nodes[n].name.c_str());
+    out.count("emvia_node_frames_out_total", labels, out_frames[n]);
+  }
+  out.family("emvia_node_frames_dropped_total", "counter",
+             "Frames a node dropped.");
+  for (size_t n = 0; n < num; n++) {
+    snprintf(labels, sizeof(labels), "node=\"%s\"", nodes[n].name.c_str());
+    out.count("emvia_node_frames_dropped_total", labels, dropped[n]);
+  }
+  out.family("emvia_node_busy_seconds_total", "counter",
+             "Wall time a node spent processing, summed over its replicas.");
+  for (size_t n = 0; n < num; n++) {
+    snprintf(labels, sizeof(labels), "node=\"%s\"", nodes[n].name.c_str());
+    out.sample("emvia_node_busy_seconds_total", labels, busy[n]/1e9);
+  }
+
+  if (in.size() != num) {
+    return;
+  }
+
+  //
+  // per edge, over the queues between all replica pairs
+  //
+  out.family("emvia_queue_depth", "gauge",
+             "Frames waiting in the input queues of a node.");
+  for (size_t n = 1; n < num; n++) {
+    size_t depth = 0;
+    for (size_t a = 0; a < in[n].size(); a++) {
+      for (size_t b = 0; b < in[n][a].size(); b++) {
+        depth += in[n][a][b]->buf->Count();
+      }
+    }
+    snprintf(labels, sizeof(labels), "from=\"%s\",to=\"%s\"",
+             nodes[n-1].name.c_str(), nodes[n].name.c_str());
+    out.count("emvia_queue_depth", labels, depth);
+  }
+  out.family("emvia_queue_capacity", "gauge",
+             "Capacity of the input queues of a node.");
+  for (size_t n = 1; n < num; n++) {
+    snprintf(labels, sizeof(labels), "from=\"%s\",to=\"%s\"",
+             nodes[n-1].name.c_str(), nodes[n].name.c_str());
+    out.count("emvia_queue_capacity", labels,
+              (unsigned long)nodes[n-1].replicas * nodes[n].replicas
+              * nodes[n].depth);
+  }
+  out.family("emvia_queue_depth_max", "gauge",
+             "Highest occupancy of one input queue of a node after a put.");
+  for (size_t n = 1; n < num; n++) {
+    unsigned long max = 0;
+    for (size_t a = 0; a < in[n].size(); a++) {
+      for (size_t b = 0; b < in[n][a].size(); b++) {
+        unsigned long m = metric_load(&in[n][a][b]->occupancy_max);
+        if (m > max) max = m;
+      }
+    }
+    snprintf(labels, sizeof(labels), "from=\"%s\",to=\"%s\"",
+             nodes[n-1].name.c_str(), nodes[n].name.c_str());
+    out.count("emvia_queue_depth_max", labels, max);
+  }
+  out.family("emvia_queue_full_total", "counter",
+             "Puts into the input queues of a node that found them full.");
+  for (size_t n = 1; n < num; n++) {
+    unsigned long full = 0;
+    for (size_t a = 0; a < in[n].size(); a++) {
+      for (size_t b = 0; b < in[n][a].size(); b++) {
+        full += metric_load(&in[n][a][b]->full);
+      }
+    }
+    snprintf(labels, sizeof(labels), "from=\"%s\",to=\"%s\"",
+             nodes[n-1].name.c_str(), nodes[n].name.c_str());
+    out.count("emvia_queue_full_total", labels, full);
+  }
+}
+
+// see .h for more details
+void Pipeline::metrics_collector(MetricsText& out, void* arg) {
+
+  ((Pipeline*) arg)->collect_metrics(out);
+}
@@ -0,0 +1,199 @@
+/* ----------------------------------------------------------------------------
+ * @file pipeline.h
+ * @brief A small stage-graph runtime: a chain of stage nodes connected by
+ *        bounded lock-free SPSC queues
+ *
+ * Each node runs one Stage on its own thread, or shares a thread with other
+ * nodes of the same group. A node can be replicated over several threads,
+ * each replica with its own Stage instance: frames are dealt round-robin by
+ * sequence number, and since replica k of a node only ever exchanges frames
+ * with replica j of the next node through its own queue, every queue stays
+ * single-producer/single-consumer and frames leave every node in capture
+ * order without a reorder buffer.
+ *
+ * The first node is the source. When its Stage::process() returns false the
+ * stream ends, and an end-of-stream marker drains the whole chain, so every
+ * frame already captured is still processed and written.
+ *
+ * A node is configured by a spec string
+ *
+ *   name[*replicas][:depth][@group]
+ *
+ *   replicas  threads running this node, 1 by default
+ *   depth     capacity of each input queue of this node, 16 by default
+ *   group     nodes with the same group number share one thread, replicated
+ *             nodes always get their own threads
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "frame.h"
+#include "ringbuf.h"
+#include "perfcnt.h"
+#include "metrics.h"
+
+using namespace cv;
+
+#define PIPELINE_DEFAULT_DEPTH (16)
+#define PIPELINE_MAX_REPLICAS  (16)
+
+/* @brief One processing step, called with every frame in order
+ */
+class Stage {
+
+public:
+
+  virtual ~Stage() {}
+
+  // processes the frame in place, false drops the frame (for the source
+  // node: ends the stream). Called only from the thread running the node.
+  virtual bool process(frame_t& frame) = 0;
+
+  // called once on the node's thread after the end of stream
+  virtual void finish() {}
+};
+
+// creates the Stage of one replica of a node, NULL on failure
+typedef Stage* (*stage_factory_t)(int replica, void* arg);
+
+/* @brief Description of one node of the chain
+ */
+typedef struct {
+  String name;
+  stage_factory_t factory;
+  void* arg;            // passed to the factory
+  int replicas;
+  int depth;            // input queue capacity of each replica
+  int group;            // -1 for a dedicated thread
+  bool stateful;        // depends on the frame order, cannot be replicated
+} node_desc_t;
+
+/* @brief Parses a node spec "name[*replicas][:depth][@group]"
+ *
+ * @param spec, the spec string
+ * @param desc, name, replicas, depth and group are set, the rest untouched
+ * @return false on a malformed spec
+ */
+bool pipeline_parse_node(const String& spec, node_desc_t& desc);
+
+/* @brief The runtime
+ */
+class Pipeline {
+
+private:
+
+  // a frame on its way through the chain
+  typedef struct {
+    frame_t frame;
+    uint64_t seq;       // position in the stream
+    bool dropped;       // skipped by the remaining nodes
+    bool eos;           // end-of-stream marker, carries no frame
+  } item_t;
+
+  // a queue with its producer side statistics, sampled at every Put().
+  // puts, occupancy_max and full are read live, see collect_metrics()
+  typedef struct {
+    RingBuffer<item_t*>* buf;
+    unsigned long puts;
+    unsigned long occupancy_sum;
+    unsigned long occupancy_max;
+    unsigned long full;   // Put() attempts that found the queue full
+  } queue_t;
+
+  // one replica of a node
+  typedef struct {
+    int node;
+    int replica;
+    Stage* stage;
+    uint64_t next_seq;    // next sequence number this replica expects
+    std::vector<item_t*> pending;   // outputs waiting for queue space
+    std::vector<int> pending_to;    // their target replicas
+    bool done;
+    unsigned long received;         // frames taken from the queues, the
+                                    // dropped ones included (not the source)
+    unsigned long frames;           // frames processed
+    unsigned long dropped;          // of them, dropped by the stage
+    uint64_t busy_ns, busy_max_ns;  // wall time in Stage::process()
+    uint64_t busy_cpu_ns;           // thread CPU time in Stage::process()
+    uint64_t perf[PERF_NUM_COUNTERS];   // counts in Stage::process()
+  } task_t;
+
+  // one thread running one or more tasks
+  typedef struct {
+    Pipeline* pipeline;
+    std::vector<task_t*> tasks;
+    pthread_t thread;
+    uint64_t wall_ns, cpu_ns;   // lifetime of the thread
+    uint64_t perf[PERF_NUM_COUNTERS];
+  } worker_t;
+
+  std::vector<node_desc_t> nodes;
+  std::vector<std::vector<task_t*> > tasks;   // [node][replica]
+
+  // in[n][a][b]: from replica a of node n-1 to replica b of node n
+  std::vector<std::vector<std::vector<queue_t*> > > in;
+
+  std::vector<worker_t*> workers;
+
+  // frames back from the last node to the source, one ring per replica of
+  // the last node, see prealloc_frames()
+  std::vector<RingBuffer<item_t*>*> recycled;
+  size_t recycle_next;
+  unsigned long frames_allocated;
+
+  volatile int* stop;
+  uint64_t source_seq;
+  double start_time, end_time;
+  bool running;
+
+  bool step(task_t* task);
+  item_t* new_item();
+  void free_item(task_t* task, item_t* item);
+  bool flush(task_t* task);
+  void queue_sampled(queue_t* q);
+  void emit(task_t* task, item_t* item, int to);
+  static void* worker_main(void* param);
+
+public:
+
+  Pipeline();
+  ~Pipeline();
+
+  // appends a node to the chain, before start()
+  bool add_node(const node_desc_t& desc);
+
+  // frames leaving the last node are reused by the source, with their
+  // buffers, instead of freed. Allocates as many frames as can be in 
+  // flight, each set up once by init(frame, arg). After the add_node() 
+  // calls, before start(), returns the number of frames.
+  int prealloc_frames(void (*init)(frame_t& frame, void* arg), void* arg);
+
+  // the most frames that can be in flight at once, after add_node()
+  int get_max_in_flight();
+
+  // creates the stages and threads, the source stops once *stop_flag is set
+  bool start(volatile int* stop_flag);
+
+  // waits until the end of stream has drained through every node
+  void join();
+
+  // per-node throughput and busy time, per-edge queue occupancy, and 
+  // per-thread wall versus CPU time (and perf counters if enabled)
+  void print_stats();
+
+  // per-node frames in/out/dropped and busy time, per-edge queue depth,
+  // while running, from the metrics exporter thread. After start().
+  void collect_metrics(MetricsText& out);
+  static void metrics_collector(MetricsText& out, void* arg);
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,289 @@
+/* ----------------------------------------------------------------------------
+ * @file preview.cpp
+ * @brief Embedded MJPEG-over-HTTP preview of the annotated frames
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "preview.h"
+#include "net.h"
+#include "log.h"
+
+#define BOUNDARY "emviaframe"
+#define SEND_TIMEOUT_MS (200)
+
+static const char index_html[] =
+  "HTTP/1.0 200 OK\r\n"
+  "Content-Type: text/html\r\n"
+  "Cache-Control: no-cache\r\n\r\n"
+  "<html><body style=\"background:#222;color:#ddd;font-family:monospace\">"
+  "<img src=\"/stream.mjpg\"><pre id=\"s\"></pre><script>"
+  "setInterval(function(){fetch('/state.json').then(r=>r.text())"
+  ".then(t=>{document.getElementById('s').textContent=t;});},500);"
+  "</script></body></html>";
+
+static const char stream_head[] =
+  "HTTP/1.0 200 OK\r\n"
+  "Cache-Control: no-cache\r\n"
+  "Connection: close\r\n"
+  "Content-Type: multipart/x-mixed-replace; boundary=" BOUNDARY "\r\n\r\n";
+
+static const char not_found[] =
+  "HTTP/1.0 404 Not Found\r\n"
+  "Content-Type: text/plain\r\n\r\n"
+  "not found\n";
+
+/* @brief The default preview server constructor, does not start anything
+ */
+PreviewServer::PreviewServer() {
+
+  running = false;
+  listen_fd = -1;
+  num_clients = 0;
+  have_state = false;
+  last_state = lane_state_t();
+  frames_encoded = 0;
+  encode_elapsed = 0.0;
+  pthread_mutex_init(&state_lock, NULL);
+}
+
+PreviewServer::~PreviewServer() {
+
+  stop();
+  pthread_mutex_destroy(&state_lock);
+}
+
+/* @brief Binds the listening socket and starts the preview thread
+ *
+ * @param config, the preview settings
+ * @return true if the server is running
+ */
+bool PreviewServer::start(const preview_config_t& config) {
+
+  cfg = config;
+  if (cfg.fps <= 0.0) cfg.fps = 5.0;
+  if (cfg.scale <= 0.0 || cfg.scale > 1.0) cfg.scale = 1.0;
+
+  jpeg_params.clear();
+  jpeg_params.push_back(IMWRITE_JPEG_QUALITY);
+  jpeg_params.push_back(cfg.quality);
+
+  listen_fd = net_tcp_listen(cfg.addr.c_str(), cfg.port);
+  if (listen_fd < 0) {
+    return false;
+  }
+
+  running = true;
+  if (pthread_create(&thread, NULL, thread_entry, this) != 0) {
+    perror("preview pthread_create");
+    running = false;
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+
+  LOGP("preview: http://%s:%i/\n", cfg.addr.c_str(), cfg.port);
+  return true;
+}
+
+/* @brief Stops the preview thread and closes all sockets
+ */
+void PreviewServer::stop() {
+
+  if (!running) return;
+
+  running = false;
+  pthread_join(thread, NULL);
+
+  while (num_clients > 0) {
+    drop_client(num_clients-1);
+  }
+  close(listen_fd);
+  listen_fd = -1;
+}
+
+/* @brief Hands the latest annotated frame to the preview
+ *
+ * The Mat is shared, not copied, so the caller must not draw into it again.
+ */
+void PreviewServer::post(const Mat& annotated, const lane_state_t& state) {
+
+  preview_frame_t frame;
+  frame.annot = annotated;
+  frame.state = state;
+  box.Post(frame);
+
+  pthread_mutex_lock(&state_lock);
+  last_state = state;
+  have_state = true;
+  pthread_mutex_unlock(&state_lock);
+}
+
+void *PreviewServer::thread_entry(void *param) {
+
+  PreviewServer *server = (PreviewServer*) param;
+
+  // the preview must only use otherwise idle CPU
+  struct sched_param sp;
+  sp.sched_priority = 0;
+  if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp) != 0) {
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+  }
+
+  server->run();
+  return nullptr;
+}
+
+/* @brief The preview thread loop: serves requests, and at most cfg.fps times
+ *        per second encodes the latest frame for the stream clients
+ */
+void PreviewServer::run() {
+
+  double period = 1000.0 / cfg.fps;
+  double next = get_time_msec();
+  struct pollfd pfd;
+
+  while (running) {
+
+    double now = get_time_msec();
+    int timeout = (next > now) ? (int)(next - now) + 1 : 0;
+
+    pfd.fd = listen_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, (timeout < 100) ? timeout : 100) > 0) {
+      int fd;
+      while ((fd = net_accept(listen_fd, SEND_TIMEOUT_MS)) >= 0) {
+        handle_request(fd);
+      }
+    }
+
+    now = get_time_msec();
+    if (now >= next) {
+      if (num_clients > 0) {
+        stream_latest();
+      }
+      next += period;
+      if (next < now) next = now + period;
+    }
+  }
+}
+
+/* @brief Routes a single request, stream clients are kept open
+ */
+void PreviewServer::handle_request(int fd) {
+
+  char path[256];
+  char body[512];
+  char head[128];
+
+  if (!net_read_get_path(fd, path, sizeof(path))) {
+    close(fd);
+    return;
+  }
+
+  if (strcmp(path, "/stream.mjpg") == 0) {
+    if (num_clients < PREVIEW_MAX_CLIENTS 
+        && net_send_all(fd, stream_head, sizeof(stream_head)-1)) {
+      clients[num_clients++] = fd;
+    } else {
+      close(fd);
+    }
+    return;
+  }
+
+  if (strcmp(path, "/state.json") == 0) {
+
+    lane_state_t s;
+    bool valid;
+    pthread_mutex_lock(&state_lock);
+    s = last_state;
+    valid = have_state;
+    pthread_mutex_unlock(&state_lock);
+
+    int n = snprintf(body, sizeof(body),
+      "{\"valid\": %s, \"frame\": %u, "
+      "\"left\": {\"found\": %s, \"x1\": %i, \"y1\": %i, \"x2\": %i, \"y2\": %i}, "
+      "\"right\": {\"found\": %s, \"x1\": %i, \"y1\": %i, \"x2\": %i, \"y2\": %i}, "
+      "\"offset\": %i, \"warning\": %i, \"degrade\": %i, "
+      "\"preview\": {\"encoded\": %u, \"skipped\": %lu}}\n",
+      valid ? "true" : "false", s.frame_num,
+      s.is_left_found ? "true" : "false",
+      s.left_pt1.x, s.left_pt1.y, s.left_pt2.x, s.left_pt2.y,
+      s.is_right_found ? "true" : "false",
+      s.right_pt1.x, s.right_pt1.y, s.right_pt2.x, s.right_pt2.y,
+      s.offset, (int)s.warning, (int)s.degrade,
+      frames_encoded, box.Skipped());
+
+    int m = snprintf(head, sizeof(head),
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Type: application/json\r\n"
+      "Content-Length: %i\r\n\r\n", n);
+
+    if (net_send_all(fd, head, m)) {
+      net_send_all(fd, body, n);
+    }
+    close(fd);
+    return;
+  }
+
+  if (strcmp(path, "/") == 0) {
+    net_send_all(fd, index_html, sizeof(index_html)-1);
+  } else {
+    net_send_all(fd, not_found, sizeof(not_found)-1);
+  }
+  close(fd);
+}
+
+/* @brief Downscales and encodes the latest frame, and pushes it to all
+ *        stream clients. Does nothing if no new frame arrived.
+ */
+void PreviewServer::stream_latest() {
+
+  preview_frame_t frame;
+  char head[128];
+
+  if (!box.Take(frame)) {
+    return;
+  }
+
+  double start = get_time_msec();
+
+  if (cfg.scale < 1.0) {
+    resize(frame.annot, small, Size(), cfg.scale, cfg.scale, INTER_AREA);
+    imencode(".jpg", small, jpeg, jpeg_params);
+  } else {
+    imencode(".jpg", frame.annot, jpeg, jpeg_params);
+  }
+
+  encode_elapsed += get_time_msec() - start;
+  frames_encoded++;
+
+  int m = snprintf(head, sizeof(head),
+    "--" BOUNDARY "\r\n"
+    "Content-Type: image/jpeg\r\n"
+    "Content-Length: %u\r\n\r\n", (unsigned int)jpeg.size());
+
+  for (int i = num_clients-1; i >= 0; i--) {
+    if (!net_send_all(clients[i], head, m)
+        || !net_send_all(clients[i], jpeg.data(), jpeg.size())
+        || !net_send_all(clients[i], "\r\n", 2)) {
+      drop_client(i);
+    }
+  }
+}
+
+void PreviewServer::drop_client(int i) {
+
+  close(clients[i]);
+  clients[i] = clients[--num_clients];
+}
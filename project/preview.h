@@ -0,0 +1,103 @@
+/* ----------------------------------------------------------------------------
+ * @file preview.h
+ * @brief Embedded MJPEG-over-HTTP preview of the annotated frames
+ *
+ * Endpoints:
+ *   /             a small HTML page embedding the stream
+ *   /stream.mjpg  multipart/x-mixed-replace JPEG stream (downscaled)
+ *   /state.json   lane state of the most recent frame
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <pthread.h>
+#include <vector>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "lane.h"
+#include "mailbox.h"
+
+using namespace cv;
+
+#define PREVIEW_MAX_CLIENTS (4)
+
+/* @brief Preview settings
+ */
+typedef struct {
+  String addr;     // interface to bind, 127.0.0.1 for SSH port forwarding
+  int port;        // TCP port, 0 disables the preview
+  double fps;      // maximum encode/stream rate
+  double scale;    // downscale factor applied before encoding
+  int quality;     // JPEG quality 0..100
+} preview_config_t;
+
+/* @brief A frame handed over from the processing thread
+ */
+typedef struct {
+  Mat annot;
+  lane_state_t state;
+} preview_frame_t;
+
+/* @brief Serves the latest annotated frame over HTTP from one low priority
+ *        thread, encoding at most fps frames per second and only while a
+ *        stream client is connected.
+ */
+class PreviewServer {
+
+private:
+
+  preview_config_t cfg;
+  pthread_t thread;
+  volatile bool running;
+  int listen_fd;
+
+  // streaming clients, the fds that requested /stream.mjpg
+  int clients[PREVIEW_MAX_CLIENTS];
+  int num_clients;
+
+  // latest frame from the processing thread, taken by the stream only
+  Mailbox<preview_frame_t> box;
+
+  // lane state of the last posted frame, for /state.json, a copy so that
+  // polling the state never takes frames from the stream
+  pthread_mutex_t state_lock;
+  lane_state_t last_state;
+  bool have_state;
+
+  // reusable encode buffers
+  Mat small;
+  std::vector<uchar> jpeg;
+  std::vector<int> jpeg_params;
+
+  // metrics to track
+  unsigned int frames_encoded;
+  double encode_elapsed;
+
+  static void *thread_entry(void *param);
+  void run();
+  void handle_request(int fd);
+  void stream_latest();
+  void drop_client(int i);
+
+public:
+
+  PreviewServer();
+  ~PreviewServer();
+
+  bool start(const preview_config_t& config);
+  void stop();
+
+  // called from the processing thread, never blocks on the preview
+  void post(const Mat& annotated, const lane_state_t& state);
+
+  unsigned int get_frames_encoded() { return frames_encoded; }
+  unsigned long get_frames_skipped() { return box.Skipped(); }
+  double get_encode_elapsed() { return encode_elapsed; }
+};
+
+#endif // PREVIEW_H
@@ -0,0 +1,144 @@
+/* ----------------------------------------------------------------------------
+ * @file replay.cpp
+ * @brief Paced replay of recorded input, see replay.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <errno.h>
+
+#include "log.h"
+#include "replay.h"
+
+/* @brief splitmix64, a good 64-bit mix of the seed and frame number
+ */
+static uint64_t mix64(uint64_t x) {
+
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* @brief A uniform number in (0, 1) from a hash
+ */
+static double unit(uint64_t h) {
+
+  return ((h >> 11) + 0.5) / 9007199254740992.0;
+}
+
+ReplayClock::ReplayClock(const replay_config_t& config, double source_fps) {
+
+  cfg = config;
+  double fps = (cfg.fps > 0.0) ? cfg.fps : source_fps;
+  if (!(fps > 0.0)) {
+    fps = REPLAY_DEFAULT_FPS;
+  }
+  period = 1000.0 / fps;
+  if (cfg.burst_len >= cfg.burst_every) {
+    cfg.burst_len = cfg.burst_every - 1;
+  }
+
+  t0 = 0.0;
+  next = 0;
+  released = dropped = late = 0;
+  late_sum = late_max = 0.0;
+  gap_min = DBL_MAX;
+  gap_max = 0.0;
+  last_release = 0.0;
+}
+
+/* @brief The jitter of frame k in msec, a truncated gaussian
+ */
+double ReplayClock::offset(unsigned int k) {
+
+  if (cfg.jitter_ms <= 0.0) {
+    return 0.0;
+  }
+
+  // Box-Muller from two hashes of (seed, k)
+  uint64_t h = mix64(cfg.seed ^ ((uint64_t)k << 1));
+  double u1 = unit(h), u2 = unit(mix64(h));
+  double z = sqrt(-2.0*log(u1)) * cos(2.0*M_PI*u2);
+
+  double limit = fmin(3.0*cfg.jitter_ms, 0.49*period);
+  return fmax(-limit, fmin(limit, z*cfg.jitter_ms));
+}
+
+// see .h for more details
+double ReplayClock::arrival(unsigned int k) {
+
+  // held back to the last frame of its burst
+  if (cfg.burst_every > 0 && cfg.burst_len > 0) {
+    unsigned int pos = k % cfg.burst_every;
+    unsigned int first = cfg.burst_every - cfg.burst_len - 1;
+    if (pos >= first) {
+      k += cfg.burst_every - 1 - pos;
+    }
+  }
+  return t0 + k*period + offset(k);
+}
+
+// see .h for more details
+double ReplayClock::wait(bool& stale) {
+
+  unsigned int k = next++;
+
+  if (k == 0) {
+    // the first frame arrives now, up to its own jitter
+    t0 = get_time_msec() - offset(0);
+  }
+
+  double t = arrival(k);
+  double now = get_time_msec();
+
+  if (now < t) {
+    double ns = (t - now) * MSEC_TO_NSEC;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += (time_t)(ns / SEC_TO_NSEC);
+    ts.tv_nsec += (long)fmod(ns, SEC_TO_NSEC);
+    if (ts.tv_nsec >= SEC_TO_NSEC) {
+      ts.tv_sec++;
+      ts.tv_nsec -= SEC_TO_NSEC;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+           == EINTR) {
+    }
+    now = get_time_msec();
+  } else {
+    // decoded (or let go by the chain) only after it arrived
+    metric_add(&late, 1);
+    late_sum += now - t;
+    if (now - t > late_max) late_max = now - t;
+  }
+
+  // the frames of a burst are queued, not overwritten by the next one
+  double t_next = arrival(k+1);
+  stale = cfg.drop && t_next > t && now >= t_next;
+  if (!stale) {
+    if (released > 0) {
+      double gap = now - last_release;
+      if (gap < gap_min) gap_min = gap;
+      if (gap > gap_max) gap_max = gap;
+    }
+    last_release = now;
+    metric_add(&released, 1);
+  }
+  return t;
+}
+
+// see .h for more details
+void ReplayClock::print() {
+
+  LOGP("replay, fps: %.2f, jitter msec: %.2f, burst: %i of %i, "
+       "frames released: %u, dropped: %u, late: %u (avg %.2f, max %.2f "
+       "msec), release gap min/max msec: %.2f/%.2f\n",
+       1000.0/period, cfg.jitter_ms, cfg.burst_len, cfg.burst_every,
+       released, dropped, late, late ? late_sum/late : 0.0, late_max,
+       (released > 1) ? gap_min : 0.0, gap_max);
+}
@@ -0,0 +1,97 @@
+/* ----------------------------------------------------------------------------
+ * @file replay.h
+ * @brief Paced replay of recorded input: frames are released on a camera
+ *        like clock, with optional arrival jitter and bursts
+ *
+ * Source frame k nominally arrives at t0 + k*period, period from the
+ * source's native frame rate or a chosen one. On top of that:
+ *
+ *   jitter   each arrival moves by a gaussian offset of the given standard
+ *            deviation, truncated to 3 sigma and to less than half a period
+ *            so frames never swap order
+ *   bursts   every burst_every frames, the last burst_len of them are held
+ *            back and arrive together with the last one, like a stalled
+ *            USB or network link delivering its backlog
+ *
+ * The offsets are a hash of the seed and the frame number, so a run is
+ * repeatable and any arrival time can be computed on its own.
+ *
+ * A frame is decoded ahead and released at its arrival time, which is its
+ * capture time for the latency statistics. A frame that is only decoded
+ * after the next one has arrived is stale: a camera would have overwritten
+ * it, and with drop enabled it is skipped. Late and dropped frames show
+ * where the chain cannot keep up with the arrival pattern.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+
+#include "metrics.h"
+
+#define REPLAY_DEFAULT_FPS (30.0)   // for sources without a frame rate
+
+/* @brief Replay settings
+ */
+typedef struct {
+  double fps;             // 0 for the source's native rate
+  double jitter_ms;       // standard deviation of the arrival offset
+  int burst_every;        // frames per burst period, 0 for no bursts
+  int burst_len;          // frames held back and released together
+  bool drop;              // skip stale frames instead of passing them on
+  uint64_t seed;
+} replay_config_t;
+
+/* @brief The arrival clock of one source
+ */
+class ReplayClock {
+
+private:
+
+  replay_config_t cfg;
+  double period;          // msec
+  double t0;              // msec, arrival of frame 0, set by the first wait
+  unsigned int next;      // next source frame
+
+  // statistics, the counts are read live, see metrics.h
+  unsigned int released, dropped, late;
+  double late_sum, late_max;        // msec after arrival
+  double gap_min, gap_max;          // msec between two releases
+  double last_release;
+
+  double offset(unsigned int k);
+
+public:
+
+  ReplayClock(const replay_config_t& config, double source_fps);
+
+  // msec (CLOCK_MONOTONIC) at which source frame k arrives
+  double arrival(unsigned int k);
+
+  // the nominal frame period in msec
+  double get_period() { return period; }
+
+  /* @brief Waits until the next source frame (already decoded) arrives
+   *
+   * @param stale, set when drop is on and the frame after it has arrived
+   *        as well, the caller skips it and calls drop()
+   * @return the arrival time in msec, the capture time of the frame
+   */
+  double wait(bool& stale);
+
+  // the frame was skipped as stale, see replay_config_t.drop
+  void drop() { metric_add(&dropped, 1); }
+
+  // releases, drops, lateness and arrival gaps
+  void print();
+
+  unsigned int get_released() { return metric_load(&released); }
+  unsigned int get_dropped() { return metric_load(&dropped); }
+  unsigned int get_late() { return metric_load(&late); }
+};
+
+#endif // REPLAY_H
@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include <assert.h>
+#include <stddef.h>
+
 template <class T> //, size_t RingSize>
 class RingBuffer
 {
@@ -32,16 +35,23 @@ public:
     size_t Next(size_t n) const 
         { return (n+1)%m_size; }
     bool Empty() const 
-        { return (m_rIndex == m_wIndex); }
+        { return (Load(m_rIndex) == Load(m_wIndex)); }
     bool Full() const
-        { return (Next(m_wIndex) == m_rIndex); }
+        { return (Next(Load(m_wIndex)) == Load(m_rIndex)); }
+
+    // number of queued items, exact only when called by the producer or
+    // the consumer
+    size_t Count() const
+        { return (Load(m_wIndex) + m_size - Load(m_rIndex)) % m_size; }
+    size_t Capacity() const
+        { return m_size - 1; }
 
     bool Put(const T& value)
     {
         if (Full()) 
             return false;
         m_buffer[m_wIndex] = value;
-        m_wIndex = Next(m_wIndex);
+        Store(m_wIndex, Next(m_wIndex));
         return true;
     }
 
@@ -50,18 +60,23 @@ public:
         if (Empty())
             return false;
         value = m_buffer[m_rIndex];
-        m_rIndex = Next(m_rIndex);
+        Store(m_rIndex, Next(m_rIndex));
         return true;
     }
 
 private:
+    // acquire/release ordering on the indices, so the slot contents are
+    // visible before the index that publishes them (needed on ARM)
+    static size_t Load(const size_t& index)
+        { return __atomic_load_n(&index, __ATOMIC_ACQUIRE); }
+    static void Store(size_t& index, size_t value)
+        { __atomic_store_n(&index, value, __ATOMIC_RELEASE); }
+
     size_t          m_size;
     T*              m_buffer;
 
-    // volatile is only used to keep compiler from placing values in registers.
-    // volatile does NOT make the index thread safe.
-    volatile size_t m_rIndex;   
-    volatile size_t m_wIndex;
+    size_t          m_rIndex;   
+    size_t          m_wIndex;
 };
 
 #endif // RINGBUF_H_
@@ -0,0 +1,362 @@
+/* ----------------------------------------------------------------------------
+ * @file rtmem.cpp
+ * @brief Real-time memory mode, see rtmem.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "log.h"
+#include "rtmem.h"
+
+#define HUGE_PAGE_SIZE (2*1024*1024)
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((uintptr_t)(a) - 1))
+
+/* @brief Frame buffers from equal slots of one prefaulted mapping
+ *
+ * The slots are handed out from a free stack under a mutex, allocations
+ * that do not fit or find the pool empty come from the heap. Only the
+ * buffers are pooled, the UMatData headers are small heap allocations.
+ */
+class FramePool : public MatAllocator {
+
+private:
+
+  uint8_t* base;
+  size_t map_bytes;
+  size_t slot_bytes;
+  int slots;
+  mutable std::vector<int> free_slots;
+  mutable pthread_mutex_t lock;
+  mutable unsigned long taken, fallbacks;
+
+  int take() const;
+  void give(int slot) const;
+
+public:
+
+  FramePool();
+  ~FramePool();
+
+  bool create(size_t slot_size, int num_slots, rtmem_pages_t pages);
+  void print() const;
+
+  UMatData* allocate(int dims, const int* sizes, int type, void* data0,
+                     size_t* step, int flags, UMatUsageFlags usage) const;
+  bool allocate(UMatData* u, int access, UMatUsageFlags usage) const;
+  void deallocate(UMatData* u) const;
+};
+
+static bool rtmem_enabled = false;
+static bool rtmem_locked = false;
+static rtmem_pages_t rtmem_pages = RTMEM_PAGES_NORMAL;
+static FramePool* frame_pool = NULL;
+
+// page faults at init, end of warm-up and print, see rtmem_steady()
+static struct rusage usage_init, usage_steady;
+static int steady_marked = 0;
+
+/* @brief Maps anonymous memory of the given page size, huge page mappings
+ *        are 2 MB aligned
+ */
+static uint8_t* map_pages(size_t& bytes, rtmem_pages_t pages) {
+
+  if (pages == RTMEM_PAGES_HUGETLB) {
+    size_t size = ALIGN_UP(bytes, HUGE_PAGE_SIZE);
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      bytes = size;
+      return (uint8_t*)p;
+    }
+    perror("rtmem hugetlb mmap, using transparent huge pages");
+    pages = RTMEM_PAGES_THP;
+  }
+
+  if (pages == RTMEM_PAGES_THP) {
+    // over-allocate to cut out an aligned range, a THP needs 2 MB alignment
+    size_t size = ALIGN_UP(bytes, HUGE_PAGE_SIZE);
+    void* p = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      perror("rtmem mmap");
+      return NULL;
+    }
+    uint8_t* aligned = (uint8_t*)ALIGN_UP((uintptr_t)p, HUGE_PAGE_SIZE);
+    if (aligned > (uint8_t*)p) {
+      munmap(p, aligned - (uint8_t*)p);
+    }
+    munmap(aligned + size, (uint8_t*)p + HUGE_PAGE_SIZE - aligned);
+    if (madvise(aligned, size, MADV_HUGEPAGE) < 0) {
+      perror("rtmem madvise MADV_HUGEPAGE");
+    }
+    bytes = size;
+    return aligned;
+  }
+
+  void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    perror("rtmem mmap");
+    return NULL;
+  }
+  return (uint8_t*)p;
+}
+
+/* @brief Writes every page of a range, so it is faulted in (and locked)
+ */
+static void touch_pages(uint8_t* p, size_t bytes) {
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  for (size_t i = 0; i < bytes; i += page) {
+    ((volatile uint8_t*)p)[i] = 0;
+  }
+}
+
+/* @brief Touches RTMEM_STACK_PREFAULT bytes below the caller's frame
+ */
+static void __attribute__((noinline)) touch_stack() {
+
+  volatile uint8_t stack[RTMEM_STACK_PREFAULT];
+  size_t page = sysconf(_SC_PAGESIZE);
+  for (size_t i = 0; i < sizeof(stack); i += page) {
+    stack[i] = 0;
+  }
+}
+
+FramePool::FramePool()
+  : base(NULL), map_bytes(0), slot_bytes(0), slots(0), taken(0),
+    fallbacks(0) {
+
+  pthread_mutex_init(&lock, NULL);
+}
+
+FramePool::~FramePool() {
+
+  if (base != NULL) {
+    munmap(base, map_bytes);
+  }
+  pthread_mutex_destroy(&lock);
+}
+
+bool FramePool::create(size_t slot_size, int num_slots,
+                       rtmem_pages_t pages) {
+
+  // cache line aligned slots
+  slot_bytes = ALIGN_UP(slot_size, 64);
+  map_bytes = slot_bytes * num_slots;
+  base = map_pages(map_bytes, pages);
+  if (base == NULL) {
+    return false;
+  }
+  touch_pages(base, map_bytes);
+
+  slots = num_slots;
+  free_slots.reserve(slots);
+  for (int i = slots-1; i >= 0; i--) {
+    free_slots.push_back(i);
+  }
+  return true;
+}
+
+int FramePool::take() const {
+
+  int slot = -1;
+  pthread_mutex_lock(&lock);
+  if (!free_slots.empty()) {
+    slot = free_slots.back();
+    free_slots.pop_back();
+    taken++;
+  } else {
+    fallbacks++;
+  }
+  pthread_mutex_unlock(&lock);
+  return slot;
+}
+
+void FramePool::give(int slot) const {
+
+  pthread_mutex_lock(&lock);
+  free_slots.push_back(slot);
+  pthread_mutex_unlock(&lock);
+}
+
+// the same layout as OpenCV's default allocator, only the buffer differs
+UMatData* FramePool::allocate(int dims, const int* sizes, int type,
+                              void* data0, size_t* step, int flags,
+                              UMatUsageFlags usage) const {
+
+  size_t total = CV_ELEM_SIZE(type);
+  for (int i = dims-1; i >= 0; i--) {
+    if (step) {
+      if (data0 && step[i] != CV_AUTOSTEP) {
+        CV_Assert(total <= step[i]);
+        total = step[i];
+      } else {
+        step[i] = total;
+      }
+    }
+    total *= sizes[i];
+  }
+
+  uint8_t* data = (uint8_t*)data0;
+  if (data == NULL) {
+    int slot = (total <= slot_bytes) ? take() : -1;
+    data = (slot >= 0) ? base + slot*slot_bytes : (uint8_t*)fastMalloc(total);
+  }
+
+  UMatData* u = new UMatData(this);
+  u->data = u->origdata = data;
+  u->size = total;
+  if (data0) {
+    u->flags |= UMatData::USER_ALLOCATED;
+  }
+  return u;
+}
+
+bool FramePool::allocate(UMatData* u, int, UMatUsageFlags) const {
+
+  return u != NULL;
+}
+
+void FramePool::deallocate(UMatData* u) const {
+
+  if (u == NULL) {
+    return;
+  }
+  if (!(u->flags & UMatData::USER_ALLOCATED)) {
+    if (u->origdata >= base && u->origdata < base + map_bytes) {
+      give((u->origdata - base) / slot_bytes);
+    } else {
+      fastFree(u->origdata);
+    }
+  }
+  delete u;
+}
+
+void FramePool::print() const {
+
+  LOGP("rtmem frame pool, slots: %i x %.2f MB, taken: %lu, "
+       "heap fallbacks: %lu\n", slots, slot_bytes/1048576.0, taken,
+       fallbacks);
+}
+
+// see .h for more details
+bool rtmem_init(size_t heap_bytes, rtmem_pages_t pages) {
+
+  rtmem_enabled = true;
+  rtmem_pages = pages;
+
+  // one heap, never trimmed, no per-allocation mappings
+  mallopt(M_MMAP_MAX, 0);
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_ARENA_MAX, 1);
+
+#ifdef MCL_ONFAULT
+  int flags = MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT;
+#else
+  int flags = MCL_CURRENT | MCL_FUTURE;
+#endif
+  rtmem_locked = (mlockall(flags) == 0);
+  if (!rtmem_locked) {
+    perror("rtmem mlockall (needs CAP_IPC_LOCK or a larger ulimit -l)");
+  }
+
+  // grow the heap once, fault it in, and keep it for later allocations
+  if (heap_bytes > 0) {
+    uint8_t* heap = (uint8_t*)malloc(heap_bytes);
+    if (heap == NULL) {
+      perror("rtmem heap malloc");
+    } else {
+      if (pages != RTMEM_PAGES_NORMAL) {
+        uint8_t* start = (uint8_t*)ALIGN_UP((uintptr_t)heap, HUGE_PAGE_SIZE);
+        uint8_t* end = (uint8_t*)((uintptr_t)(heap + heap_bytes)
+                                  & ~((uintptr_t)HUGE_PAGE_SIZE - 1));
+        if (end > start) {
+          madvise(start, end - start, MADV_HUGEPAGE);
+        }
+      }
+      touch_pages(heap, heap_bytes);
+      free(heap);
+    }
+  }
+
+  touch_stack();
+  getrusage(RUSAGE_SELF, &usage_init);
+  usage_steady = usage_init;
+  return rtmem_locked;
+}
+
+// see .h for more details
+bool rtmem_is_enabled() {
+
+  return rtmem_enabled;
+}
+
+// see .h for more details
+void rtmem_thread_start() {
+
+  if (rtmem_enabled) {
+    touch_stack();
+  }
+}
+
+// see .h for more details
+MatAllocator* rtmem_frame_pool(size_t slot_bytes, int slots) {
+
+  if (!rtmem_enabled || slot_bytes == 0 || slots <= 0) {
+    return NULL;
+  }
+  if (frame_pool == NULL) {
+    FramePool* pool = new FramePool();
+    if (!pool->create(slot_bytes, slots, rtmem_pages)) {
+      delete pool;
+      return NULL;
+    }
+    frame_pool = pool;
+  }
+  return frame_pool;
+}
+
+// see .h for more details
+void rtmem_steady() {
+
+  if (rtmem_enabled && __sync_bool_compare_and_swap(&steady_marked, 0, 1)) {
+    getrusage(RUSAGE_SELF, &usage_steady);
+  }
+}
+
+// see .h for more details
+void rtmem_print() {
+
+  if (!rtmem_enabled) {
+    return;
+  }
+
+  struct rusage now;
+  getrusage(RUSAGE_SELF, &now);
+
+  LOGP("rtmem, memory locked: %s, pages: %s\n", rtmem_locked ? "yes" : "no",
+       rtmem_pages == RTMEM_PAGES_HUGETLB ? "hugetlb" :
+       rtmem_pages == RTMEM_PAGES_THP ? "transparent huge" : "normal");
+  if (frame_pool != NULL) {
+    frame_pool->print();
+  }
+  LOGP("rtmem page faults minor/major, startup: %ld/%ld, setup and "
+       "warm-up (%i frames): %ld/%ld, steady state: %ld/%ld\n",
+       usage_init.ru_minflt, usage_init.ru_majflt, RTMEM_WARMUP_FRAMES,
+       usage_steady.ru_minflt - usage_init.ru_minflt,
+       usage_steady.ru_majflt - usage_init.ru_majflt,
+       steady_marked ? now.ru_minflt - usage_steady.ru_minflt : 0L,
+       steady_marked ? now.ru_majflt - usage_steady.ru_majflt : 0L);
+}
@@ -0,0 +1,87 @@
+/* ----------------------------------------------------------------------------
+ * @file rtmem.h
+ * @brief Real-time memory mode: locked, prefaulted memory and a huge-page
+ *        frame buffer pool, so the steady-state run takes no page faults
+ *
+ * Without it the first frames, and every buffer that grows later, fault
+ * their pages in on the processing threads. Large OpenCV buffers (frames)
+ * are mmap()ed by malloc on every allocation and munmap()ed on free, so
+ * they fault again on every frame. rtmem_init():
+ *
+ *   - keeps every allocation on one heap that is never given back to the
+ *     kernel (no mmap()ed chunks, no trimming, one malloc arena for all
+ *     threads, whose heaps would otherwise be separate and unprefaulted)
+ *   - locks all current and future pages with mlockall(), on fault where
+ *     the kernel supports it, so a large memory-mapped input is not read in
+ *     as a whole
+ *   - grows the heap by heap_bytes and touches every page, optionally with
+ *     transparent huge pages, then frees it for the allocations to come
+ *   - touches the stack of the calling thread, rtmem_thread_start() does
+ *     the same for other threads
+ *
+ * The frame buffers come from a pool of equal slots in one mapping, of
+ * explicit (hugetlbfs) or transparent huge pages, prefaulted up front. The
+ * pool is a cv::MatAllocator: Mats that have it as their allocator take a
+ * free slot for any buffer that fits, others fall back to the heap.
+ *
+ * Page faults are counted with getrusage() over the warm-up frames and
+ * over the steady state after rtmem_steady().
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef RTMEM_H
+#define RTMEM_H
+
+#include <stddef.h>
+#include <opencv2/core.hpp>
+
+using namespace cv;
+
+#define RTMEM_STACK_PREFAULT (256*1024)   // bytes of stack touched per thread
+#define RTMEM_WARMUP_FRAMES  (30)         // frames before the steady state
+
+// page size behind the heap and the frame pool
+typedef enum {
+  RTMEM_PAGES_NORMAL = 0,
+  RTMEM_PAGES_THP,        // transparent huge pages, madvise(MADV_HUGEPAGE)
+  RTMEM_PAGES_HUGETLB     // explicit huge pages (vm.nr_hugepages), frame
+                          // pool only, THP for the heap and as fallback
+} rtmem_pages_t;
+
+/* @brief Enables the real-time memory mode, before any thread is started
+ *
+ * @param heap_bytes, heap to prefault for the buffers of the stages
+ * @param pages, page size behind the heap and the frame pool
+ * @return false if the memory could not be locked (the mode stays on,
+ *         the pages are still prefaulted)
+ */
+bool rtmem_init(size_t heap_bytes, rtmem_pages_t pages);
+
+bool rtmem_is_enabled();
+
+/* @brief Prefaults the stack of the calling thread, if enabled
+ */
+void rtmem_thread_start();
+
+/* @brief Creates the prefaulted frame buffer pool
+ *
+ * @param slot_bytes, the largest buffer a slot holds
+ * @param slots, number of slots
+ * @return the pool, to be set as Mat::allocator, NULL if not enabled or
+ *         the pool could not be mapped
+ */
+MatAllocator* rtmem_frame_pool(size_t slot_bytes, int slots);
+
+/* @brief Marks the end of the warm-up, the faults from here on are the
+ *        steady-state faults. Safe to call from any thread, once counts.
+ */
+void rtmem_steady();
+
+/* @brief Prints the locked state, pool usage and page faults of the
+ *        startup, warm-up and steady-state phases
+ */
+void rtmem_print();
+
+#endif // RTMEM_H
@@ -0,0 +1,322 @@
+/* ----------------------------------------------------------------------------
+ * @file scan_lane.cpp
+ * @brief Scan-line lane marker detector, see scan_lane.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "scan_lane.h"
+#include "kernels.h"
+
+// the ROI width at 1280x720, the marking width is scaled from it
+#define SCAN_ROI_WIDTH    (400)
+
+// RANSAC: line hypotheses per candidate line, and the seed of the pair
+// sequence, fixed so the same peaks always give the same lines
+#define SCAN_RANSAC_ITERS (64)
+#define SCAN_RANSAC_SEED  (0x2545f491u)
+
+// theta windows (min, max) of the left and right lane lines, as the Hough
+// search of the LaneDetector
+static const double scan_window[2][2] = {
+  {THETA_LEFT_MIN, THETA_LEFT_MAX}, {THETA_RIGHT_MIN, THETA_RIGHT_MAX}
+};
+
+/* @brief The Hough theta of the line x = a*y + b, in [0, pi)
+ */
+static inline double slope_theta(double a) {
+
+  double theta = atan2(-a, 1.0);
+  return (theta < 0.0) ? theta + CV_PI : theta;
+}
+
+static inline bool in_window(int side, double a) {
+
+  double theta = slope_theta(a);
+  return theta >= scan_window[side][0] && theta <= scan_window[side][1];
+}
+
+/* @brief The default scan-line detector, SCAN_LINES lines
+ */
+ScanLaneDetector::ScanLaneDetector() {
+
+  num_lines = SCAN_LINES;
+  mark_width = SCAN_MARK_WIDTH;
+  contrast = SCAN_CONTRAST;
+  for (int side = 0; side < 2; side++) {
+    found[side].reserve(SCAN_MAX_LINES_OUT);
+  }
+}
+
+// see .h for more details
+void ScanLaneDetector::set_scan_lines(int lines) {
+
+  num_lines = std::min(std::max(lines, 2), SCAN_MAX_LINES);
+}
+
+// see .h for more details
+void ScanLaneDetector::set_marker(int width, int min_contrast) {
+
+  mark_width = std::max(width, 2);
+  contrast = std::max(min_contrast, 1);
+}
+
+/* @brief ROI row of scan line i, evenly spaced over the rows
+ */
+int ScanLaneDetector::scan_row(int i, int rows) const {
+
+  int n = std::min(num_lines, rows);
+  return ((2*i + 1) * rows) / (2*n);
+}
+
+/* @brief The scan line at a ROI row, or -1
+ */
+int ScanLaneDetector::scan_index(int row, int rows) const {
+
+  int n = std::min(num_lines, rows);
+  int i = row * n / rows;
+  for (int k = std::max(i-1, 0); k <= i+1 && k < n; k++) {
+    if (scan_row(k, rows) == row) {
+      return k;
+    }
+  }
+  return -1;
+}
+
+/* @brief The marking width in pixels of a ROI of the given width
+ */
+int ScanLaneDetector::marker_width(int roi_cols) const {
+
+  return std::max(cvRound((double)mark_width * roi_cols / SCAN_ROI_WIDTH), 2);
+}
+
+/* @brief The matched filter of one scan line: a bright center of the
+ *        marking width between two dark flanks of the same width, the
+ *        local maxima set to 255 in dst, all else 0
+ *
+ * @param w, the marking width
+ */
+void ScanLaneDetector::match_row(const uchar* src, uchar* dst, int cols,
+                                 int w) const {
+
+  int sum[SCAN_MAX_WIDTH+1];
+  int resp[SCAN_MAX_WIDTH];
+
+  CV_Assert(cols <= SCAN_MAX_WIDTH);
+  memset(dst, 0, cols);
+  if (cols < 3*w) {
+    return;
+  }
+
+  sum[0] = 0;
+  for (int x = 0; x < cols; x++) {
+    sum[x+1] = sum[x] + src[x];
+    resp[x] = 0;
+  }
+
+  // center [c, c+w), flanks [c-w, c) and [c+w, c+2w), both darker
+  int h = w/2;
+  int t = contrast*w;
+  for (int c = w; c + 2*w <= cols; c++) {
+    int center = sum[c+w] - sum[c];
+    int left = sum[c] - sum[c-w];
+    int right = sum[c+2*w] - sum[c+w];
+    if (center - left > t && center - right > t) {
+      resp[c+h] = 2*center - left - right;
+    }
+  }
+
+  // one peak per marking, the first of equal maxima
+  int peaks = 0;
+  for (int x = 0; x < cols && peaks < SCAN_MAX_PEAKS; x++) {
+    if (resp[x] == 0) {
+      continue;
+    }
+    bool peak = true;
+    int k0 = std::max(x-h, 0), k1 = std::min(x+h, cols-1);
+    for (int k = k0; k <= k1 && peak; k++) {
+      peak = resp[k] < resp[x] || (resp[k] == resp[x] && k >= x);
+    }
+    if (peak) {
+      dst[x] = 255;
+      peaks++;
+    }
+  }
+}
+
+// see .h for more details
+void ScanLaneDetector::gray_rows(int row0, int row1) {
+
+  Rect r = get_roi_rect();
+  Mat src = raw->colRange(r.x, r.x + r.width);
+  Mat dst = gray.colRange(r.x, r.x + r.width);
+
+  int y0 = std::max(row0, r.y), y1 = std::min(row1, r.y + r.height);
+  for (int y = y0; y < y1; y++) {
+    if (scan_index(y - r.y, r.height) >= 0) {
+      kern_bgr2gray(src, dst, y, y+1);
+    }
+  }
+}
+
+// see .h for more details
+void ScanLaneDetector::median_rows(int row0, int row1) {
+
+  for (int y = row0; y < row1; y++) {
+    uchar* d = filtered.ptr<uchar>(y);
+    if (scan_index(y, roi.rows) >= 0) {
+      memcpy(d, roi.ptr<uchar>(y), roi.cols);
+    } else {
+      memset(d, 0, roi.cols);
+    }
+  }
+}
+
+// see .h for more details
+void ScanLaneDetector::thresh_rows(int row0, int row1) {
+
+  int w = marker_width(roi.cols);
+
+  for (int y = row0; y < row1; y++) {
+    uchar* d = binary.ptr<uchar>(y);
+    if (scan_index(y, roi.rows) >= 0) {
+      match_row(roi.ptr<uchar>(y), d, roi.cols, w);
+    } else {
+      memset(d, 0, roi.cols);
+    }
+  }
+}
+
+/* @brief RANSAC over the unused peaks of one side: the line x = a*y + b
+ *        inside the theta window with the most peaks within tol, refit
+ *        by least squares through them, its inliers marked used
+ *
+ * @param n, the peaks
+ * @return the inliers of the line, 0 if none was found
+ */
+int ScanLaneDetector::fit_line(int side, int n, int min_inliers, double tol,
+                               double& a, double& b) {
+
+  const Point2f* p = pts[side];
+  bool* u = used[side];
+  unsigned int seed = SCAN_RANSAC_SEED;
+  int best = 0;
+
+  for (int it = 0; it < SCAN_RANSAC_ITERS && n >= 2; it++) {
+
+    seed = seed*1103515245u + 12345u;
+    int i = (seed >> 8) % n;
+    seed = seed*1103515245u + 12345u;
+    int j = (seed >> 8) % n;
+    if (u[i] || u[j] || p[i].y == p[j].y) {
+      continue;
+    }
+
+    double ha = (p[j].x - p[i].x) / (p[j].y - p[i].y);
+    if (!in_window(side, ha)) {
+      continue;
+    }
+    double hb = p[i].x - ha*p[i].y;
+
+    int inliers = 0;
+    for (int k = 0; k < n; k++) {
+      if (!u[k] && fabs(p[k].x - (ha*p[k].y + hb)) <= tol) inliers++;
+    }
+    if (inliers > best) {
+      best = inliers;
+      a = ha;
+      b = hb;
+    }
+  }
+
+  if (best < min_inliers) {
+    return 0;
+  }
+
+  // least squares x = a*y + b through the inliers, kept inside the window
+  double sy = 0, sx = 0, syy = 0, sxy = 0;
+  for (int k = 0; k < n; k++) {
+    if (!u[k] && fabs(p[k].x - (a*p[k].y + b)) <= tol) {
+      sy += p[k].y; sx += p[k].x;
+      syy += p[k].y*p[k].y; sxy += p[k].x*p[k].y;
+    }
+  }
+  double den = best*syy - sy*sy;
+  if (den > 0.0) {
+    double fa = (best*sxy - sy*sx) / den;
+    if (in_window(side, fa)) {
+      a = fa;
+      b = (sx - a*sy) / best;
+    }
+  }
+
+  int inliers = 0;
+  for (int k = 0; k < n; k++) {
+    if (!u[k] && fabs(p[k].x - (a*p[k].y + b)) <= tol) {
+      u[k] = true;
+      inliers++;
+    }
+  }
+  return inliers;
+}
+
+// see .h for more details
+const std::vector<Vec3f>& ScanLaneDetector::hough_search(int side, int,
+                                                         const Mat& img,
+                                                         int threshold) {
+
+  // the scan lines of the full size binary ROI, also at the degraded
+  // levels, where rho and the votes are reported at the image's scale
+  const Mat& bin = roi;
+  int scale = (img.rows < bin.rows) ? 2 : 1;
+  int rows = bin.rows;
+  int n = std::min(num_lines, rows);
+
+  std::vector<Vec3f>& lines = found[side];
+  lines.clear();
+
+  int count = 0;
+  for (int i = 0; i < n; i++) {
+    int y = scan_row(i, rows);
+    const uchar* p = bin.ptr<uchar>(y);
+    for (int x = 0; x < bin.cols; x++) {
+      if (p[x] != 0 && count < SCAN_MAX_LINES*SCAN_MAX_PEAKS) {
+        pts[side][count] = Point2f((float)x, (float)y);
+        used[side][count] = false;
+        count++;
+      }
+    }
+  }
+
+  // the threshold in votes of a line over all rows, to scan lines
+  int min_inliers = std::max(cvRound((double)threshold*scale*n / rows), 3);
+  double tol = std::max(marker_width(bin.cols)*0.5, 2.0);
+
+  for (int l = 0; l < SCAN_MAX_LINES_OUT; l++) {
+
+    double a = 0.0, b = 0.0;
+    int inliers = fit_line(side, count, min_inliers, tol, a, b);
+    if (inliers < min_inliers) {
+      break;
+    }
+
+    // the normal form x*cos(theta) + y*sin(theta) = rho of the line
+    double norm = sqrt(1.0 + a*a);
+    double theta = atan2(-a, 1.0);
+    double rho = b / norm;
+    if (theta < 0.0) {
+      theta += CV_PI;
+      rho = -rho;
+    }
+    double votes = (double)inliers * rows / n;
+    lines.push_back(Vec3f((float)(rho/scale), (float)theta,
+                          (float)(votes/scale)));
+  }
+
+  return lines;
+}
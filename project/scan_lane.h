@@ -0,0 +1,95 @@
+/* ----------------------------------------------------------------------------
+ * @file scan_lane.h
+ * @brief A LaneDetector that looks at a few horizontal scan lines of the ROI
+ *        only, for the smallest targets
+ *
+ * Instead of filtering the whole ROI and voting with every pixel, the
+ * engine samples scan lines evenly spaced over the ROI rows:
+ *
+ *   to_gray          converts the ROI span of the scan lines only
+ *   filter_roi       copies the scan lines (no median filter)
+ *   threshold_roi    a 1D dark-bright-dark matched filter of lane marking
+ *                    width on each scan line, the marker peaks set to 255
+ *   hough_transform  per side, a small RANSAC over the peaks inside the
+ *                    theta window of the side, refit by least squares, the
+ *                    lines returned as (rho, theta, votes) like the Hough
+ *                    search's, so the rho windows, endpoints and decision
+ *                    are the LaneDetector's
+ *
+ * The cost scales with the number of scan lines instead of the ROI area,
+ * apart from clearing the other rows of the ROI images. The binary ROI
+ * (the peaks) is the hand-over between the steps as in the Hough engine,
+ * so the preprocess and hough pipeline nodes work unchanged.
+ *
+ * A line needs as many inlier peaks as the Hough threshold, in votes of a
+ * ROI tall line, gives for the scan lines, so --acc-thresh and the
+ * adaptive threshold apply. The votes of a line are its inliers scaled
+ * back to ROI rows.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef SCAN_LANE_H
+#define SCAN_LANE_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "lane.h"
+
+using namespace cv;
+
+#define SCAN_LINES        (16)    // default scan lines over the ROI
+#define SCAN_MAX_LINES    (64)
+#define SCAN_MAX_PEAKS    (32)    // marker peaks kept per scan line
+#define SCAN_MAX_WIDTH    (4096)  // ROI width the matched filter handles
+#define SCAN_MARK_WIDTH   (12)    // lane marking width in pixels at 1280x720
+#define SCAN_CONTRAST     (12)    // marking over each flank, mean gray levels
+#define SCAN_MAX_LINES_OUT (3)    // candidate lines per side
+
+/* @brief Scan-line lane marker detector behind the LaneDetector interface
+ */
+class ScanLaneDetector : public LaneDetector {
+
+private:
+
+  int num_lines;
+  int mark_width;     // at 1280x720, scaled with the ROI width
+  int contrast;
+
+  // the marker peaks of one side's search, x and y in the ROI
+  Point2f pts[2][SCAN_MAX_LINES*SCAN_MAX_PEAKS];
+  bool used[2][SCAN_MAX_LINES*SCAN_MAX_PEAKS];
+  std::vector<Vec3f> found[2];
+
+  int scan_row(int i, int rows) const;
+  int scan_index(int row, int rows) const;
+  int marker_width(int roi_cols) const;
+  void match_row(const uchar* src, uchar* dst, int cols, int w) const;
+  int fit_line(int side, int n, int min_inliers, double tol,
+               double& a, double& b);
+
+protected:
+
+  void gray_rows(int row0, int row1);
+  void median_rows(int row0, int row1);
+  void thresh_rows(int row0, int row1);
+  const std::vector<Vec3f>& hough_search(int side, int level, const Mat& img,
+                                         int threshold);
+
+public:
+
+  ScanLaneDetector();
+
+  // the number of scan lines, 2..SCAN_MAX_LINES
+  void set_scan_lines(int lines);
+
+  // the lane marking width in pixels at 1280x720, and the contrast of
+  // the marking over both sides, in gray levels
+  void set_marker(int width, int min_contrast);
+
+  int get_scan_lines() { return num_lines; }
+};
+
+#endif // SCAN_LANE_H
@@ -0,0 +1,139 @@
+/* ----------------------------------------------------------------------------
+ * @file shm_reader.cpp
+ * @brief Example reader and latency benchmark for the shared-memory frame ring
+ *
+ * usage: ./shm_reader.out [shm name] [frames to measure] [sleep usec]
+ *
+ *   shm name     defaults to /emvia_frames, as passed to main.out --shm-name
+ *   frames       number of frames to read before printing statistics
+ *   sleep usec   0 busy-polls the head (no syscalls), >0 sleeps between polls
+ *
+ * Pixels are used in place from the mapping: no copies are made. The example
+ * computes the mean luma of the center row of each frame and then validates
+ * the read with the seqlock.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+
+#include "shmring.h"
+
+static volatile int exit_signal_g = 0;
+static void int_handler(int signum) {
+  
+  exit_signal_g = true;
+}
+
+static uint64_t monotonic_ns(void) {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static void print_latency(const char* label, std::vector<uint64_t>& v) {
+
+  if (v.empty()) return;
+  std::sort(v.begin(), v.end());
+
+  double sum = 0.0;
+  for (size_t i = 0; i < v.size(); i++) sum += v[i];
+
+  printf("%-16s usec, min: %8.1f, avg: %8.1f, p50: %8.1f, p99: %8.1f, max: %8.1f\n",
+         label,
+         v.front()/1000.0,
+         sum/v.size()/1000.0,
+         v[v.size()/2]/1000.0,
+         v[(v.size()*99)/100]/1000.0,
+         v.back()/1000.0);
+}
+
+int main(int argc, char **argv) {
+
+  const char* name = (argc > 1) ? argv[1] : "/emvia_frames";
+  unsigned long nframes = (argc > 2) ? strtoul(argv[2], NULL, 0) : 300;
+  unsigned int sleep_us = (argc > 3) ? strtoul(argv[3], NULL, 0) : 0;
+
+  shmring_reader_t ring;
+  std::vector<uint64_t> pub_lat, cap_lat;
+  unsigned long nread = 0, ntorn = 0, nmissed = 0;
+
+  signal(SIGINT, int_handler);
+
+  printf("waiting for %s\n", name);
+  while (!shmring_open(&ring, name)) {
+    if (exit_signal_g) return 0;
+    usleep(100000);
+  }
+
+  const shmring_header_t* hdr = ring.hdr;
+  printf("%s: %ux%ux%u, %u slots\n", 
+         name, hdr->width, hdr->height, hdr->channels, hdr->num_slots);
+
+  pub_lat.reserve(nframes);
+  cap_lat.reserve(nframes);
+  uint64_t last = shmring_head(&ring);
+
+  while (!exit_signal_g && nread < nframes) {
+
+    uint64_t head = shmring_head(&ring);
+    if (head == last) {
+      if (sleep_us) usleep(sleep_us);
+      continue;
+    }
+
+    // always jump to the newest frame, older ones are counted as missed
+    nmissed += head - last - 1;
+    last = head;
+
+    uint64_t gen;
+    const shmring_slot_t* meta;
+    const uint8_t* px = shmring_read_begin(&ring, head, &gen, &meta);
+    if (px == NULL) {
+      ntorn++;
+      continue;
+    }
+
+    uint64_t now = monotonic_ns();
+    uint64_t t_pub = meta->t_publish_ns;
+    uint64_t t_cap = meta->t_capture_ns;
+    uint32_t frame_num = meta->frame_num;
+    int left_found = meta->left_found, right_found = meta->right_found;
+
+    // use the pixels in place
+    const uint8_t* row = px + (uint64_t)(hdr->height/2) * hdr->stride;
+    unsigned long sum = 0;
+    for (uint32_t x = 0; x < hdr->stride; x++) sum += row[x];
+
+    if (!shmring_read_end(&ring, head, gen)) {
+      ntorn++;
+      continue;
+    }
+
+    pub_lat.push_back(now - t_pub);
+    cap_lat.push_back(now - t_cap);
+    nread++;
+
+    if (nread % 30 == 0) {
+      printf("seq: %llu, frame: %u, lanes: %c%c, center row mean: %lu\n",
+             (unsigned long long)head, frame_num,
+             left_found ? 'L' : '-', right_found ? 'R' : '-', 
+             sum / hdr->stride);
+    }
+  }
+
+  printf("frames read: %lu, missed: %lu, torn: %lu\n", nread, nmissed, ntorn);
+  print_latency("publish->read", pub_lat);
+  print_latency("capture->read", cap_lat);
+
+  shmring_close(&ring);
+  return 0;
+}
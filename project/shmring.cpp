@@ -0,0 +1,218 @@
+/* ----------------------------------------------------------------------------
+ * @file shmring.cpp
+ * @brief POSIX shared-memory ring of annotated frames for external readers
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmring.h"
+
+#define PAGE_ALIGN(x) (((x) + 4095) & ~((uint64_t)4095))
+
+static uint64_t monotonic_ns(void) {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+ShmRingWriter::ShmRingWriter() {
+
+  name[0] = '\0';
+  fd = -1;
+  base = NULL;
+  hdr = NULL;
+  slots = NULL;
+  seq = 0;
+}
+
+ShmRingWriter::~ShmRingWriter() {
+
+  destroy();
+}
+
+/* @brief Creates (or replaces) the named segment and writes its header
+ *
+ * @param shm_name, POSIX shm name, e.g. "/emvia_frames"
+ * @param num_slots, number of frames in the ring, at least 2
+ * @return true on success
+ */
+bool ShmRingWriter::create(const char* shm_name, unsigned int num_slots,
+                           unsigned int width, unsigned int height, 
+                           unsigned int channels) {
+
+  if (num_slots < 2) num_slots = 2;
+
+  uint64_t stride = (uint64_t)width * channels;
+  uint64_t slot_bytes = PAGE_ALIGN(stride * height);
+  uint64_t meta_offset = SHMRING_HEADER_BYTES;
+  uint64_t data_offset = PAGE_ALIGN(meta_offset + num_slots*sizeof(shmring_slot_t));
+  uint64_t total = data_offset + num_slots*slot_bytes;
+
+  snprintf(name, sizeof(name), "%s", shm_name);
+  shm_unlink(name);
+
+  fd = shm_open(name, O_CREAT | O_RDWR | O_EXCL, 0644);
+  if (fd < 0) {
+    perror("shmring shm_open");
+    return false;
+  }
+
+  if (ftruncate(fd, total) < 0) {
+    perror("shmring ftruncate");
+    destroy();
+    return false;
+  }
+
+  void* p = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    perror("shmring mmap");
+    destroy();
+    return false;
+  }
+  base = (uint8_t*) p;
+
+  // prefault the whole segment now rather than on the first frames
+  memset(base, 0, total);
+
+  hdr = (shmring_header_t*) base;
+  slots = (shmring_slot_t*) (base + meta_offset);
+  hdr->version = SHMRING_VERSION;
+  hdr->num_slots = num_slots;
+  hdr->width = width;
+  hdr->height = height;
+  hdr->channels = channels;
+  hdr->stride = stride;
+  hdr->slot_bytes = slot_bytes;
+  hdr->meta_offset = meta_offset;
+  hdr->data_offset = data_offset;
+  hdr->total_bytes = total;
+  hdr->head = 0;
+
+  // readers check the magic last
+  __atomic_store_n(&hdr->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+  seq = 0;
+  return true;
+}
+
+/* @brief Unmaps and unlinks the segment
+ */
+void ShmRingWriter::destroy() {
+
+  if (base != NULL) {
+    munmap(base, hdr->total_bytes);
+    base = NULL;
+    hdr = NULL;
+    slots = NULL;
+  }
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+    shm_unlink(name);
+  }
+}
+
+/* @brief Copies a frame of the configured geometry into the next slot
+ *
+ * @param data, pointer to the first row of pixels
+ * @param stride, bytes per row of the source
+ * @param info, lane result and timestamps for the metadata
+ */
+void ShmRingWriter::publish(const uint8_t* data, size_t stride, 
+                            const shmring_info_t& info) {
+
+  if (base == NULL) return;
+
+  uint64_t next = seq + 1;
+  uint32_t i = next % hdr->num_slots;
+  shmring_slot_t* s = &slots[i];
+  uint8_t* dst = base + hdr->data_offset + (uint64_t)i * hdr->slot_bytes;
+
+  // open the seqlock, readers of this slot will now fail validation
+  __atomic_store_n(&s->gen, s->gen + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  if (stride == hdr->stride) {
+    memcpy(dst, data, (size_t)hdr->stride * hdr->height);
+  } else {
+    for (uint32_t r = 0; r < hdr->height; r++) {
+      memcpy(dst + (size_t)r*hdr->stride, data + r*stride, hdr->stride);
+    }
+  }
+
+  s->seq = next;
+  s->t_capture_ns = info.t_capture_ns;
+  s->frame_num = info.frame_num;
+  s->left_found = info.left_found;
+  s->right_found = info.right_found;
+  for (int k = 0; k < 4; k++) {
+    s->left[k] = info.left[k];
+    s->right[k] = info.right[k];
+  }
+  s->t_publish_ns = monotonic_ns();
+
+  // close the seqlock, then make the frame visible
+  __atomic_store_n(&s->gen, s->gen + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&hdr->head, next, __ATOMIC_RELEASE);
+
+  seq = next;
+}
+
+// see .h for more details
+bool shmring_open(shmring_reader_t* r, const char* shm_name) {
+
+  struct stat st;
+
+  memset(r, 0, sizeof(*r));
+  r->fd = shm_open(shm_name, O_RDONLY, 0);
+  if (r->fd < 0) {
+    return false;
+  }
+
+  if (fstat(r->fd, &st) < 0 || (size_t)st.st_size < SHMRING_HEADER_BYTES) {
+    shmring_close(r);
+    return false;
+  }
+
+  void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, r->fd, 0);
+  if (p == MAP_FAILED) {
+    shmring_close(r);
+    return false;
+  }
+  r->base = (uint8_t*) p;
+  r->bytes = st.st_size;
+  r->hdr = (const shmring_header_t*) r->base;
+
+  if (__atomic_load_n(&r->hdr->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC
+      || r->hdr->version != SHMRING_VERSION
+      || r->hdr->total_bytes > r->bytes) {
+    shmring_close(r);
+    return false;
+  }
+
+  r->slots = (const shmring_slot_t*) (r->base + r->hdr->meta_offset);
+  return true;
+}
+
+// see .h for more details
+void shmring_close(shmring_reader_t* r) {
+
+  if (r->base != NULL) {
+    munmap(r->base, r->bytes);
+  }
+  if (r->fd >= 0) {
+    close(r->fd);
+  }
+  memset(r, 0, sizeof(*r));
+  r->fd = -1;
+}
@@ -0,0 +1,157 @@
+/* ----------------------------------------------------------------------------
+ * @file shmring.h
+ * @brief POSIX shared-memory ring of annotated frames for external readers
+ *
+ * Segment layout (all offsets from the start of the mapping):
+ *
+ *   shmring_header_t                    header, one page
+ *   shmring_slot_t[num_slots]           per-slot metadata
+ *   pixels, num_slots * slot_bytes      frame data, page aligned per slot
+ *
+ * Each slot is protected by a seqlock. The writer makes slot.gen odd, writes
+ * metadata and pixels, makes slot.gen even again and finally publishes the
+ * frame sequence number in header.head. A reader picks slot (seq % num_slots),
+ * reads gen, uses the pixels in place and re-reads gen afterwards: the frame
+ * was consistent only if both reads are equal, even, and slot.seq == seq.
+ * Neither side makes a syscall per frame.
+ *
+ * The layout is plain C so that other processes can map it without this code.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHMRING_MAGIC   (0x49564d45) // "EMVI"
+#define SHMRING_VERSION (1)
+#define SHMRING_HEADER_BYTES (4096)
+
+/* @brief Per-slot metadata, one cache line
+ */
+typedef struct {
+  uint64_t gen;           // seqlock generation, odd while being written
+  uint64_t seq;           // frame sequence number, starts at 1
+  uint64_t t_capture_ns;  // CLOCK_MONOTONIC when the frame was captured
+  uint64_t t_publish_ns;  // CLOCK_MONOTONIC when the frame was published
+  uint32_t frame_num;     // detector frame number
+  uint8_t  left_found;
+  uint8_t  right_found;
+  uint8_t  pad[2];
+  int16_t  left[4];       // x1, y1, x2, y2 at the ROI top and bottom
+  int16_t  right[4];
+} __attribute__((aligned(64))) shmring_slot_t;
+
+/* @brief Segment header, written once by the writer before readers attach
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_slots;
+  uint32_t width;
+  uint32_t height;
+  uint32_t channels;      // 3 for BGR
+  uint32_t stride;        // bytes per row
+  uint32_t slot_bytes;    // bytes reserved per frame
+  uint64_t meta_offset;   // offset of shmring_slot_t[0]
+  uint64_t data_offset;   // offset of the pixels of slot 0
+  uint64_t total_bytes;   // size of the whole segment
+  uint64_t head;          // last completely published seq, 0 for none
+} shmring_header_t;
+
+/* @brief Lane result published with a frame
+ */
+typedef struct {
+  uint64_t t_capture_ns;
+  uint32_t frame_num;
+  bool left_found;
+  bool right_found;
+  int left[4];
+  int right[4];
+} shmring_info_t;
+
+/* @brief The writer side of the ring, owned by the lane detection process
+ */
+class ShmRingWriter {
+
+private:
+
+  char name[64];
+  int fd;
+  uint8_t* base;
+  shmring_header_t* hdr;
+  shmring_slot_t* slots;
+  uint64_t seq;
+
+public:
+
+  ShmRingWriter();
+  ~ShmRingWriter();
+
+  bool create(const char* shm_name, unsigned int num_slots,
+              unsigned int width, unsigned int height, unsigned int channels);
+  void destroy();
+
+  bool is_open() { return base != NULL; }
+  uint64_t get_published() { return seq; }
+
+  // copies one frame into the next slot and publishes it
+  void publish(const uint8_t* data, size_t stride, const shmring_info_t& info);
+};
+
+/* @brief The reader side, usable from any process
+ */
+typedef struct {
+  int fd;
+  uint8_t* base;
+  size_t bytes;
+  const shmring_header_t* hdr;
+  const shmring_slot_t* slots;
+} shmring_reader_t;
+
+/* @brief Maps an existing ring read-only
+ *
+ * @return true if the segment exists and has a valid header
+ */
+bool shmring_open(shmring_reader_t* r, const char* shm_name);
+void shmring_close(shmring_reader_t* r);
+
+/* @brief Sequence number of the latest published frame, 0 if none yet
+ */
+static inline uint64_t shmring_head(const shmring_reader_t* r) {
+  return __atomic_load_n(&r->hdr->head, __ATOMIC_ACQUIRE);
+}
+
+/* @brief Starts reading frame seq in place
+ *
+ * @param gen, receives the generation to pass to shmring_read_end()
+ * @return pointer to the pixels, or NULL if seq is being overwritten
+ */
+static inline const uint8_t* shmring_read_begin(const shmring_reader_t* r,
+                                                uint64_t seq, uint64_t* gen,
+                                                const shmring_slot_t** meta) {
+  uint32_t i = seq % r->hdr->num_slots;
+  const shmring_slot_t* s = &r->slots[i];
+  *gen = __atomic_load_n(&s->gen, __ATOMIC_ACQUIRE);
+  if ((*gen & 1) || s->seq != seq) return NULL;
+  *meta = s;
+  return r->base + r->hdr->data_offset + (uint64_t)i * r->hdr->slot_bytes;
+}
+
+/* @brief Validates a read started with shmring_read_begin()
+ *
+ * @return true if the writer did not touch the slot during the read, all
+ *         data read from the slot in between may only be trusted if so
+ */
+static inline bool shmring_read_end(const shmring_reader_t* r,
+                                    uint64_t seq, uint64_t gen) {
+  const shmring_slot_t* s = &r->slots[seq % r->hdr->num_slots];
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&s->gen, __ATOMIC_RELAXED) == gen;
+}
+
+#endif // SHMRING_H
@@ -0,0 +1,284 @@
+/* ----------------------------------------------------------------------------
+ * @file snapshot.cpp
+ * @brief Debug snapshot ring, see snapshot.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <opencv2/imgcodecs.hpp>
+
+#include "log.h"
+#include "snapshot.h"
+
+static const char* reason_names[] = {"sample", "lost", "warn", "deadline"};
+#define NUM_REASONS (4)
+
+SnapshotRing::SnapshotRing()
+  : head(0), every(0), triggers(0), frozen(0), writers(0), dumps(0),
+    started(false), quit(0) {
+
+  sem_init(&requests, 0, 0);
+}
+
+SnapshotRing::~SnapshotRing() {
+
+  stop();
+  sem_destroy(&requests);
+}
+
+// see .h for more details
+bool SnapshotRing::start(int num_slots, Size roi_size, int sample_every,
+                         int trigger_mask, const String& dir) {
+
+  if (num_slots <= 0) {
+    return false;
+  }
+
+  slots.resize(num_slots);
+  dumped.resize(num_slots);
+  for (int i = 0; i < num_slots; i++) {
+    slots[i].valid = 0;
+    slots[i].gray.create(roi_size, CV_8UC1);
+    slots[i].median.create(roi_size, CV_8UC1);
+    slots[i].binary.create(roi_size, CV_8UC1);
+    dumped[i].valid = 0;
+    dumped[i].gray.create(roi_size, CV_8UC1);
+    dumped[i].median.create(roi_size, CV_8UC1);
+    dumped[i].binary.create(roi_size, CV_8UC1);
+  }
+  every = sample_every;
+  triggers = trigger_mask;
+  folder = dir;
+
+  quit = 0;
+  if (pthread_create(&thread, NULL, thread_entry, this) != 0) {
+    perror("snapshot pthread_create");
+    return false;
+  }
+  started = true;
+  return true;
+}
+
+// see .h for more details
+snap_slot_t* SnapshotRing::begin() {
+
+  if (frozen) {
+    return NULL;
+  }
+
+  // the dumper sets frozen, then waits for the writers: one of the two
+  // sees the other (both are full barriers)
+  __sync_fetch_and_add(&writers, 1);
+  if (frozen) {
+    __sync_fetch_and_sub(&writers, 1);
+    return NULL;
+  }
+
+  unsigned long n = __sync_fetch_and_add(&head, 1);
+  snap_slot_t* slot = &slots[n % slots.size()];
+  slot->valid = 0;
+  return slot;
+}
+
+// see .h for more details
+void SnapshotRing::commit(snap_slot_t* slot) {
+
+  __sync_synchronize();
+  slot->valid = 1;
+  __sync_fetch_and_sub(&writers, 1);
+}
+
+// see .h for more details
+void SnapshotRing::dump() {
+
+  sem_post(&requests);
+}
+
+// see .h for more details
+void SnapshotRing::stop() {
+
+  if (!started) {
+    return;
+  }
+  quit = 1;
+  sem_post(&requests);
+  pthread_join(thread, NULL);
+  started = false;
+
+  if (head > 0) {
+    write_dump();
+  }
+}
+
+/* @brief Dumper thread: one dump per request
+ */
+void* SnapshotRing::thread_entry(void* arg) {
+
+  SnapshotRing* ring = (SnapshotRing*) arg;
+
+  for (;;) {
+    while (sem_wait(&ring->requests) < 0 && errno == EINTR) {
+    }
+    if (ring->quit) {
+      break;
+    }
+    ring->write_dump();
+  }
+  return NULL;
+}
+
+/* @brief Writes the reasons as "a|b" into buf
+ */
+static void reason_string(int reasons, char* buf, size_t size) {
+
+  buf[0] = '\0';
+  for (int i = 0; i < NUM_REASONS; i++) {
+    if (reasons & (1 << i)) {
+      if (buf[0] != '\0') {
+        strncat(buf, "|", size - strlen(buf) - 1);
+      }
+      strncat(buf, reason_names[i], size - strlen(buf) - 1);
+    }
+  }
+}
+
+/* @brief Copies a slot into a dump buffer slot, the images into its
+ *        preallocated buffers
+ */
+static void copy_slot(const snap_slot_t& s, snap_slot_t& d) {
+
+  d.valid = 1;
+  d.frame = s.frame;
+  d.reasons = s.reasons;
+  d.t_capture = s.t_capture;
+  d.state = s.state;
+  d.has_gray = s.has_gray;
+  d.has_median = s.has_median;
+  d.has_binary = s.has_binary;
+  if (s.has_gray) s.gray.copyTo(d.gray);
+  if (s.has_median) s.median.copyTo(d.median);
+  if (s.has_binary) s.binary.copyTo(d.binary);
+  for (int side = 0; side < 2; side++) {
+    d.peaks[side] = s.peaks[side];
+    for (int p = 0; p < s.peaks[side]; p++) {
+      d.peak[side][p] = s.peak[side][p];
+    }
+  }
+}
+
+/* @brief Copies the valid slots out, oldest first, then writes the copy
+ *        into the next dump folder
+ *
+ * The ring is frozen only for the copy, so snapshots taken while the PNGs
+ * are encoded are kept for the next dump.
+ */
+void SnapshotRing::write_dump() {
+
+  frozen = 1;
+  __sync_synchronize();
+  while (writers > 0) {
+    sched_yield();
+  }
+
+  int count = 0;
+  size_t n = slots.size();
+  unsigned long taken = head;
+  for (size_t i = 0; i < n; i++) {
+    const snap_slot_t& s = slots[(taken + i) % n];
+    if (s.valid) {
+      copy_slot(s, dumped[count++]);
+    }
+  }
+
+  __sync_synchronize();
+  frozen = 0;
+
+  char dir[512], path[600], reasons[64];
+  snprintf(dir, sizeof(dir), "%s/dump_%03u", folder.c_str(), dumps++);
+  mkdir(folder.c_str(), 0755);
+  if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+    perror("snapshot mkdir");
+    return;
+  }
+
+  snprintf(path, sizeof(path), "%s/index.csv", dir);
+  FILE* index = fopen(path, "w");
+  if (index == NULL) {
+    perror("snapshot index fopen");
+    return;
+  }
+  fprintf(index, "frame,reasons,t_capture,left_found,right_found,offset,"
+          "warning,degrade,thresh_l,thresh_r,peaks_l,peaks_r\n");
+
+  int written = 0;
+  for (int i = 0; i < count; i++) {
+
+    const snap_slot_t& s = dumped[i];
+
+    reason_string(s.reasons, reasons, sizeof(reasons));
+    fprintf(index, "%u,%s,%.3f,%i,%i,%i,%i,%i,%i,%i,", s.frame, reasons,
+            s.t_capture, s.state.is_left_found, s.state.is_right_found,
+            s.state.offset, (int)s.state.warning, (int)s.state.degrade,
+            s.state.thresh[0], s.state.thresh[1]);
+    for (int side = 0; side < 2; side++) {
+      // rho:theta:votes separated by spaces, strongest first
+      for (int p = 0; p < s.peaks[side]; p++) {
+        fprintf(index, "%s%.1f:%.4f:%.0f", p ? " " : "", s.peak[side][p][0],
+                s.peak[side][p][1], s.peak[side][p][2]);
+      }
+      fprintf(index, side ? "\n" : ",");
+    }
+
+    if (s.has_gray) {
+      snprintf(path, sizeof(path), "%s/%08u_gray.png", dir, s.frame);
+      imwrite(path, s.gray);
+    }
+    if (s.has_median) {
+      snprintf(path, sizeof(path), "%s/%08u_median.png", dir, s.frame);
+      imwrite(path, s.median);
+    }
+    if (s.has_binary) {
+      snprintf(path, sizeof(path), "%s/%08u_binary.png", dir, s.frame);
+      imwrite(path, s.binary);
+    }
+    written++;
+  }
+  fclose(index);
+
+  LOGP("snapshots, dump %u: %i frames to %s (%lu taken)\n", dumps-1, written,
+       dir, taken);
+}
+
+// see .h for more details
+int snapshot_parse_triggers(const char* spec) {
+
+  char buf[128];
+  strncpy(buf, spec, sizeof(buf)-1);
+  buf[sizeof(buf)-1] = '\0';
+
+  int mask = 0;
+  for (char* save = NULL, *item = strtok_r(buf, ",", &save); item != NULL;
+       item = strtok_r(NULL, ",", &save)) {
+    if (strcmp(item, "all") == 0) {
+      mask |= SNAP_TRIGGERS;
+    } else if (strcmp(item, "none") == 0) {
+      continue;
+    } else if (strcmp(item, "lost") == 0) {
+      mask |= SNAP_LOST;
+    } else if (strcmp(item, "warn") == 0) {
+      mask |= SNAP_WARN;
+    } else if (strcmp(item, "deadline") == 0) {
+      mask |= SNAP_DEADLINE;
+    } else {
+      fprintf(stderr, "snapshot: unknown trigger '%s'\n", item);
+      return -1;
+    }
+  }
+  return mask;
+}
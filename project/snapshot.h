@@ -0,0 +1,135 @@
+/* ----------------------------------------------------------------------------
+ * @file snapshot.h
+ * @brief Debug snapshot ring: the intermediate images of sampled and of
+ *        suspicious frames, kept in memory and written out on demand
+ *
+ * A detector with a ring (LaneDetector::set_snapshots()) copies the ROI of
+ * a frame into the next slot when the frame is sampled (every Nth) or a
+ * trigger fires:
+ *
+ *   lost      a lane line was found on the previous frame, not on this one
+ *   warn      the departure warning rose to warn or depart
+ *   deadline  a step of the frame missed its budget (see deadline.h) or
+ *             the budgeted mode missed its deadline (see set_budget())
+ *
+ * A slot holds the gray, median filtered and binary ROI, the strongest
+ * Hough peaks of each side and the detection result. The buffers are
+ * allocated when the ring is opened, a snapshot costs three ROI copies.
+ * A detector only has what it computed: in the pipeline the hough node
+ * takes the snapshots, of the binary ROI and the peaks.
+ *
+ * The ring is written by a dumper thread, on dump() (async signal safe,
+ * main calls it on SIGUSR1) and when the ring is stopped. Each dump goes
+ * to its own folder dump_<n> with PNGs named by frame and an index.csv.
+ * A dump copies the valid slots into a dump buffer allocated with the
+ * ring, and only then encodes the PNGs. Snapshots are skipped only
+ * during that copy (three ROI copies per slot), not while encoding.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <vector>
+#include <pthread.h>
+#include <semaphore.h>
+#include <opencv2/core.hpp>
+
+#include "lane.h"
+
+using namespace cv;
+
+#define SNAP_PEAKS (8)    // Hough peaks kept per side
+
+// why a frame was taken, a set of bits
+typedef enum {
+  SNAP_SAMPLE   = 1,
+  SNAP_LOST     = 2,
+  SNAP_WARN     = 4,
+  SNAP_DEADLINE = 8,
+  SNAP_TRIGGERS = SNAP_LOST | SNAP_WARN | SNAP_DEADLINE
+} snap_reason_t;
+
+/* @brief One snapshot
+ */
+typedef struct {
+  volatile int valid;         // 0 while written or never used
+  unsigned int frame;
+  int reasons;
+  double t_capture;           // msec
+  lane_state_t state;
+  bool has_gray, has_median, has_binary;
+  Mat gray, median, binary;   // ROI size
+  int peaks[2];
+  Vec3f peak[2][SNAP_PEAKS];  // rho (ROI pixels), theta, votes
+} snap_slot_t;
+
+/* @brief The ring, shared by all detectors of a process
+ */
+class SnapshotRing {
+
+private:
+
+  std::vector<snap_slot_t> slots;
+  std::vector<snap_slot_t> dumped;  // the valid slots of a dump, oldest first
+  unsigned long head;         // slots taken so far
+  int every;                  // sampling period, 0 for triggers only
+  int triggers;               // SNAP_* bits that take a snapshot
+  String folder;
+
+  volatile int frozen;        // set while a dump copies the ring out
+  volatile int writers;       // snapshots being written
+  unsigned int dumps;
+
+  pthread_t thread;
+  bool started;
+  volatile int quit;
+  sem_t requests;
+
+  static void* thread_entry(void* arg);
+  void write_dump();
+
+public:
+
+  SnapshotRing();
+  ~SnapshotRing();
+
+  /* @brief Allocates the slots and starts the dumper thread
+   *
+   * @param num_slots, snapshots kept
+   * @param roi_size, the ROI size of the frames
+   * @param sample_every, samples every Nth frame, 0 for none
+   * @param trigger_mask, SNAP_* trigger bits
+   * @param dir, the dumps go to dir/dump_<n>/
+   */
+  bool start(int num_slots, Size roi_size, int sample_every,
+             int trigger_mask, const String& dir);
+
+  // the reasons to take a frame with the triggers it fired, 0 for none
+  int wanted(unsigned int frame, int fired) {
+    return ((every > 0 && frame % every == 0) ? SNAP_SAMPLE : 0)
+           | (fired & triggers);
+  }
+
+  // a slot to fill, NULL while a dump copies the ring, commit() when filled
+  snap_slot_t* begin();
+  void commit(snap_slot_t* slot);
+
+  // requests a dump, async signal safe
+  void dump();
+
+  // dumps the ring a last time and stops the dumper thread
+  void stop();
+
+  unsigned long get_taken() { return head; }
+};
+
+/* @brief Parses trigger names ("lost,warn,deadline", "all" or "none")
+ *
+ * @return the SNAP_* bits, -1 on an unknown name
+ */
+int snapshot_parse_triggers(const char* spec);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,499 @@
+/* ----------------------------------------------------------------------------
+ * @file source.cpp
+ * @brief Frame sources for the capture thread
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <opencv2/imgproc.hpp>
+
+#include "log.h"
+#include "source.h"
+#include "yuv.h"
+
+// see .h for more details
+bool FrameSource::read_yuv(Mat& i420) {
+
+  Mat bgr;
+  if (!read(bgr)) {
+    return false;
+  }
+  cvtColor(bgr, i420, COLOR_BGR2YUV_I420);
+  return true;
+}
+
+/* @brief Opens a video and seeks to the start position
+ *
+ * @param path, the video file
+ * @param start_msec, position to start reading from
+ * @return true if the video could be opened
+ */
+bool VideoSource::open(const String& path, double start_msec) {
+
+  if (!cap.open(path)) {
+    return false;
+  }
+  if (start_msec > 0.0) {
+    cap.set(CAP_PROP_POS_MSEC, start_msec);
+  }
+  base = cap.get(CAP_PROP_POS_FRAMES);
+  return true;
+}
+
+bool VideoSource::read(Mat& img) {
+
+  cap >> img;
+  return !img.empty();
+}
+
+/* @brief Seeks to a frame, the FFmpeg backend decodes forward from the 
+ *        keyframe before it, so seeks to keyframes are the cheapest
+ */
+bool VideoSource::seek(unsigned int n) {
+
+  return cap.set(CAP_PROP_POS_FRAMES, base + n);
+}
+
+unsigned int VideoSource::get_frame_count() {
+
+  double frames = cap.get(CAP_PROP_FRAME_COUNT) - base;
+  return (frames > 0) ? (unsigned int)frames : 0;
+}
+
+Size VideoSource::get_size() {
+
+  return Size((int)cap.get(CAP_PROP_FRAME_WIDTH), 
+              (int)cap.get(CAP_PROP_FRAME_HEIGHT));
+}
+
+SynthSource::SynthSource() {
+
+  road = NULL;
+  next = 0;
+  truth_file = NULL;
+}
+
+SynthSource::~SynthSource() {
+
+  if (truth_file != NULL) {
+    fclose(truth_file);
+  }
+  delete road;
+}
+
+/* @brief Creates the generator from a spec string
+ *
+ * @param spec, the "synth:..." spec
+ * @param truth_path, CSV file for the ground truth, may be empty
+ * @return false if the spec or the truth file is invalid
+ */
+bool SynthSource::open(const String& spec, const String& truth_path) {
+
+  synth_config_t cfg;
+  if (!synth_parse(spec, cfg)) {
+    return false;
+  }
+
+  if (!truth_path.empty()) {
+    truth_file = fopen(truth_path.c_str(), "w");
+    if (truth_file == NULL) {
+      perror("synth truth fopen");
+      return false;
+    }
+    synth_write_truth_header(truth_file);
+  }
+
+  road = new SyntheticRoad(cfg);
+  next = 0;
+  return true;
+}
+
+bool SynthSource::read(Mat& img) {
+
+  synth_truth_t truth;
+  unsigned int frames = road->get_config().frames;
+
+  if (frames != 0 && next >= frames) {
+    return false;
+  }
+
+  road->render(next, img, truth);
+  if (truth_file != NULL) {
+    synth_write_truth(truth_file, truth);
+  }
+  next++;
+  return true;
+}
+
+RawSource::RawSource() {
+
+  fd = -1;
+  map = NULL;
+  map_size = 0;
+  format = RAW_BGR;
+  fps = 0.0;
+  frame_bytes = 0;
+  next = 0;
+  released = 0;
+  release_after = RAW_RELEASE_FRAMES;
+  page_size = 4096;
+}
+
+RawSource::~RawSource() {
+
+  if (map != NULL) {
+    munmap(map, map_size);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+/* @brief Maps the whole file copy-on-write, for sequential reading
+ */
+bool RawSource::map_file(const String& path) {
+
+  struct stat st;
+
+  fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    perror("raw open");
+    return false;
+  }
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    fprintf(stderr, "raw: %s is empty\n", path.c_str());
+    return false;
+  }
+
+  // writable so the stages can draw into the frames, private so the
+  // drawings never reach the file
+  map_size = st.st_size;
+  void* p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) {
+    perror("raw mmap");
+    return false;
+  }
+  map = (uint8_t*)p;
+
+  // 4K, 16K or 64K depending on the kernel, madvise() needs it aligned
+  long page = sysconf(_SC_PAGESIZE);
+  page_size = (page > 0) ? (size_t)page : 4096;
+
+  // larger readahead, pages behind are dropped early. Locked pages (real-
+  // time memory mode, see rtmem.h) could not be dropped.
+  madvise(map, map_size, MADV_SEQUENTIAL);
+  munlock(map, map_size);
+  return true;
+}
+
+/* @brief Parses the Y4M stream header and indexes the FRAME headers
+ */
+bool RawSource::parse_y4m() {
+
+  const char* p = (const char*)map;
+  const char* end = p + map_size;
+  const char* eol = (const char*)memchr(p, '\n', map_size);
+
+  if (map_size < 10 || memcmp(p, "YUV4MPEG2 ", 10) != 0 || eol == NULL) {
+    fprintf(stderr, "raw: not a YUV4MPEG2 file\n");
+    return false;
+  }
+
+  // W<width> H<height> F<num>:<den> C<colorspace>, others are ignored
+  String header(p + 10, eol);
+  format = RAW_I420;
+  size_t pos = 0;
+  while (pos < header.size()) {
+
+    size_t space = header.find(' ', pos);
+    if (space == String::npos) space = header.size();
+    String item = header.substr(pos, space-pos);
+    pos = space+1;
+    if (item.empty()) continue;
+
+    int num, den;
+    switch (item[0]) {
+      case 'W': size.width = atoi(item.c_str()+1); break;
+      case 'H': size.height = atoi(item.c_str()+1); break;
+      case 'F':
+        if (sscanf(item.c_str()+1, "%d:%d", &num, &den) == 2 && den > 0) {
+          fps = (double)num/den;
+        }
+        break;
+      case 'C':
+        if (item == "Cmono") {
+          format = RAW_GRAY;
+        } else if (item.compare(0, 4, "C420") != 0 
+                   || (item.size() > 5 && item[4] == 'p' && isdigit(item[5]))) {
+          // C420jpeg, C420paldv and C420mpeg2 differ only in chroma siting,
+          // C420p10 and the 4:2:2/4:4:4 layouts are not supported
+          fprintf(stderr, "raw: unsupported Y4M colorspace %s\n", item.c_str());
+          return false;
+        }
+        break;
+    }
+  }
+
+  if (size.width <= 0 || size.height <= 0 
+      || (format != RAW_GRAY && (size.width % 2 || size.height % 2))) {
+    fprintf(stderr, "raw: bad Y4M frame size %dx%d\n", size.width, size.height);
+    return false;
+  }
+  frame_bytes = (format == RAW_GRAY) ? (size_t)size.area() : (size_t)size.area()*3/2;
+
+  // every frame is "FRAME[ params]\n" followed by the planes
+  p = eol + 1;
+  while (p < end) {
+    eol = (const char*)memchr(p, '\n', end - p);
+    if (eol == NULL || end - p < 5 || memcmp(p, "FRAME", 5) != 0) {
+      break;
+    }
+    if ((size_t)(end - (eol + 1)) < frame_bytes) {
+      fprintf(stderr, "raw: truncated last frame dropped\n");
+      break;
+    }
+    offsets.push_back((const uint8_t*)(eol + 1) - map);
+    p = eol + 1 + frame_bytes;
+  }
+  return true;
+}
+
+/* @brief Headerless files are back to back frames of frame_bytes
+ */
+void RawSource::index_raw() {
+
+  for (size_t off = 0; off + frame_bytes <= map_size; off += frame_bytes) {
+    offsets.push_back(off);
+  }
+  if (map_size % frame_bytes) {
+    fprintf(stderr, "raw: %lu trailing bytes ignored\n", 
+            (unsigned long)(map_size % frame_bytes));
+  }
+}
+
+/* @brief Opens and indexes a Y4M file or a raw spec
+ *
+ * @param spec, a .y4m file, or "raw:WxH,fmt=...,fps=...,path=file" where 
+ *              path comes last (it may contain commas)
+ * @return false if the spec is malformed or the file cannot be mapped
+ */
+bool RawSource::open(const String& spec) {
+
+  String path;
+  bool y4m = spec.compare(0, 4, "raw:") != 0;
+
+  if (y4m) {
+    path = spec;
+  } else {
+
+    size = Size(1280, 720);
+    format = RAW_BGR;
+    fps = 30.0;
+
+    String s = spec.substr(4);
+    size_t pos = 0;
+    while (pos < s.size()) {
+
+      if (s.compare(pos, 5, "path=") == 0) {
+        path = s.substr(pos+5);
+        break;
+      }
+      size_t comma = s.find(',', pos);
+      if (comma == String::npos) comma = s.size();
+      String item = s.substr(pos, comma-pos);
+      pos = comma+1;
+      if (item.empty()) continue;
+
+      int w, h;
+      if (sscanf(item.c_str(), "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+        size = Size(w, h);
+      } else if (item == "fmt=bgr") {
+        format = RAW_BGR;
+      } else if (item == "fmt=gray") {
+        format = RAW_GRAY;
+      } else if (item == "fmt=i420") {
+        format = RAW_I420;
+      } else if (item == "fmt=nv12") {
+        format = RAW_NV12;
+      } else if (item.compare(0, 4, "fps=") == 0) {
+        fps = atof(item.c_str()+4);
+      } else {
+        fprintf(stderr, "raw: bad spec item '%s'\n", item.c_str());
+        return false;
+      }
+    }
+
+    if (path.empty()) {
+      fprintf(stderr, "raw: spec needs a path=file item\n");
+      return false;
+    }
+    if (format >= RAW_I420 && (size.width % 2 || size.height % 2)) {
+      fprintf(stderr, "raw: 4:2:0 frames need an even size\n");
+      return false;
+    }
+    switch (format) {
+      case RAW_BGR:  frame_bytes = (size_t)size.area()*3; break;
+      case RAW_GRAY: frame_bytes = (size_t)size.area(); break;
+      default:       frame_bytes = (size_t)size.area()*3/2; break;
+    }
+  }
+
+  if (!map_file(path)) {
+    return false;
+  }
+  if (y4m) {
+    if (!parse_y4m()) {
+      return false;
+    }
+  } else {
+    index_raw();
+  }
+
+  LOGP("raw: %s, %dx%d, %lu frames, %.2f fps\n", path.c_str(), 
+       size.width, size.height, (unsigned long)offsets.size(), fps);
+  next = 0;
+  released = 0;
+  return !offsets.empty();
+}
+
+/* @brief The pixel data of the next frame, NULL at the end of the file
+ */
+uint8_t* RawSource::next_frame() {
+
+  if (next >= offsets.size()) {
+    return NULL;
+  }
+  uint8_t* data = map + offsets[next];
+  next++;
+
+  // drop the pages of old frames, copy-on-write pages included, which 
+  // keeps the resident size flat over long recordings
+  if (next > released + release_after) {
+    unsigned int keep = next - release_after;
+    size_t from = offsets[released] & ~(page_size - 1);
+    size_t to = offsets[keep] & ~(page_size - 1);
+    if (to > from && madvise(map + from, to - from, MADV_DONTNEED) < 0) {
+      perror("raw madvise");
+    }
+    released = keep;
+  }
+  return data;
+}
+
+bool RawSource::seek(unsigned int n) {
+
+  if (n > offsets.size()) {
+    return false;
+  }
+  next = n;
+  released = n;
+  return true;
+}
+
+bool RawSource::read(Mat& img) {
+
+  uint8_t* data = next_frame();
+  if (data == NULL) {
+    return false;
+  }
+
+  switch (format) {
+    case RAW_BGR:
+      // zero copy, img only references the mapping
+      img = Mat(size, CV_8UC3, data);
+      break;
+    case RAW_GRAY:
+      cvtColor(Mat(size, CV_8UC1, data), img, COLOR_GRAY2BGR);
+      break;
+    case RAW_I420:
+      cvtColor(Mat(size.height*3/2, size.width, CV_8UC1, data), img, 
+               COLOR_YUV2BGR_I420);
+      break;
+    case RAW_NV12:
+      cvtColor(Mat(size.height*3/2, size.width, CV_8UC1, data), img, 
+               COLOR_YUV2BGR_NV12);
+      break;
+  }
+  return true;
+}
+
+bool RawSource::read_yuv(Mat& i420) {
+
+  uint8_t* data = next_frame();
+  if (data == NULL) {
+    return false;
+  }
+
+  if (format == RAW_I420) {
+    // zero copy, as it is in the file
+    i420 = Mat(size.height*3/2, size.width, CV_8UC1, data);
+    return true;
+  }
+  if (format == RAW_BGR) {
+    cvtColor(Mat(size, CV_8UC3, data), i420, COLOR_BGR2YUV_I420);
+    return true;
+  }
+
+  // gray and NV12 keep their luma, only the chroma is rearranged
+  Mat planes[3];
+  i420.create(size.height*3/2, size.width, CV_8UC1);
+  yuv_planes(i420, planes);
+  Mat(size, CV_8UC1, data).copyTo(planes[0]);
+
+  if (format == RAW_GRAY) {
+    planes[1] = Scalar(128);
+    planes[2] = Scalar(128);
+  } else {
+    Mat uv(size.height/2, size.width/2, CV_8UC2, data + size.area());
+    Mat chroma[2] = {planes[1], planes[2]};
+    split(uv, chroma);
+  }
+  return true;
+}
+
+static bool has_suffix(const String& s, const char* suffix) {
+
+  size_t n = strlen(suffix);
+  return s.size() >= n && strcasecmp(s.c_str() + s.size() - n, suffix) == 0;
+}
+
+// see .h for more details
+FrameSource* open_source(const String& input, const String& truth_path) {
+
+  if (input.compare(0, 5, "synth") == 0) {
+    SynthSource* synth = new SynthSource();
+    if (!synth->open(input, truth_path)) {
+      delete synth;
+      return NULL;
+    }
+    return synth;
+  }
+
+  if (input.compare(0, 4, "raw:") == 0 || has_suffix(input, ".y4m")) {
+    RawSource* raw = new RawSource();
+    if (!raw->open(input)) {
+      fprintf(stderr, "cannot open input %s\n", input.c_str());
+      delete raw;
+      return NULL;
+    }
+    return raw;
+  }
+
+  // the first 10 seconds of the challenge clips are skipped
+  VideoSource* video = new VideoSource();
+  if (!video->open(input, 10000)) {
+    fprintf(stderr, "cannot open input %s\n", input.c_str());
+    delete video;
+    return NULL;
+  }
+  return video;
+}
@@ -0,0 +1,179 @@
+/* ----------------------------------------------------------------------------
+ * @file source.h
+ * @brief Frame sources for the capture thread
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "synth.h"
+
+using namespace cv;
+
+/* @brief A sequential source of BGR frames
+ */
+class FrameSource {
+
+public:
+
+  virtual ~FrameSource() {}
+
+  // reads the next frame into img, false at the end of the source
+  virtual bool read(Mat& img) = 0;
+
+  // reads the next frame as I420 (see yuv.h), by default converted from
+  // the BGR frame, false at the end of the source
+  virtual bool read_yuv(Mat& i420);
+
+  // nominal frame rate of the source, 0 if unknown
+  virtual double get_fps() = 0;
+
+  // positions the source at frame n, 0 being the first frame after open(),
+  // false if the source cannot seek
+  virtual bool seek(unsigned int n) { return false; }
+
+  // frames from the open position to the end, 0 if unknown or unbounded
+  virtual unsigned int get_frame_count() { return 0; }
+
+  // the frame size, empty if unknown before the first frame
+  virtual Size get_size() { return Size(); }
+
+  // frames read that may still be in use downstream, e.g. the frames in
+  // flight in a pipeline, which the source must keep intact
+  virtual void set_frames_held(unsigned int frames) {}
+};
+
+/* @brief Frames decoded from a video file (or camera) by VideoCapture
+ */
+class VideoSource : public FrameSource {
+
+private:
+
+  VideoCapture cap;
+  double base;    // frame position after open()
+
+public:
+
+  bool open(const String& path, double start_msec);
+  virtual ~VideoSource() { cap.release(); }
+
+  virtual bool read(Mat& img);
+  virtual double get_fps() { return cap.get(CAP_PROP_FPS); }
+  virtual bool seek(unsigned int n);
+  virtual unsigned int get_frame_count();
+  virtual Size get_size();
+};
+
+/* @brief Frames rendered by the synthetic road generator, with the ground 
+ *        truth optionally written to a CSV file as the frames are read
+ */
+class SynthSource : public FrameSource {
+
+private:
+
+  SyntheticRoad* road;
+  unsigned int next;
+  FILE* truth_file;
+
+public:
+
+  SynthSource();
+  virtual ~SynthSource();
+
+  bool open(const String& spec, const String& truth_path);
+
+  virtual bool read(Mat& img);
+  virtual double get_fps() { return road->get_config().fps; }
+
+  // frames are rendered from their number, any frame can be read next
+  virtual bool seek(unsigned int n) { next = n; return true; }
+  virtual unsigned int get_frame_count() { return road->get_config().frames; }
+  virtual Size get_size() { return road->get_config().size; }
+};
+
+// pixel layouts of uncompressed frames
+typedef enum {
+  RAW_BGR,      // packed 8-bit BGR, handed out without a copy
+  RAW_GRAY,     // 8-bit luma only
+  RAW_I420,     // planar Y, U, V 4:2:0 (also Y4M C420*)
+  RAW_NV12      // planar Y, interleaved UV 4:2:0
+} raw_format_t;
+
+// frames behind the read position whose written pages are given back, at
+// least, see RawSource::set_frames_held()
+#define RAW_RELEASE_FRAMES 64
+
+/* @brief Uncompressed frames from a memory-mapped Y4M or headerless raw
+ *        file, e.g. pre-decoded recordings, to run without decode cost
+ *
+ * The file is mapped MAP_PRIVATE with sequential readahead. BGR frames
+ * (and I420 frames read with read_yuv()) are Mat headers into the mapping,
+ * without a copy; the other layouts are converted straight from the
+ * mapping. Stages that draw into a
+ * frame get private copy-on-write pages, the file is never modified.
+ * Those pages are dropped once the read position is far enough ahead:
+ * RAW_RELEASE_FRAMES frames, or more after set_frames_held(), which the
+ * pipeline sets to its in-flight bound so no frame in flight loses its
+ * drawings.
+ */
+class RawSource : public FrameSource {
+
+private:
+
+  int fd;
+  uint8_t* map;
+  size_t map_size;
+  Size size;
+  raw_format_t format;
+  double fps;
+  std::vector<size_t> offsets;  // of the pixel data of every frame
+  size_t frame_bytes;
+  unsigned int next;
+  unsigned int released;        // frames whose pages were released
+  unsigned int release_after;   // frames kept behind the read position
+  size_t page_size;             // of the mapping, from sysconf() at open
+
+  bool map_file(const String& path);
+  bool parse_y4m();
+  void index_raw();
+  uint8_t* next_frame();
+
+public:
+
+  RawSource();
+  virtual ~RawSource();
+
+  // a .y4m file, or a "raw:WxH,fmt=bgr|gray|i420|nv12,fps=N,path=file" spec
+  bool open(const String& spec);
+
+  virtual bool read(Mat& img);
+  virtual bool read_yuv(Mat& i420);
+  virtual double get_fps() { return fps; }
+  virtual bool seek(unsigned int n);
+  virtual unsigned int get_frame_count() { return offsets.size(); }
+  virtual Size get_size() { return size; }
+  virtual void set_frames_held(unsigned int frames) {
+    release_after = (frames > RAW_RELEASE_FRAMES) ? frames
+                                                  : RAW_RELEASE_FRAMES;
+  }
+};
+
+/* @brief Opens the source named by --input
+ *
+ * @param input, a video path, a "synth:..." spec (see synth.h), a .y4m file
+ *              or a "raw:..." spec (see RawSource)
+ * @param truth_path, CSV file for the synthetic ground truth, may be empty
+ * @return the opened source, or NULL on error
+ */
+FrameSource* open_source(const String& input, const String& truth_path);
+
+#endif // SOURCE_H
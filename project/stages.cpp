@@ -0,0 +1,732 @@
+/* ----------------------------------------------------------------------------
+ * @file stages.cpp
+ * @brief The lane detection pipeline stages, see stages.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <float.h>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/highgui.hpp>
+
+#include "lane.h"
+#include "scan_lane.h"
+#include "stages.h"
+#include "deadline.h"
+#include "rtmem.h"
+#include "yuv.h"
+
+/* @brief Reads frames from the source, paced like the former capture thread
+ */
+class DecodeStage : public Stage {
+
+  stage_context_t *ctx;
+  unsigned int framecnt;
+
+public:
+
+  DecodeStage(stage_context_t *context) : ctx(context), framecnt(0) {}
+
+  bool process(frame_t& frame) {
+
+    if (ctx->replay != NULL) {
+      // paced by the replay clock, only look for the quit key
+      if (!ctx->show_pipeline) {
+        char user_input = waitKey(1);
+        if ( user_input == 'q' ) return false;
+      }
+    } else if (framecnt > 0) {
+      if (ctx->show_pipeline) {
+        // the display thread owns the GUI, just keep the same pacing here
+        struct timespec pace_time = {0, 20*MSEC_TO_NSEC};
+        nanosleep(&pace_time, NULL);
+      } else {
+        char user_input = waitKey(20);
+        if ( user_input == 'q' ) return false;
+      }
+    }
+
+    // a recycled frame (see Pipeline::prealloc_frames()) is read into its
+    // own buffer, unless the display or the preview still holds it
+    if (frame.img.u != NULL && frame.img.u->refcount > 1) {
+      frame.img.release();
+    }
+    frame.jpeg.clear();
+
+    double t_arrival;
+    bool stale;
+    do {
+      uint64_t start = time_now_ns();
+      frame.yuv = ctx->yuv;
+      bool ok = frame.yuv ? ctx->source->read_yuv(frame.img) 
+                          : ctx->source->read(frame.img);
+      if ( !ok ) {
+        LOGSYS("decode, source empty, nframes: %i\n", framecnt);
+        return false;
+      }
+      deadline_check(DEADLINE_DECODE, framecnt, time_now_ns() - start);
+
+      // decoded ahead, released when the camera would have delivered it
+      stale = false;
+      t_arrival = ctx->replay ? ctx->replay->wait(stale) : get_time_msec();
+      if (stale) {
+        ctx->replay->drop();
+      }
+    } while (stale);
+
+    frame.id = framecnt++;
+    if (frame.id == RTMEM_WARMUP_FRAMES) {
+      rtmem_steady();
+    }
+    frame.t_capture = t_arrival;
+    // zeroed, in case the chain has no detection nodes
+    frame.state = lane_state_t();
+    return true;
+  }
+};
+
+/* @brief The detector of the preprocess and hough nodes, of the engine
+ *        the context selects
+ */
+static LaneDetector* new_detector(stage_context_t *context) {
+
+  if (context->scan_lines > 0) {
+    ScanLaneDetector* scan = new ScanLaneDetector();
+    scan->set_scan_lines(context->scan_lines);
+    return scan;
+  }
+  return new LaneDetector();
+}
+
+/* @brief Grayscale, ROI, median filter and threshold, leaves the binary ROI
+ *        in frame.roi
+ */
+class PreprocessStage : public Stage {
+
+  LaneDetector* detector;
+
+public:
+
+  // in budgeted mode the filter and threshold are skipped when they do not
+  // fit, the hough node then keeps the previous lines
+  PreprocessStage(stage_context_t *context) {
+    detector = new_detector(context);
+    detector->set_task_pool(context->pool, context->strips);
+    detector->set_budget(context->budget);
+  }
+
+  ~PreprocessStage() {
+    delete detector;
+  }
+
+  bool process(frame_t& frame) {
+
+    if (frame.yuv) {
+      detector->input_yuv(frame.img, frame.t_capture);
+    } else {
+      detector->input_image(frame.img, frame.t_capture);
+    }
+    detector->to_gray();
+    detector->extract_roi();
+    frame.roi_skipped = !detector->preprocess_roi();
+    if (!frame.roi_skipped) {
+      detector->copy_roi(frame.roi);
+    }
+    return true;
+  }
+};
+
+/* @brief Hough transform and end points of the lane lines
+ */
+class HoughStage : public Stage {
+
+  LaneDetector* detector;
+  unsigned long frames;
+  unsigned long thresh_sum[2], cand_sum[2];
+  bool budget;
+
+public:
+
+  // with the adaptive threshold, each replica adapts to the frames it sees
+  HoughStage(stage_context_t *context) : frames(0) {
+    detector = new_detector(context);
+    detector->set_task_pool(context->pool, context->strips);
+    detector->set_acc_thresh(context->acc_thresh);
+    detector->set_adaptive_thresh(context->adaptive_thresh);
+    detector->set_budget(context->budget);
+    detector->set_snapshots(context->snapshots);
+    budget = context->budget > 0.0;
+    thresh_sum[0] = thresh_sum[1] = cand_sum[0] = cand_sum[1] = 0;
+  }
+
+  ~HoughStage() {
+    delete detector;
+  }
+
+  bool process(frame_t& frame) {
+
+    Vec4i left, right;
+
+    detector->load_roi(frame.roi_skipped ? Mat() : frame.roi,
+                       frame_size(frame), frame.t_capture);
+    detector->hough_transform(left, right);
+    detector->find_endpoints(left, right);
+    detector->snapshot(frame.id);
+    detector->get_state(frame.state);
+    frame.state.frame_num = frame.id;
+
+    frames++;
+    for (int i = 0; i < 2; i++) {
+      thresh_sum[i] += frame.state.thresh[i];
+      cand_sum[i] += frame.state.candidates[i];
+    }
+    return true;
+  }
+
+  void finish() {
+    if (frames > 0) {
+      LOGP("hough, frames: %lu, avg threshold L/R: %.1f/%.1f, "
+           "avg candidates L/R: %.1f/%.1f\n", frames,
+           (double)thresh_sum[0]/frames, (double)thresh_sum[1]/frames,
+           (double)cand_sum[0]/frames, (double)cand_sum[1]/frames);
+    }
+    if (budget) {
+      stages_print_degrade("hough", *detector);
+    }
+  }
+};
+
+/* @brief Lane departure transition handler, runs as soon as the decision
+ *        is made, before any annotation or encoding
+ */
+static void lane_event_handler(const lane_event_t& ev, void* arg) {
+
+  stage_context_t *ctx = (stage_context_t *) arg;
+  double t_event = get_time_msec();
+
+  if (ctx->events) {
+    ctx->events->send(ev, t_event);
+  }
+  if (ev.t_capture > 0.0) {
+    latency_stat_add(&ctx->event_lat, t_event - ev.t_capture);
+    ctx->event_hist.observe(t_event - ev.t_capture);
+  }
+  metric_add(&ctx->warnings[ev.warning], 1);
+
+  LOGSYS("lane warning %i -> %i, frame: %u, offset: %i",
+         (int)ev.prev, (int)ev.warning, ev.frame_num, ev.offset);
+}
+
+/* @brief Lane departure decision, keeps the level of the previous frame
+ */
+class DecideStage : public Stage {
+
+  stage_context_t *ctx;
+  LaneDetector detector;
+
+public:
+
+  DecideStage(stage_context_t *context) : ctx(context) {
+    detector.set_event_callback(lane_event_handler, ctx);
+  }
+
+  bool process(frame_t& frame) {
+
+    detector.load_state(frame.state, frame_size(frame), frame.t_capture);
+    detector.decide();
+    double t_decision = get_time_msec() - frame.t_capture;
+    latency_stat_add(&ctx->decision_lat, t_decision);
+    ctx->decision_hist.observe(t_decision);
+    detector.get_state(frame.state);
+
+    metric_add(&ctx->decided, 1);
+    metric_add(&ctx->lanes_found[0], frame.state.is_left_found ? 1 : 0);
+    metric_add(&ctx->lanes_found[1], frame.state.is_right_found ? 1 : 0);
+    metric_set(&ctx->warning, frame.state.warning);
+    metric_set(&ctx->offset, frame.state.offset);
+    return true;
+  }
+};
+
+/* @brief Draws the lane lines and the decision into the frame, in place
+ *
+ * The per-frame processing time (proc_min/proc_max of a single detector)
+ * is taken here across the nodes, from capture to the annotated frame.
+ */
+class AnnotateStage : public Stage {
+
+  stage_context_t *ctx;
+  LaneDetector detector;
+  double proc_min, proc_max;
+  unsigned int proc_min_frame, proc_max_frame;
+
+public:
+
+  AnnotateStage(stage_context_t *context)
+    : ctx(context), proc_min(DBL_MAX), proc_max(0.0), proc_min_frame(0),
+      proc_max_frame(0) {}
+
+  bool process(frame_t& frame) {
+
+    if (frame.yuv) {
+      detector.input_yuv(frame.img, frame.t_capture);
+    } else {
+      detector.input_image(frame.img, frame.t_capture);
+    }
+    detector.load_state(frame.state, frame_size(frame), frame.t_capture);
+    detector.annotate();
+
+    double proc = get_time_msec() - frame.t_capture;
+    if (proc < proc_min) {
+      proc_min = proc;
+      proc_min_frame = frame.id;
+    }
+    if (proc > proc_max) {
+      proc_max = proc;
+      proc_max_frame = frame.id;
+    }
+    return true;
+  }
+
+  void finish() {
+    __sync_fetch_and_add(&ctx->lines_detected, detector.get_lines_detected());
+    if (detector.get_frame_num() > 0) {
+      LOGSYS("capture->annotated, proc_min: %6.2f, frame: %u, "
+             "proc_max: %6.2f, frame: %u", proc_min, proc_min_frame,
+             proc_max, proc_max_frame);
+    }
+  }
+};
+
+/* @brief Copies an annotated frame and its lane result into the shm ring
+ */
+static void publish_shm(ShmRingWriter *shm, const frame_t& frame, 
+                        const Mat& img) {
+
+  shmring_info_t info;
+  info.t_capture_ns = (uint64_t)(frame.t_capture * MSEC_TO_NSEC);
+  info.frame_num = frame.state.frame_num;
+  info.left_found = frame.state.is_left_found;
+  info.right_found = frame.state.is_right_found;
+  info.left[0] = frame.state.left_pt1.x;
+  info.left[1] = frame.state.left_pt1.y;
+  info.left[2] = frame.state.left_pt2.x;
+  info.left[3] = frame.state.left_pt2.y;
+  info.right[0] = frame.state.right_pt1.x;
+  info.right[1] = frame.state.right_pt1.y;
+  info.right[2] = frame.state.right_pt2.x;
+  info.right[3] = frame.state.right_pt2.y;
+
+  shm->publish(img.data, img.step, info);
+}
+
+/* @brief Hands the annotated frame to the display, preview and shm ring,
+ *        none of which ever waits on its consumer
+ */
+class PublishStage : public Stage {
+
+  stage_context_t *ctx;
+
+public:
+
+  PublishStage(stage_context_t *context) : ctx(context) {}
+
+  bool process(frame_t& frame) {
+
+    Mat img = frame.img;
+
+    // the outputs all take BGR, convert once and only if one is enabled
+    if (frame.yuv && (ctx->display_box || ctx->preview || ctx->shm)) {
+      cvtColor(frame.img, img, COLOR_YUV2BGR_I420);
+    }
+
+    if (ctx->display_box) {
+      // an unshown frame is overwritten
+      display_frame_t disp;
+      disp.roi = frame.roi;
+      disp.annot = img;
+      ctx->display_box->Post(disp);
+    }
+    if (ctx->preview) {
+      ctx->preview->post(img, frame.state);
+    }
+    if (ctx->shm) {
+      // the ring geometry is only known once the first frame arrives
+      if (!ctx->shm->is_open()
+          && !ctx->shm->create(ctx->shm_name.c_str(), ctx->shm_slots,
+                               img.cols, img.rows, img.channels())) {
+        ctx->shm = NULL;
+      } else {
+        publish_shm(ctx->shm, frame, img);
+      }
+    }
+    return true;
+  }
+};
+
+/* @brief JPEG encoding, so that the write node only does file I/O
+ */
+class EncodeStage : public Stage {
+
+public:
+
+  bool process(frame_t& frame) {
+
+    DEADLINE_SCOPE(DEADLINE_ENCODE);
+    bool ok = frame.yuv ? yuv_encode_jpeg(frame.img, YUV_JPEG_QUALITY, frame.jpeg)
+                        : imencode(".jpg", frame.img, frame.jpeg);
+    if (!ok) {
+      frame.jpeg.clear();
+    }
+    return true;
+  }
+};
+
+/* @brief Writes the output frames and the results CSV
+ */
+class WriteStage : public Stage {
+
+  stage_context_t *ctx;
+  FILE* results;
+  unsigned int i;
+
+public:
+
+  WriteStage(stage_context_t *context) : ctx(context), results(NULL), i(0) {
+
+    if (!ctx->results_path.empty()) {
+      results = fopen(ctx->results_path.c_str(), "w");
+      if (results == NULL) {
+        perror("write results fopen");
+      } else {
+        stages_results_header(results);
+      }
+    }
+  }
+
+  ~WriteStage() {
+    if (results != NULL) {
+      fclose(results);
+    }
+  }
+
+  bool process(frame_t& frame) {
+
+    DEADLINE_SCOPE(DEADLINE_WRITE);
+    char number[20];
+    sprintf(number, "%08d.jpg", i);
+    String path = ctx->output_folder + number;
+    i++;
+
+    if (frame.jpeg.empty() && frame.yuv) {
+      yuv_encode_jpeg(frame.img, YUV_JPEG_QUALITY, frame.jpeg);
+    }
+
+    if (frame.jpeg.empty()) {
+      imwrite(path, frame.img);
+    } else {
+      FILE* f = fopen(path.c_str(), "wb");
+      if (f == NULL) {
+        perror("write fopen");
+      } else {
+        fwrite(frame.jpeg.data(), 1, frame.jpeg.size(), f);
+        fclose(f);
+      }
+    }
+    double t_file = get_time_msec() - frame.t_capture;
+    latency_stat_add(&ctx->file_lat, t_file);
+    ctx->file_hist.observe(t_file);
+    deadline_check(DEADLINE_FRAME, frame.id, (uint64_t)(t_file*MSEC_TO_NSEC));
+
+    if (results != NULL) {
+      stages_results_row(results, frame.id, frame.state);
+    }
+    return true;
+  }
+
+  void finish() {
+    if (results != NULL) {
+      fclose(results);
+      results = NULL;
+    }
+  }
+};
+
+//
+// factories, one Stage instance per replica
+//
+static Stage* make_decode(int, void* arg)
+  { return new DecodeStage((stage_context_t*) arg); }
+static Stage* make_preprocess(int, void* arg)
+  { return new PreprocessStage((stage_context_t*) arg); }
+static Stage* make_hough(int, void* arg)
+  { return new HoughStage((stage_context_t*) arg); }
+static Stage* make_decide(int, void* arg)
+  { return new DecideStage((stage_context_t*) arg); }
+static Stage* make_annotate(int, void* arg)
+  { return new AnnotateStage((stage_context_t*) arg); }
+static Stage* make_publish(int, void* arg)
+  { return new PublishStage((stage_context_t*) arg); }
+static Stage* make_encode(int, void*)
+  { return new EncodeStage(); }
+static Stage* make_write(int, void* arg)
+  { return new WriteStage((stage_context_t*) arg); }
+
+typedef struct {
+  const char* name;
+  stage_factory_t factory;
+  bool stateful;
+  int needs;    // index of a stage that must come earlier, -1 for none
+} stage_info_t;
+
+// in the order the nodes must appear in
+static const stage_info_t stage_table[] = {
+  {"decode",     make_decode,     true,  -1},
+  {"preprocess", make_preprocess, false, -1},
+  {"hough",      make_hough,      false,  1},
+  {"decide",     make_decide,     true,   2},
+  {"annotate",   make_annotate,   false,  2},
+  {"publish",    make_publish,    true,  -1},
+  {"encode",     make_encode,     false, -1},
+  {"write",      make_write,      true,  -1},
+};
+
+#define NUM_STAGES (int)(sizeof(stage_table)/sizeof(stage_table[0]))
+
+// see .h for more details
+bool stages_build(Pipeline& pipeline, const String& spec, stage_context_t* ctx) {
+
+  size_t pos = 0;
+  int count = 0, last = -1;
+  bool used[NUM_STAGES] = {false};
+
+  while (pos < spec.size()) {
+
+    size_t comma = spec.find(',', pos);
+    if (comma == String::npos) comma = spec.size();
+    String item = spec.substr(pos, comma-pos);
+    pos = comma+1;
+    if (item.empty()) continue;
+
+    node_desc_t desc;
+    if (!pipeline_parse_node(item, desc)) {
+      fprintf(stderr, "pipeline: bad node spec '%s'\n", item.c_str());
+      return false;
+    }
+
+    int index = -1;
+    for (int i = 0; i < NUM_STAGES; i++) {
+      if (desc.name == stage_table[i].name) {
+        index = i;
+      }
+    }
+    if (index < 0) {
+      fprintf(stderr, "pipeline: unknown stage '%s'\n", desc.name.c_str());
+      return false;
+    }
+    if (index <= last || (count == 0) != (index == 0)) {
+      fprintf(stderr, "pipeline: stage '%s' out of order, the order is "
+                      "decode,preprocess,hough,decide,annotate,publish,"
+                      "encode,write\n", desc.name.c_str());
+      return false;
+    }
+
+    const stage_info_t* info = &stage_table[index];
+    if (info->needs >= 0 && !used[info->needs]) {
+      fprintf(stderr, "pipeline: stage '%s' needs '%s' before it\n",
+              info->name, stage_table[info->needs].name);
+      return false;
+    }
+
+    desc.factory = info->factory;
+    desc.arg = ctx;
+    desc.stateful = info->stateful;
+    if (!pipeline.add_node(desc)) {
+      return false;
+    }
+    used[index] = true;
+    last = index;
+    count++;
+  }
+
+  return count > 0;
+}
+
+// see .h for more details
+void stages_init_context(stage_context_t* ctx) {
+
+  ctx->source = NULL;
+  ctx->show_pipeline = 0;
+  ctx->display_box = NULL;
+  ctx->preview = NULL;
+  ctx->shm = NULL;
+  ctx->shm_slots = 0;
+  ctx->events = NULL;
+  ctx->pool = NULL;
+  ctx->strips = 1;
+  ctx->yuv = false;
+  ctx->acc_thresh = ACC_THRESH;
+  ctx->adaptive_thresh = false;
+  ctx->budget = 0.0;
+  ctx->scan_lines = 0;
+  ctx->frame_pool = NULL;
+  ctx->replay = NULL;
+  ctx->snapshots = NULL;
+  latency_stat_init(&ctx->decision_lat);
+  latency_stat_init(&ctx->event_lat);
+  latency_stat_init(&ctx->file_lat);
+  ctx->lines_detected = 0;
+  ctx->decision_hist.reset();
+  ctx->event_hist.reset();
+  ctx->file_hist.reset();
+  ctx->decided = 0;
+  ctx->lanes_found[0] = ctx->lanes_found[1] = 0;
+  ctx->warnings[LANE_OK] = ctx->warnings[LANE_WARN] = 0;
+  ctx->warnings[LANE_DEPART] = 0;
+  ctx->warning = LANE_OK;
+  ctx->offset = 0;
+}
+
+// see .h for more details
+void stages_collect_metrics(MetricsText& out, void* arg) {
+
+  stage_context_t *ctx = (stage_context_t *) arg;
+  static const char* sides[2] = {"side=\"left\"", "side=\"right\""};
+  static const char* levels[3] = {
+    "level=\"ok\"", "level=\"warn\"", "level=\"depart\""
+  };
+  static const char* paths[3] = {
+    "path=\"decision\"", "path=\"event\"", "path=\"file\""
+  };
+  const MetricHistogram* hists[3] = {
+    &ctx->decision_hist, &ctx->event_hist, &ctx->file_hist
+  };
+
+  out.family("emvia_latency_seconds", "histogram",
+             "Capture to decision, to departure event and to written file.");
+  for (int i = 0; i < 3; i++) {
+    out.histogram("emvia_latency_seconds", paths[i], *hists[i]);
+  }
+  out.family("emvia_latency_msec", "gauge",
+             "Latency percentiles estimated from the histogram buckets.");
+  for (int i = 0; i < 3; i++) {
+    out.quantiles("emvia_latency_msec", paths[i], *hists[i]);
+  }
+
+  out.family("emvia_frames_decided_total", "counter",
+             "Frames through the lane departure decision.");
+  out.count("emvia_frames_decided_total", NULL, metric_load(&ctx->decided));
+  out.family("emvia_lanes_found_total", "counter",
+             "Decided frames with the lane line found.");
+  for (int side = 0; side < 2; side++) {
+    out.count("emvia_lanes_found_total", sides[side],
+              metric_load(&ctx->lanes_found[side]));
+  }
+  out.family("emvia_lane_warnings_total", "counter",
+             "Lane departure transitions to a level.");
+  for (int level = 0; level < 3; level++) {
+    out.count("emvia_lane_warnings_total", levels[level],
+              metric_load(&ctx->warnings[level]));
+  }
+  out.family("emvia_lane_warning", "gauge",
+             "Warning level of the last frame: 0 ok, 1 warn, 2 depart.");
+  out.sample("emvia_lane_warning", NULL, metric_load(&ctx->warning));
+  out.family("emvia_lane_offset_pixels", "gauge",
+             "Offset from the lane center of the last frame.");
+  out.sample("emvia_lane_offset_pixels", NULL, metric_load(&ctx->offset));
+
+  if (ctx->replay != NULL) {
+    out.family("emvia_replay_frames_total", "counter",
+               "Replayed frames released to the chain and dropped as stale.");
+    out.count("emvia_replay_frames_total", "result=\"released\"",
+              ctx->replay->get_released());
+    out.count("emvia_replay_frames_total", "result=\"dropped\"",
+              ctx->replay->get_dropped());
+    out.family("emvia_replay_late_total", "counter",
+               "Replayed frames decoded only after their arrival time.");
+    out.count("emvia_replay_late_total", NULL, ctx->replay->get_late());
+  }
+}
+
+// see .h for more details
+size_t stages_frame_bytes(stage_context_t* ctx) {
+
+  Size size = ctx->source->get_size();
+  return ctx->yuv ? size.area()*3/2 : size.area()*3;
+}
+
+// see .h for more details
+Size stages_roi_size(stage_context_t* ctx) {
+
+  LaneDetector probe;
+  Size size = ctx->source->get_size();
+  if (size.area() > 0) {
+    probe.set_frame_size(size);
+  }
+  return probe.get_roi_rect().size();
+}
+
+// see .h for more details
+void stages_prealloc_frame(frame_t& frame, void* arg) {
+
+  stage_context_t *ctx = (stage_context_t *) arg;
+  Size size = ctx->source->get_size();
+  if (size.area() == 0) {
+    return;
+  }
+
+  // the frame from the pool, the rest from the (prefaulted) heap
+  frame.img.allocator = ctx->frame_pool;
+  if (ctx->yuv) {
+    frame.img.create(size.height*3/2, size.width, CV_8UC1);
+  } else {
+    frame.img.create(size, CV_8UC3);
+  }
+
+  LaneDetector geometry;
+  geometry.set_frame_size(size);
+  frame.roi.create(geometry.get_roi_rect().size(), CV_8UC1);
+  frame.jpeg.reserve(size.area());
+  frame.yuv = ctx->yuv;
+}
+
+// see .h for more details
+void stages_results_header(FILE* f) {
+
+  fprintf(f, "id,frame,left_found,right_found,"
+             "left_x1,left_y1,left_x2,left_y2,"
+             "right_x1,right_y1,right_x2,right_y2,offset,warning,"
+             "left_thresh,right_thresh,left_candidates,right_candidates,degrade\n");
+}
+
+// see .h for more details
+void stages_results_row(FILE* f, unsigned int id, const lane_state_t& st) {
+
+  fprintf(f, "%u,%u,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i\n",
+          id, st.frame_num, st.is_left_found, st.is_right_found,
+          st.left_pt1.x, st.left_pt1.y, st.left_pt2.x, st.left_pt2.y,
+          st.right_pt1.x, st.right_pt1.y, st.right_pt2.x, st.right_pt2.y,
+          st.offset, (int)st.warning, st.thresh[0], st.thresh[1],
+          st.candidates[0], st.candidates[1], (int)st.degrade);
+}
+
+// see .h for more details
+void stages_print_degrade(const char* label, LaneDetector& detector) {
+
+  unsigned int n[DEGRADE_LEVELS], total = 0;
+  for (int i = 0; i < DEGRADE_LEVELS; i++) {
+    n[i] = detector.get_degrade_count((lane_degrade_t) i);
+    total += n[i];
+  }
+  if (total == 0) {
+    return;
+  }
+  LOGP("%s, budget levels full/coarse/half/predict: %u/%u/%u/%u, "
+       "degraded: %.1f%%, budget misses: %u\n", label, n[DEGRADE_NONE], 
+       n[DEGRADE_COARSE], n[DEGRADE_HALF], n[DEGRADE_PREDICT], 
+       100.0*(total - n[DEGRADE_NONE])/total, detector.get_budget_misses());
+}
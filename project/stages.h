@@ -0,0 +1,151 @@
+/* ----------------------------------------------------------------------------
+ * @file stages.h
+ * @brief The lane detection pipeline stages, as nodes for the pipeline
+ *        runtime (see pipeline.h)
+ *
+ *   decode      reads frames from the FrameSource (the source node)
+ *   preprocess  grayscale, ROI, median filter and threshold
+ *   hough       Hough transform and lane line end points
+ *   decide      lane departure decision and events
+ *   annotate    draws the lane lines into the frame
+ *   publish     display, HTTP preview and shm ring outputs
+ *   encode      JPEG encoding
+ *   write       output frames and the results CSV
+ *
+ * decide, publish and write depend on the frame order and cannot be
+ * replicated. Without an encode node, write encodes the frames itself.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef STAGES_H
+#define STAGES_H
+
+#include <opencv2/core.hpp>
+
+#include "log.h"
+#include "frame.h"
+#include "mailbox.h"
+#include "pipeline.h"
+#include "preview.h"
+#include "shmring.h"
+#include "events.h"
+#include "source.h"
+#include "taskpool.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "metrics.h"
+
+using namespace cv;
+
+// the layout of the former capture, process and write threads
+#define STAGES_DEFAULT_SPEC \
+  "decode@0,preprocess@1,hough@1,decide@1,annotate@1,publish@1,encode@2,write@2"
+
+// latest-frame mailbox contents for the display thread
+typedef struct {
+  Mat roi;
+  Mat annot;
+} display_frame_t;
+
+/* @brief Settings and outputs shared by the stages, NULL when disabled
+ */
+typedef struct {
+  FrameSource *source;
+  int show_pipeline;
+  Mailbox<display_frame_t> *display_box;
+  PreviewServer *preview;
+  ShmRingWriter *shm;
+  unsigned int shm_slots;
+  String shm_name;
+  LaneEventSocket *events;
+  String output_folder;
+  String results_path;  // per-frame lane results CSV, may be empty
+  TaskPool *pool;       // low-latency mode of preprocess and hough
+  int strips;
+  bool yuv;             // frames stay I420 from decode to encode
+  int acc_thresh;       // Hough accumulator threshold at 1280x720
+  bool adaptive_thresh; // per-frame threshold, see set_adaptive_thresh()
+  double budget;        // msec from capture to lane lines, see set_budget()
+  int scan_lines;       // scan-line engine with this many lines, 0 for Hough
+  MatAllocator *frame_pool; // frame buffers, see rtmem.h
+  ReplayClock *replay;  // paced arrivals from a recording, may be NULL
+  SnapshotRing *snapshots;  // debug snapshots of the hough node, may be NULL
+
+  // capture->decision for every frame, capture->event for transitions,
+  // capture->file for every written frame
+  latency_stat_t decision_lat;
+  latency_stat_t event_lat;
+  latency_stat_t file_lat;
+  unsigned int lines_detected;
+
+  // live metrics, read by stages_collect_metrics(): the same latencies as
+  // histograms, and the decisions so far (written by the decide node)
+  MetricHistogram decision_hist;
+  MetricHistogram event_hist;
+  MetricHistogram file_hist;
+  unsigned long decided;
+  unsigned long lanes_found[2];     // left, right
+  unsigned long warnings[3];        // transitions to each lane_warning_t
+  int warning;                      // of the last decided frame
+  int offset;
+} stage_context_t;
+
+/* @brief Adds the nodes of a comma separated pipeline spec, e.g.
+ *        "decode,preprocess*2,hough*2,decide@1,annotate@1,publish@1,write"
+ *
+ * @param pipeline, the runtime to add the nodes to
+ * @param spec, node specs, see pipeline_parse_node()
+ * @param ctx, the shared stage context, must outlive the pipeline
+ * @return false on an unknown node or a malformed spec
+ */
+bool stages_build(Pipeline& pipeline, const String& spec, stage_context_t* ctx);
+
+/* @brief Resets the statistics of the context
+ */
+void stages_init_context(stage_context_t* ctx);
+
+/* @brief Appends the latency histograms and percentiles, lanes found,
+ *        warnings and replay drops of a running chain, a metrics collector
+ *        (see metrics.h)
+ *
+ * @param out, the exposition text
+ * @param arg, the stage context
+ */
+void stages_collect_metrics(MetricsText& out, void* arg);
+
+/* @brief Allocates the buffers of a frame at the source's frame size, for
+ *        Pipeline::prealloc_frames()
+ *
+ * @param frame, the frame to set up
+ * @param arg, the stage context
+ */
+void stages_prealloc_frame(frame_t& frame, void* arg);
+
+/* @brief Bytes of the largest frame buffer of the source, 0 if unknown
+ */
+size_t stages_frame_bytes(stage_context_t* ctx);
+
+/* @brief The ROI size of the source frames, for buffers sized up front
+ */
+Size stages_roi_size(stage_context_t* ctx);
+
+/* @brief The header and one row of the per-frame results CSV
+ *
+ * @param f, the CSV file
+ * @param id, the frame number in the stream
+ * @param st, the detection result of the frame
+ */
+void stages_results_header(FILE* f);
+void stages_results_row(FILE* f, unsigned int id, const lane_state_t& st);
+
+/* @brief Prints the frames per budgeted mode level and the budget misses
+ *        of a detector
+ *
+ * @param label, printed first
+ * @param detector, a detector in budgeted mode
+ */
+void stages_print_degrade(const char* label, LaneDetector& detector);
+
+#endif // STAGES_H
@@ -0,0 +1,305 @@
+/* ----------------------------------------------------------------------------
+ * @file synth.cpp
+ * @brief Deterministic procedural road scene generator with ground truth
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <opencv2/imgproc.hpp>
+
+#include "synth.h"
+
+// scene layout relative to the frame size, matched to the challenge clips
+#define VP_X        (0.45)    // vanishing point, fraction of the width
+#define VP_Y        (0.52)    // vanishing point, fraction of the height
+#define LANE_WIDTH  (0.54)    // lane width at the bottom row, of the width
+#define PAINT_WIDTH (0.04)    // paint width, fraction of the lane width
+#define SHOULDER    (0.3)     // road beyond the outer lines, in lane widths
+#define DEPTH_SCALE (6.0)     // meters to the road at the bottom row
+#define SHADOW_PERIOD (80.0)  // shadows repeat every SHADOW_PERIOD meters
+
+// BGR colors
+static const uchar SKY[3]    = {200, 170, 140};
+static const uchar GRASS[3]  = { 60, 110,  70};
+static const uchar ROAD[3]   = { 95,  95,  95};
+static const uchar WHITE[3]  = {225, 225, 225};
+static const uchar YELLOW[3] = { 40, 190, 215};
+
+/* @brief Fills pixels [x0, x1] of a BGR row, clipped to the width
+ */
+static inline void fill_span(uchar* row, int width, double x0, double x1,
+                             const uchar* color) {
+
+  int a = (int)ceil(x0), b = (int)floor(x1);
+  if (a < 0) a = 0;
+  if (b > width-1) b = width-1;
+  for (int x = a; x <= b; x++) {
+    row[3*x+0] = color[0];
+    row[3*x+1] = color[1];
+    row[3*x+2] = color[2];
+  }
+}
+
+/* @brief Halves the brightness of pixels [x0, x1] of a BGR row
+ */
+static inline void shade_span(uchar* row, int width, double x0, double x1) {
+
+  int a = (int)ceil(x0), b = (int)floor(x1);
+  if (a < 0) a = 0;
+  if (b > width-1) b = width-1;
+  for (int x = 3*a; x < 3*(b+1); x++) {
+    row[x] >>= 1;
+  }
+}
+
+// see .h for more details
+bool synth_parse(const String& spec, synth_config_t& cfg) {
+
+  cfg.size = Size(1280, 720);
+  cfg.frames = 900;
+  cfg.fps = 30.0;
+  cfg.speed = 25.0;
+  cfg.lanes = 3;
+  cfg.curve = 0.0;
+  cfg.drift = 0.2;
+  cfg.period = 300.0;
+  cfg.dash = 3.0;
+  cfg.gap = 9.0;
+  cfg.noise = 4.0;
+  cfg.shadows = 0;
+  cfg.seed = 1;
+
+  String s = spec;
+  if (s.compare(0, 6, "synth:") == 0) s = s.substr(6);
+  else if (s == "synth") s = "";
+
+  size_t pos = 0;
+  while (pos < s.size()) {
+
+    size_t comma = s.find(',', pos);
+    if (comma == String::npos) comma = s.size();
+    String item = s.substr(pos, comma-pos);
+    pos = comma+1;
+    if (item.empty()) continue;
+
+    int w, h;
+    size_t eq = item.find('=');
+    if (eq == String::npos) {
+      if (sscanf(item.c_str(), "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+        cfg.size = Size(w, h);
+        continue;
+      }
+      fprintf(stderr, "synth: bad spec item '%s'\n", item.c_str());
+      return false;
+    }
+
+    String key = item.substr(0, eq);
+    double v = atof(item.c_str() + eq + 1);
+
+    if (key == "frames")       cfg.frames = (unsigned int)v;
+    else if (key == "fps")     cfg.fps = v;
+    else if (key == "speed")   cfg.speed = v;
+    else if (key == "lanes")   cfg.lanes = (int)v;
+    else if (key == "curve")   cfg.curve = v;
+    else if (key == "drift")   cfg.drift = v;
+    else if (key == "period")  cfg.period = v;
+    else if (key == "dash")    cfg.dash = v;
+    else if (key == "gap")     cfg.gap = v;
+    else if (key == "noise")   cfg.noise = v;
+    else if (key == "shadows") cfg.shadows = (int)v;
+    else if (key == "seed")    cfg.seed = (unsigned int)v;
+    else {
+      fprintf(stderr, "synth: unknown spec key '%s'\n", key.c_str());
+      return false;
+    }
+  }
+
+  if (cfg.lanes < 1) cfg.lanes = 1;
+  if (cfg.fps <= 0.0) cfg.fps = 30.0;
+  if (cfg.period <= 0.0) cfg.period = 300.0;
+  return true;
+}
+
+// see .h for more details
+void synth_write_truth_header(FILE* f) {
+
+  fprintf(f, "frame,y_top,y_bottom,left_top,left_bottom,right_top,right_bottom,"
+             "left_visible,right_visible,offset,warning\n");
+}
+
+// see .h for more details
+void synth_write_truth(FILE* f, const synth_truth_t& t) {
+
+  fprintf(f, "%u,%i,%i,%.2f,%.2f,%.2f,%.2f,%.3f,%.3f,%i,%i\n",
+          t.frame, t.y_top, t.y_bottom,
+          t.left_top, t.left_bottom, t.right_top, t.right_bottom,
+          t.left_visible, t.right_visible, t.offset, (int)t.warning);
+}
+
+/* @brief Lays out the scene for the configured frame size
+ */
+SyntheticRoad::SyntheticRoad(const synth_config_t& config) {
+
+  cfg = config;
+  W = cfg.size.width;
+  H = cfg.size.height;
+
+  vp_x = VP_X * W;
+  vp_y = VP_Y * H;
+  lane_px = LANE_WIDTH * W;
+  depth_scale = DEPTH_SCALE;
+
+  // keep the ego lane in the middle, extra lanes alternate right and left
+  int right_lanes = (cfg.lanes-1)/2;
+  int left_lanes = cfg.lanes-1-right_lanes;
+  for (int i = left_lanes; i >= 0; i--) lines.push_back(-0.5 - i);
+  for (int i = 0; i <= right_lanes; i++) lines.push_back(0.5 + i);
+
+  RNG rng(cfg.seed);
+
+  for (int i = 0; i < cfg.shadows; i++) {
+    shadow_t s;
+    s.z = rng.uniform(0.0, SHADOW_PERIOD);
+    s.len = rng.uniform(2.0, 8.0);
+    s.u0 = rng.uniform(lines.front() - SHOULDER, lines.back());
+    s.u1 = s.u0 + rng.uniform(0.5, 2.0);
+    shadow_list.push_back(s);
+  }
+
+  if (cfg.noise > 0.0) {
+    Mat n(H, W, CV_16SC3);
+    rng.fill(n, RNG::NORMAL, 0.0, cfg.noise);
+    n.convertTo(noise_pos, CV_8U);
+    n.convertTo(noise_neg, CV_8U, -1.0);
+  }
+
+  // score against the geometry the detector uses for this frame size
+  LaneDetector geometry;
+  geometry.set_frame_size(cfg.size);
+  roi = geometry.get_roi_rect();
+  vcenter = geometry.get_vcenter();
+}
+
+/* @brief Lateral offset of the lane lines caused by the vehicle drifting
+ */
+double SyntheticRoad::drift_px(unsigned int k) {
+
+  return cfg.drift * lane_px * sin(2.0*CV_PI*k / cfg.period);
+}
+
+/* @brief Column of a line at lateral position u, at depth factor t (0 at the
+ *        horizon, 1 at the bottom row)
+ */
+double SyntheticRoad::line_x(double u, double t, double drift) {
+
+  return vp_x + cfg.curve*W*(1.0-t)*(1.0-t) + t*(u*lane_px - drift);
+}
+
+/* @brief Whether the line at u has paint at distance z. The ego left line
+ *        is solid, the others are dashed.
+ */
+bool SyntheticRoad::paint_visible(double u, double z, double travel) {
+
+  if (u == -0.5 || cfg.gap <= 0.0) return true;
+  return fmod(z + travel, cfg.dash + cfg.gap) < cfg.dash;
+}
+
+/* @brief Renders one row below the horizon
+ */
+void SyntheticRoad::render_row(uchar* row, int y, double drift,
+                               double travel) {
+
+  double t = (y - vp_y) / (H - vp_y);
+  double z = depth_scale / t;
+  double hw = 0.5 * PAINT_WIDTH * lane_px * t;
+  if (hw < 0.5) hw = 0.5;
+
+  fill_span(row, W, 0, W-1, GRASS);
+  fill_span(row, W, line_x(lines.front() - SHOULDER, t, drift),
+                    line_x(lines.back() + SHOULDER, t, drift), ROAD);
+
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (paint_visible(lines[i], z, travel)) {
+      double x = line_x(lines[i], t, drift);
+      fill_span(row, W, x-hw, x+hw, (lines[i] == -0.5) ? YELLOW : WHITE);
+    }
+  }
+
+  for (size_t i = 0; i < shadow_list.size(); i++) {
+    const shadow_t& s = shadow_list[i];
+    double zz = fmod(z + travel - s.z + SHADOW_PERIOD, SHADOW_PERIOD);
+    if (zz >= 0.0 && zz < s.len) {
+      shade_span(row, W, line_x(s.u0, t, drift), line_x(s.u1, t, drift));
+    }
+  }
+}
+
+/* @brief Renders frame k and computes its ground truth
+ *
+ * @param k, the frame index
+ * @param img, the output BGR frame, reallocated only if the size changes
+ * @param truth, the exact lane line positions at the detector ROI rows
+ */
+void SyntheticRoad::render(unsigned int k, Mat& img, synth_truth_t& truth) {
+
+  double drift = drift_px(k);
+  double travel = cfg.speed * k / cfg.fps;
+  int horizon = (int)floor(vp_y) + 1;
+
+  img.create(H, W, CV_8UC3);
+  img.rowRange(0, horizon).setTo(Scalar(SKY[0], SKY[1], SKY[2]));
+  for (int y = horizon; y < H; y++) {
+    render_row(img.ptr<uchar>(y), y, drift, travel);
+  }
+
+  if (!noise_pos.empty()) {
+    // scroll the precomputed noise so consecutive frames differ
+    int r0 = (int)(((unsigned long)k * 7919) % H);
+    Mat top = img.rowRange(0, H-r0), bottom = img.rowRange(H-r0, H);
+    add(top, noise_pos.rowRange(r0, H), top);
+    subtract(top, noise_neg.rowRange(r0, H), top);
+    if (r0 > 0) {
+      add(bottom, noise_pos.rowRange(0, r0), bottom);
+      subtract(bottom, noise_neg.rowRange(0, r0), bottom);
+    }
+  }
+
+  //
+  // ground truth at the detector ROI rows
+  //
+  truth.frame = k;
+  truth.y_top = roi.y;
+  truth.y_bottom = roi.y + roi.height - 1;
+
+  double t_top = (truth.y_top - vp_y) / (H - vp_y);
+  double t_bottom = (truth.y_bottom - vp_y) / (H - vp_y);
+  truth.left_top = line_x(-0.5, t_top, drift);
+  truth.left_bottom = line_x(-0.5, t_bottom, drift);
+  truth.right_top = line_x(0.5, t_top, drift);
+  truth.right_bottom = line_x(0.5, t_bottom, drift);
+
+  int left_rows = 0, right_rows = 0;
+  for (int y = truth.y_top; y <= truth.y_bottom; y++) {
+    double z = depth_scale * (H - vp_y) / (y - vp_y);
+    if (paint_visible(-0.5, z, travel)) left_rows++;
+    if (paint_visible(0.5, z, travel)) right_rows++;
+  }
+  truth.left_visible = (double)left_rows / roi.height;
+  truth.right_visible = (double)right_rows / roi.height;
+
+  // the same decision LaneDetector::decide() makes
+  int left_x = cvRound(truth.left_bottom);
+  int right_x = cvRound(truth.right_bottom);
+  truth.offset = (right_x + left_x)/2 - vcenter;
+  if (abs(truth.offset) > (right_x-left_x)/4) {
+    truth.warning = LANE_DEPART;
+  } else if (abs(truth.offset) > (right_x-left_x)/6) {
+    truth.warning = LANE_WARN;
+  } else {
+    truth.warning = LANE_OK;
+  }
+}
@@ -0,0 +1,136 @@
+/* ----------------------------------------------------------------------------
+ * @file synth.h
+ * @brief Deterministic procedural road scene generator with ground truth
+ *
+ * Renders a flat road in perspective, frame by frame, at any resolution. The
+ * scene is laid out relative to the frame size so that at 1280x720 the ego
+ * lane lines fall inside the default LaneDetector ROI and rho windows, and at
+ * other sizes inside the scaled ones (see LaneDetector::set_frame_size()).
+ *
+ * A scene is described by a spec string, e.g.
+ *
+ *   synth:1920x1080,frames=900,lanes=3,curve=0.03,drift=0.2,dash=3,gap=9,
+ *         noise=6,shadows=4,seed=7
+ *
+ *   WxH        frame size (default 1280x720)
+ *   frames     number of frames, 0 for endless (default 900)
+ *   fps        frame rate (default 30)
+ *   speed      vehicle speed in m/s, moves the dashes and shadows (default 25)
+ *   lanes      number of lanes, the ego lane is kept in the middle (default 3)
+ *   curve      road curvature, horizontal bend at the horizon in frame widths
+ *   drift      peak lateral drift of the vehicle in lane widths (default 0.2)
+ *   period     drift period in frames (default 300)
+ *   dash, gap  dash and gap length in meters of the dashed lines, gap=0
+ *              gives solid lines (default 3 and 9)
+ *   noise      sigma of the gaussian pixel noise (default 4)
+ *   shadows    number of shadows across the road (default 0)
+ *   seed       random seed for noise and shadows (default 1)
+ *
+ * Rendering is a pure function of the spec and the frame index.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdio.h>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "lane.h"
+
+using namespace cv;
+
+/* @brief Synthetic scene settings, see the spec string above
+ */
+typedef struct {
+  Size size;
+  unsigned int frames;
+  double fps;
+  double speed;
+  int lanes;
+  double curve;
+  double drift;
+  double period;
+  double dash;
+  double gap;
+  double noise;
+  int shadows;
+  unsigned int seed;
+} synth_config_t;
+
+/* @brief Exact ground truth of one frame, at the rows of the detector ROI
+ */
+typedef struct {
+  unsigned int frame;
+  int y_top, y_bottom;              // ROI top and bottom row in the frame
+  double left_top, left_bottom;     // x of the ego left line center
+  double right_top, right_bottom;   // x of the ego right line center
+  double left_visible;              // fraction of ROI rows with paint
+  double right_visible;
+  int offset;                       // expected LaneDetector offset
+  lane_warning_t warning;           // expected LaneDetector warning level
+} synth_truth_t;
+
+/* @brief Parses a "synth:..." spec string
+ *
+ * @param spec, the spec string, the "synth:" prefix is optional
+ * @param cfg, filled with the defaults and the given values
+ * @return false on an unknown or malformed key
+ */
+bool synth_parse(const String& spec, synth_config_t& cfg);
+
+/* @brief Writes the CSV header / one CSV row of ground truth
+ */
+void synth_write_truth_header(FILE* f);
+void synth_write_truth(FILE* f, const synth_truth_t& t);
+
+/* @brief The road scene renderer
+ */
+class SyntheticRoad {
+
+private:
+
+  typedef struct {
+    double z;       // start distance along the road (m)
+    double len;     // length along the road (m)
+    double u0, u1;  // lateral extent in lane widths
+  } shadow_t;
+
+  synth_config_t cfg;
+  int W, H;
+
+  // perspective: vanishing point and lane width at the bottom row
+  double vp_x, vp_y;
+  double lane_px;
+  double depth_scale;   // distance (m) seen at the bottom row
+
+  // lane lines, lateral position in lane widths from the ego lane center
+  std::vector<double> lines;
+  std::vector<shadow_t> shadow_list;
+
+  // precomputed signed noise, split into saturating add/subtract parts
+  Mat noise_pos, noise_neg;
+
+  // detector geometry this scene is scored against
+  Rect roi;
+  int vcenter;
+
+  double drift_px(unsigned int k);
+  double line_x(double u, double t, double drift);
+  bool paint_visible(double u, double z, double travel);
+  void render_row(uchar* row, int y, double drift, double travel);
+
+public:
+
+  SyntheticRoad(const synth_config_t& config);
+
+  // renders frame k into img (BGR), and its ground truth
+  void render(unsigned int k, Mat& img, synth_truth_t& truth);
+
+  const synth_config_t& get_config() { return cfg; }
+};
+
+#endif // SYNTH_H
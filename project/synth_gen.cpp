@@ -0,0 +1,225 @@
+/* ----------------------------------------------------------------------------
+ * @file synth_gen.cpp
+ * @brief Writes synthetic road videos as Y4M with ground truth, and scores
+ *        detection results against the ground truth
+ *
+ * usage:
+ *   ./synth_gen.out --spec=synth:1920x1080,frames=300 --out=road.y4m \
+ *                   --truth=truth.csv
+ *   ./synth_gen.out --eval --truth=truth.csv --results=results.csv
+ *
+ * The results CSV is written by main.out --results. For the same spec,
+ * main.out --input=synth:... renders identical frames in-process.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <map>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/utility.hpp>
+
+#include "log.h"
+#include "synth.h"
+
+using namespace cv;
+using namespace std;
+
+/* @brief Renders the spec into a Y4M (4:2:0) file and a truth CSV
+ */
+static int generate(const String& spec, const String& out_path,
+                    const String& truth_path) {
+
+  synth_config_t cfg;
+  if (!synth_parse(spec, cfg)) {
+    return 1;
+  }
+  if (cfg.frames == 0) {
+    fprintf(stderr, "synth_gen: frames=0 (endless) cannot be written\n");
+    return 1;
+  }
+  if ((cfg.size.width | cfg.size.height) & 1) {
+    fprintf(stderr, "synth_gen: 4:2:0 output needs an even frame size\n");
+    return 1;
+  }
+
+  FILE* out = fopen(out_path.c_str(), "wb");
+  if (out == NULL) {
+    perror("synth_gen fopen");
+    return 1;
+  }
+
+  FILE* truth = NULL;
+  if (!truth_path.empty()) {
+    truth = fopen(truth_path.c_str(), "w");
+    if (truth == NULL) {
+      perror("synth_gen truth fopen");
+      fclose(out);
+      return 1;
+    }
+    synth_write_truth_header(truth);
+  }
+
+  fprintf(out, "YUV4MPEG2 W%i H%i F%i:1000 Ip A1:1 C420jpeg\n",
+          cfg.size.width, cfg.size.height, (int)(cfg.fps*1000));
+
+  SyntheticRoad road(cfg);
+  Mat bgr, yuv;
+  synth_truth_t t;
+  double start = get_time_msec();
+
+  for (unsigned int k = 0; k < cfg.frames; k++) {
+
+    road.render(k, bgr, t);
+    cvtColor(bgr, yuv, COLOR_BGR2YUV_I420);
+
+    fputs("FRAME\n", out);
+    fwrite(yuv.data, 1, yuv.total()*yuv.elemSize(), out);
+    if (truth != NULL) {
+      synth_write_truth(truth, t);
+    }
+  }
+
+  double elapsed = get_time_msec() - start;
+  LOGP("synth_gen, %u frames %ix%i, msec: %6.2f, FPS: %6.2f\n",
+       cfg.frames, cfg.size.width, cfg.size.height, elapsed,
+       cfg.frames*1000/elapsed);
+
+  fclose(out);
+  if (truth != NULL) {
+    fclose(truth);
+  }
+  return 0;
+}
+
+/* @brief Detection counts of one lane side
+ */
+typedef struct {
+  unsigned int tp, tn, fp, fn;
+  double err_sum;   // sum of the bottom x error of true positives
+} side_score_t;
+
+static void score_side(side_score_t& s, bool found, bool present,
+                       double found_x, double true_x) {
+
+  if (found && present) {
+    s.tp++;
+    s.err_sum += fabs(found_x - true_x);
+  } else if (found) {
+    s.fp++;
+  } else if (present) {
+    s.fn++;
+  } else {
+    s.tn++;
+  }
+}
+
+static void print_side(const char* label, const side_score_t& s) {
+
+  double tpr = (s.tp + s.fn) ? (double)s.tp / (s.tp + s.fn) : 0.0;
+  double fpr = (s.fp + s.tn) ? (double)s.fp / (s.fp + s.tn) : 0.0;
+  double err = s.tp ? s.err_sum / s.tp : 0.0;
+
+  LOGP("%-6s TP: %5u, TN: %5u, FP: %5u, FN: %5u, TPR: %5.3f, FPR: %5.3f, "
+       "mean bottom x error (px): %6.2f\n",
+       label, s.tp, s.tn, s.fp, s.fn, tpr, fpr, err);
+}
+
+/* @brief Scores a results CSV from main.out against a truth CSV
+ *
+ * A lane line counts as present if at least min_visible of the ROI rows
+ * have paint on it.
+ */
+static int evaluate(const String& truth_path, const String& results_path,
+                    double min_visible) {
+
+  FILE* tf = fopen(truth_path.c_str(), "r");
+  FILE* rf = fopen(results_path.c_str(), "r");
+  char line[512];
+
+  if (tf == NULL || rf == NULL) {
+    fprintf(stderr, "synth_gen: cannot open %s or %s\n",
+            truth_path.c_str(), results_path.c_str());
+    if (tf) fclose(tf);
+    if (rf) fclose(rf);
+    return 1;
+  }
+
+  map<unsigned int, synth_truth_t> truth;
+  fgets(line, sizeof(line), tf);
+  while (fgets(line, sizeof(line), tf)) {
+    synth_truth_t t;
+    int warning;
+    if (sscanf(line, "%u,%i,%i,%lf,%lf,%lf,%lf,%lf,%lf,%i,%i",
+               &t.frame, &t.y_top, &t.y_bottom,
+               &t.left_top, &t.left_bottom, &t.right_top, &t.right_bottom,
+               &t.left_visible, &t.right_visible, &t.offset, &warning) == 11) {
+      t.warning = (lane_warning_t) warning;
+      truth[t.frame] = t;
+    }
+  }
+  fclose(tf);
+
+  side_score_t left = {0, 0, 0, 0, 0.0}, right = {0, 0, 0, 0, 0.0};
+  unsigned int frames = 0, warn_match = 0;
+
+  fgets(line, sizeof(line), rf);
+  while (fgets(line, sizeof(line), rf)) {
+    unsigned int id, frame_num;
+    int lf, rfound, l[4], r[4], offset, warning;
+    if (sscanf(line, "%u,%u,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i",
+               &id, &frame_num, &lf, &rfound, &l[0], &l[1], &l[2], &l[3],
+               &r[0], &r[1], &r[2], &r[3], &offset, &warning) != 14) {
+      continue;
+    }
+
+    map<unsigned int, synth_truth_t>::iterator it = truth.find(id);
+    if (it == truth.end()) continue;
+    const synth_truth_t& t = it->second;
+
+    score_side(left, lf, t.left_visible >= min_visible, l[2], t.left_bottom);
+    score_side(right, rfound, t.right_visible >= min_visible,
+               r[2], t.right_bottom);
+    if (warning == (int)t.warning) warn_match++;
+    frames++;
+  }
+  fclose(rf);
+
+  LOGP("frames scored: %u\n", frames);
+  print_side("left", left);
+  print_side("right", right);
+  LOGP("warning level agreement: %5.3f\n", frames ? (double)warn_match/frames : 0.0);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+
+  const String parser_keys =
+    "{help h usage ? | | Print help message. }"
+    "{spec     | synth:1280x720 | Synthetic road spec, see synth.h. }"
+    "{out o    | road.y4m | Output Y4M file. }"
+    "{truth    | truth.csv | Ground truth CSV. }"
+    "{eval     | | Score --results against --truth instead of generating. }"
+    "{results  | results.csv | Results CSV from main.out --results. }"
+    "{min-visible | 0.25 | Fraction of ROI rows with paint for a line to count as present. }"
+    ;
+
+  CommandLineParser parser(argc, argv, parser_keys);
+  if (parser.has("help")) {
+    parser.printMessage();
+    return 0;
+  }
+
+  if (parser.has("eval")) {
+    return evaluate(parser.get<String>("truth"),
+                    parser.get<String>("results"),
+                    parser.get<double>("min-visible"));
+  }
+
+  return generate(parser.get<String>("spec"),
+                  parser.get<String>("out"),
+                  parser.get<String>("truth"));
+}
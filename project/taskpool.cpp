@@ -0,0 +1,213 @@
+/* ----------------------------------------------------------------------------
+ * @file taskpool.cpp
+ * @brief A small persistent work-stealing thread pool, see taskpool.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <sched.h>
+
+#include "log.h"
+#include "taskpool.h"
+
+TaskPool::TaskPool() {
+
+  queued = 0;
+  next = 0;
+  stopping = false;
+  tasks_run = tasks_stolen = 0;
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&wake, NULL);
+}
+
+TaskPool::~TaskPool() {
+
+  stop();
+  pthread_cond_destroy(&wake);
+  pthread_mutex_destroy(&lock);
+}
+
+// see .h for more details
+bool TaskPool::start(int threads) {
+
+  stopping = false;
+
+  for (int i = 0; i < threads; i++) {
+    worker_t* w = new worker_t;
+    w->pool = this;
+    w->id = i;
+    pthread_mutex_init(&w->lock, NULL);
+    workers.push_back(w);
+  }
+
+  for (size_t i = 0; i < workers.size(); i++) {
+    if (pthread_create(&workers[i]->thread, NULL, worker_main, workers[i]) != 0) {
+      perror("taskpool pthread_create");
+      // keep the workers that are running
+      for (size_t j = i; j < workers.size(); j++) {
+        pthread_mutex_destroy(&workers[j]->lock);
+        delete workers[j];
+      }
+      workers.resize(i);
+      break;
+    }
+  }
+
+  return !workers.empty();
+}
+
+// see .h for more details
+void TaskPool::stop() {
+
+  pthread_mutex_lock(&lock);
+  __atomic_store_n(&stopping, true, __ATOMIC_RELAXED);
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+
+  // the others may still steal from a worker until all have stopped
+  for (size_t i = 0; i < workers.size(); i++) {
+    pthread_join(workers[i]->thread, NULL);
+  }
+  for (size_t i = 0; i < workers.size(); i++) {
+    pthread_mutex_destroy(&workers[i]->lock);
+    delete workers[i];
+  }
+  workers.clear();
+}
+
+/* @brief Takes a task: the newest of the own deque, else the oldest of
+ *        another worker's deque
+ *
+ * @param self, the worker id, -1 for a thread outside of the pool
+ * @return false if all deques are empty
+ */
+bool TaskPool::pop(int self, task_t& task) {
+
+  int n = workers.size();
+
+  if (__atomic_load_n(&queued, __ATOMIC_ACQUIRE) == 0) {
+    return false;
+  }
+
+  if (self >= 0) {
+    worker_t* w = workers[self];
+    pthread_mutex_lock(&w->lock);
+    if (!w->tasks.empty()) {
+      task = w->tasks.back();
+      w->tasks.pop_back();
+      pthread_mutex_unlock(&w->lock);
+      __atomic_sub_fetch(&queued, 1, __ATOMIC_ACQ_REL);
+      return true;
+    }
+    pthread_mutex_unlock(&w->lock);
+  }
+
+  for (int i = 1; i <= n; i++) {
+    worker_t* w = workers[(self + i + n) % n];
+    if (w->id == self) continue;
+    pthread_mutex_lock(&w->lock);
+    if (!w->tasks.empty()) {
+      task = w->tasks.front();
+      w->tasks.pop_front();
+      pthread_mutex_unlock(&w->lock);
+      __atomic_sub_fetch(&queued, 1, __ATOMIC_ACQ_REL);
+      __atomic_add_fetch(&tasks_stolen, 1, __ATOMIC_RELAXED);
+      return true;
+    }
+    pthread_mutex_unlock(&w->lock);
+  }
+
+  return false;
+}
+
+/* @brief Runs a task and marks it finished in its batch
+ */
+void TaskPool::run(const task_t& task) {
+
+  task.fn(task.arg, task.index);
+  __atomic_add_fetch(&tasks_run, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&task.batch->remaining, 1, __ATOMIC_RELEASE);
+}
+
+/* @brief Worker loop: run, steal, spin, then sleep until new tasks arrive
+ */
+void* TaskPool::worker_main(void* param) {
+
+  worker_t* w = (worker_t*) param;
+  TaskPool* pool = w->pool;
+  task_t task;
+
+  while (true) {
+
+    if (pool->pop(w->id, task)) {
+      pool->run(task);
+      continue;
+    }
+
+    double spin_end = get_time_msec() + TASKPOOL_SPIN_USEC/1000.0;
+    while (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0
+           && get_time_msec() < spin_end
+           && !__atomic_load_n(&pool->stopping, __ATOMIC_RELAXED)) {
+      sched_yield();
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0
+           && !pool->stopping) {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    bool stopping = pool->stopping;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (stopping) {
+      break;
+    }
+  }
+
+  return nullptr;
+}
+
+// see .h for more details
+void TaskPool::parallel_for(int n, task_fn_t fn, void* arg) {
+
+  batch_t batch;
+  task_t task;
+  int count = workers.size();
+
+  // no workers, run sequentially
+  if (count == 0) {
+    for (int i = 0; i < n; i++) {
+      fn(arg, i);
+    }
+    return;
+  }
+
+  batch.remaining = n;
+
+  // deal the tasks over the workers, starting where the last batch ended
+  int first = __atomic_fetch_add(&next, n, __ATOMIC_RELAXED);
+  for (int i = 0; i < n; i++) {
+    worker_t* w = workers[(unsigned int)(first + i) % count];
+    task.fn = fn;
+    task.arg = arg;
+    task.index = i;
+    task.batch = &batch;
+    pthread_mutex_lock(&w->lock);
+    w->tasks.push_back(task);
+    pthread_mutex_unlock(&w->lock);
+    __atomic_add_fetch(&queued, 1, __ATOMIC_ACQ_REL);
+  }
+
+  pthread_mutex_lock(&lock);
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+
+  // help out until the batch is done
+  while (__atomic_load_n(&batch.remaining, __ATOMIC_ACQUIRE) > 0) {
+    if (pop(-1, task)) {
+      run(task);
+    }
+  }
+}
@@ -0,0 +1,85 @@
+/* ----------------------------------------------------------------------------
+ * @file taskpool.h
+ * @brief A small persistent work-stealing thread pool for splitting the work
+ *        of one frame into parallel tasks
+ *
+ * Every worker owns a deque of tasks. It runs its own tasks newest first,
+ * and once that deque is empty it steals the oldest task of another worker.
+ * Idle workers spin for a short while before they block, so that a frame
+ * arriving every few msec finds them awake. The thread calling
+ * parallel_for() runs tasks as well until its batch is done, so a batch
+ * never waits on a worker that is still waking up.
+ *
+ * Several threads may call parallel_for() at the same time.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+// spin time of an idle worker before it blocks
+#define TASKPOOL_SPIN_USEC (200)
+
+// one task of a batch, called with the index of the task
+typedef void (*task_fn_t)(void* arg, int index);
+
+class TaskPool {
+
+private:
+
+  typedef struct {
+    int remaining;    // tasks not yet finished
+  } batch_t;
+
+  typedef struct {
+    task_fn_t fn;
+    void* arg;
+    int index;
+    batch_t* batch;
+  } task_t;
+
+  typedef struct {
+    TaskPool* pool;
+    int id;
+    pthread_t thread;
+    pthread_mutex_t lock;     // protects tasks
+    std::deque<task_t> tasks;
+  } worker_t;
+
+  std::vector<worker_t*> workers;
+  int queued;                 // tasks in all deques, atomic
+  int next;                   // worker receiving the next task, atomic
+  bool stopping;
+  pthread_mutex_t lock;       // for sleeping workers
+  pthread_cond_t wake;
+  unsigned long tasks_run, tasks_stolen;   // atomic
+
+  bool pop(int self, task_t& task);
+  void run(const task_t& task);
+  static void* worker_main(void* param);
+
+public:
+
+  TaskPool();
+  ~TaskPool();
+
+  // starts the worker threads, false if none could be started
+  bool start(int threads);
+  void stop();
+
+  int get_threads() { return workers.size(); }
+
+  // runs fn(arg, i) for i in [0, n) and returns once all have finished
+  void parallel_for(int n, task_fn_t fn, void* arg);
+
+  unsigned long get_tasks_run() { return tasks_run; }
+  unsigned long get_tasks_stolen() { return tasks_stolen; }
+};
+
+#endif // TASKPOOL_H
@@ -0,0 +1,63 @@
+/* ----------------------------------------------------------------------------
+ * @file timing.cpp
+ * @brief nsec timestamps, per-thread CPU time and scoped timers
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: Embedded Machine Vision (Summer 2021)
+ *---------------------------------------------------------------------------*/
+
+#include "log.h"
+#include "timing.h"
+
+// head of the list of all statistics
+static TimingStat* timing_stats = NULL;
+
+/* @brief Registers the statistic, only call at static init (single thread)
+ */
+TimingStat::TimingStat(const char* stat_name) {
+
+  name = stat_name;
+  count = 0;
+  wall_ns = cpu_ns = wall_max_ns = 0;
+  next = timing_stats;
+  timing_stats = this;
+}
+
+// see .h for more details
+void TimingStat::add(uint64_t wall, uint64_t cpu) {
+
+  __atomic_add_fetch(&count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&wall_ns, wall, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&cpu_ns, cpu, __ATOMIC_RELAXED);
+
+  uint64_t max = __atomic_load_n(&wall_max_ns, __ATOMIC_RELAXED);
+  while (wall > max
+         && !__atomic_compare_exchange_n(&wall_max_ns, &max, wall, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    ;
+  }
+}
+
+// see .h for more details
+void TimingStat::print() {
+
+  if (count == 0) {
+    return;
+  }
+
+  // wall > cpu: the thread was preempted or blocked inside the scope
+  LOGP("timing %-16s n: %8llu, wall avg usec: %9.2f, cpu avg usec: %9.2f, "
+       "cpu/wall: %5.1f%%, wall max usec: %9.2f\n",
+       name, (unsigned long long)count,
+       wall_ns/1000.0/count, cpu_ns/1000.0/count,
+       wall_ns ? 100.0*cpu_ns/wall_ns : 0.0,
+       wall_max_ns/1000.0);
+}
+
+// see .h for more details
+void TimingStat::print_all() {
+
+  for (TimingStat* s = timing_stats; s != NULL; s = s->next) {
+    s->print();
+  }
+}
@@ -0,0 +1,109 @@
+/* ----------------------------------------------------------------------------
+ * @file timing.h
+ * @brief nsec timestamps, per-thread CPU time and scoped timers
+ *
+ * time_now_ns() reads CLOCK_MONOTONIC, which is served by the vDSO without
+ * a syscall. time_thread_cpu_ns() reads CLOCK_THREAD_CPUTIME_ID, the CPU
+ * time of the calling thread. It only advances while the thread runs, so
+ * wall time minus CPU time of a section is the time the thread was
+ * descheduled (preempted or blocked), and CPU time spent outside of any
+ * stage is spinning or polling. The CPU clock is a syscall on most
+ * kernels (~0.5 usec), the scoped timers are meant for sections of tens of
+ * usec and more.
+ *
+ * Scoped timers accumulate into named statistics:
+ *
+ *   TIMING_STAT(gray_stat, "to_gray");   // at file scope
+ *   void f() { TIMING_SCOPE(gray_stat); ... }
+ *   TIMING_PRINT();                       // all statistics, at exit
+ *
+ * and compile to nothing without TIMING_ENABLED.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: Embedded Machine Vision (Summer 2021)
+ *---------------------------------------------------------------------------*/
+
+#ifndef TIMING_H_
+#define TIMING_H_
+
+#include <stdint.h>
+#include <time.h>
+
+// Enable the scoped timers with following switch:
+#define TIMING_ENABLED
+
+/* @brief  Monotonic time in nsec
+ */
+static inline uint64_t time_now_ns(void) {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+/* @brief  CPU time of the calling thread in nsec
+ */
+static inline uint64_t time_thread_cpu_ns(void) {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+/* @brief A named wall/CPU time statistic, safe to update from any thread
+ */
+class TimingStat {
+
+private:
+
+  const char* name;
+  uint64_t count;
+  uint64_t wall_ns, cpu_ns;
+  uint64_t wall_max_ns;
+  TimingStat* next;   // all statistics, registered at static init
+
+public:
+
+  TimingStat(const char* stat_name);
+
+  void add(uint64_t wall, uint64_t cpu);
+  void print();
+
+  // prints every statistic with samples
+  static void print_all();
+};
+
+/* @brief Adds the wall and CPU time of its scope to a statistic
+ */
+class TimingScope {
+
+private:
+
+  TimingStat& stat;
+  uint64_t wall_start, cpu_start;
+
+public:
+
+  TimingScope(TimingStat& s)
+    : stat(s), wall_start(time_now_ns()), cpu_start(time_thread_cpu_ns()) {}
+
+  ~TimingScope() {
+    stat.add(time_now_ns() - wall_start, time_thread_cpu_ns() - cpu_start);
+  }
+};
+
+#define TIMING_CONCAT2(a, b) a##b
+#define TIMING_CONCAT(a, b) TIMING_CONCAT2(a, b)
+
+#ifdef TIMING_ENABLED
+  #define TIMING_STAT(var, name) static TimingStat var(name)
+  #define TIMING_SCOPE(var) TimingScope TIMING_CONCAT(timing_scope_, __LINE__)(var)
+  #define TIMING_PRINT() TimingStat::print_all()
+#else
+  // do nothing, no clock reads
+  #define TIMING_STAT(var, name)
+  #define TIMING_SCOPE(var)
+  #define TIMING_PRINT()
+#endif
+
+#endif // TIMING_H_
@@ -0,0 +1,271 @@
+/* ----------------------------------------------------------------------------
+ * @file viewer.cpp
+ * @brief Prefetching random-access frame source for frame-analysis-mode
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "viewer.h"
+#include "log.h"
+
+FramePrefetcher::FramePrefetcher() {
+
+  is_video = false;
+  video_pos = 0;
+  num_frames = 0;
+  ahead = 0;
+  behind = 0;
+  capacity = 0;
+  cursor = 0;
+  running = false;
+  hits = 0;
+  misses = 0;
+  decodes = 0;
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&wake, NULL);
+  pthread_cond_init(&decoded, NULL);
+}
+
+FramePrefetcher::~FramePrefetcher() {
+
+  close();
+  pthread_cond_destroy(&decoded);
+  pthread_cond_destroy(&wake);
+  pthread_mutex_destroy(&lock);
+}
+
+/* @brief Opens the frame source and starts the prefetch thread
+ *
+ * @param source, folder of %08d.jpg frames (ending in '/') or a video file
+ * @param prefetch_ahead, frames to decode after the cursor
+ * @param prefetch_behind, frames to decode before the cursor
+ * @param cache_frames, LRU capacity, at least the prefetch window
+ * @return true if at least one frame is available
+ */
+bool FramePrefetcher::open(const String& source, int prefetch_ahead, 
+                           int prefetch_behind, size_t cache_frames) {
+
+  ahead = prefetch_ahead;
+  behind = prefetch_behind;
+  capacity = cache_frames;
+  if (capacity < (size_t)(ahead + behind + 1)) {
+    capacity = ahead + behind + 1;
+  }
+
+  is_video = (source[source.size()-1] != '/');
+  if (is_video) {
+    if (!video.open(source)) {
+      fprintf(stderr, "viewer: cannot open %s\n", source.c_str());
+      return false;
+    }
+    num_frames = (int) video.get(CAP_PROP_FRAME_COUNT);
+    video_pos = 0;
+  } else {
+    folder = source;
+    num_frames = count_files();
+  }
+
+  if (num_frames <= 0) {
+    return false;
+  }
+
+  running = true;
+  if (pthread_create(&thread, NULL, thread_entry, this) != 0) {
+    perror("viewer pthread_create");
+    running = false;
+    return false;
+  }
+
+  return true;
+}
+
+/* @brief Stops the prefetch thread and drops the cache
+ */
+void FramePrefetcher::close() {
+
+  pthread_mutex_lock(&lock);
+  bool was_running = running;
+  running = false;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+
+  if (was_running) {
+    pthread_join(thread, NULL);
+  }
+
+  cache.clear();
+  lru.clear();
+  video.release();
+}
+
+/* @brief Returns frame i and makes it the prefetch cursor
+ *
+ * @param i, the frame index, 0 <= i < get_num_frames()
+ * @param img, the decoded frame (shared with the cache, do not draw into it)
+ * @return false if the frame does not exist or could not be decoded
+ */
+bool FramePrefetcher::get(int i, Mat& img) {
+
+  if (i < 0 || i >= num_frames) return false;
+
+  pthread_mutex_lock(&lock);
+
+  cursor = i;
+  pthread_cond_signal(&wake);
+
+  std::map<int, entry_t>::iterator it = cache.find(i);
+  if (it != cache.end()) {
+    hits++;
+  } else {
+    misses++;
+    while (running && (it = cache.find(i)) == cache.end()) {
+      pthread_cond_wait(&decoded, &lock);
+    }
+  }
+
+  bool ok = (it != cache.end() && !it->second.img.empty());
+  if (ok) {
+    img = it->second.img;
+    lru.splice(lru.begin(), lru, it->second.pos);
+  }
+
+  pthread_mutex_unlock(&lock);
+  return ok;
+}
+
+void *FramePrefetcher::thread_entry(void *param) {
+
+  ((FramePrefetcher*) param)->run();
+  return nullptr;
+}
+
+/* @brief The prefetch loop, decodes the most wanted missing frame with the
+ *        lock released, and sleeps once the whole window is cached
+ */
+void FramePrefetcher::run() {
+
+  pthread_mutex_lock(&lock);
+
+  while (running) {
+
+    int i = next_wanted();
+    if (i < 0) {
+      pthread_cond_wait(&wake, &lock);
+      continue;
+    }
+
+    pthread_mutex_unlock(&lock);
+    Mat img = decode(i);
+    pthread_mutex_lock(&lock);
+
+    // an empty Mat is cached too, so that a bad frame is not retried
+    insert(i, img);
+    decodes++;
+    pthread_cond_broadcast(&decoded);
+  }
+
+  pthread_mutex_unlock(&lock);
+}
+
+/* @brief Picks the next frame to decode: the cursor, then alternating 
+ *        ahead/behind with ahead preferred. Must hold the lock.
+ *
+ * @return the frame index, or -1 if the window is fully cached
+ */
+int FramePrefetcher::next_wanted() {
+
+  int reach = (ahead > behind) ? ahead : behind;
+
+  for (int d = 0; d <= reach; d++) {
+
+    int fwd = cursor + d;
+    if (d <= ahead && fwd < num_frames && cache.find(fwd) == cache.end()) {
+      return fwd;
+    }
+
+    int back = cursor - d;
+    if (d > 0 && d <= behind && back >= 0 && cache.find(back) == cache.end()) {
+      return back;
+    }
+  }
+
+  return -1;
+}
+
+/* @brief Decodes frame i from the source, called without the lock
+ */
+Mat FramePrefetcher::decode(int i) {
+
+  Mat img;
+  char number_ext[16];
+
+  if (is_video) {
+    // seeking is expensive, only do it when not reading sequentially
+    if (i != video_pos) {
+      video.set(CAP_PROP_POS_FRAMES, i);
+    }
+    video.read(img);
+    video_pos = i+1;
+  } else {
+    snprintf(number_ext, sizeof(number_ext), "%08d.jpg", i);
+    img = imread(folder + number_ext);
+  }
+
+  return img;
+}
+
+/* @brief Adds a frame to the cache, evicting the least recently used frame
+ *        outside the prefetch window if over capacity. Must hold the lock.
+ */
+void FramePrefetcher::insert(int i, const Mat& img) {
+
+  entry_t e;
+  e.img = img;
+  lru.push_front(i);
+  e.pos = lru.begin();
+  cache[i] = e;
+
+  lru_t::reverse_iterator r = lru.rbegin();
+  while (cache.size() > capacity && r != lru.rend()) {
+    int victim = *r;
+    if (victim >= cursor-behind && victim <= cursor+ahead) {
+      r++;
+      continue;
+    }
+    cache.erase(victim);
+    r = lru_t::reverse_iterator(lru.erase(--r.base()));
+  }
+}
+
+/* @brief Counts the contiguous %08d.jpg frames in the folder with an 
+ *        exponential then binary search, without decoding anything
+ */
+int FramePrefetcher::count_files() {
+
+  char number_ext[16];
+  int lo = 0, hi = 1;
+
+  #define FRAME_EXISTS(n) \
+    (snprintf(number_ext, sizeof(number_ext), "%08d.jpg", (n)), \
+     access((folder + number_ext).c_str(), R_OK) == 0)
+
+  if (!FRAME_EXISTS(0)) return 0;
+
+  // lo exists, find an hi that does not
+  while (FRAME_EXISTS(hi)) {
+    lo = hi;
+    hi *= 2;
+  }
+  while (hi - lo > 1) {
+    int mid = lo + (hi - lo)/2;
+    if (FRAME_EXISTS(mid)) lo = mid; else hi = mid;
+  }
+
+  #undef FRAME_EXISTS
+
+  return lo + 1;
+}
@@ -0,0 +1,84 @@
+/* ----------------------------------------------------------------------------
+ * @file viewer.h
+ * @brief Prefetching random-access frame source for frame-analysis-mode
+ *
+ * Frames are read either from a folder of %08d.jpg files (the output of the
+ * write thread) or from a single video container (e.g. out.mp4 from
+ * `make encode`). A background thread decodes the frames around the cursor,
+ * ahead first, into a bounded LRU cache so that stepping and jumping only
+ * hit the cache.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef VIEWER_H
+#define VIEWER_H
+
+#include <pthread.h>
+#include <list>
+#include <map>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+using namespace cv;
+
+/* @brief A decoded frame cache that prefetches around a cursor
+ */
+class FramePrefetcher {
+
+private:
+
+  // source, exactly one of these is used
+  String folder;
+  VideoCapture video;
+  bool is_video;
+  int video_pos;        // next frame index the decoder will return
+
+  int num_frames;
+  int ahead, behind;    // prefetch window around the cursor
+  size_t capacity;      // maximum number of cached frames
+
+  // LRU cache, front is the most recently used
+  typedef std::list<int> lru_t;
+  typedef struct { Mat img; lru_t::iterator pos; } entry_t;
+  std::map<int, entry_t> cache;
+  lru_t lru;
+
+  int cursor;
+  bool running;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;      // cursor moved, signals the prefetch thread
+  pthread_cond_t decoded;   // a frame was added, signals waiting readers
+
+  // metrics to track
+  unsigned long hits, misses, decodes;
+
+  static void *thread_entry(void *param);
+  void run();
+  int next_wanted();
+  Mat decode(int i);
+  void insert(int i, const Mat& img);
+  int count_files();
+
+public:
+
+  FramePrefetcher();
+  ~FramePrefetcher();
+
+  // source is a folder ending in '/' or a video file
+  bool open(const String& source, int prefetch_ahead, int prefetch_behind,
+            size_t cache_frames);
+  void close();
+
+  // moves the cursor and returns frame i, waiting only on a cache miss
+  bool get(int i, Mat& img);
+
+  int get_num_frames() { return num_frames; }
+  unsigned long get_hits() { return hits; }
+  unsigned long get_misses() { return misses; }
+  unsigned long get_decodes() { return decodes; }
+};
+
+#endif // VIEWER_H
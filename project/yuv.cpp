@@ -0,0 +1,156 @@
+/* ----------------------------------------------------------------------------
+ * @file yuv.cpp
+ * @brief YUV420 (I420) frames, see yuv.h
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <algorithm>
+#include <jpeglib.h>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "yuv.h"
+
+// see .h for more details
+void yuv_planes(Mat& i420, Mat planes[3]) {
+
+  Size size = yuv_size(i420);
+  Size chroma(size.width/2, size.height/2);
+  uchar* u = i420.data + size.area();
+
+  CV_Assert(i420.isContinuous() && i420.type() == CV_8UC1);
+
+  planes[0] = i420.rowRange(0, size.height);
+  planes[1] = Mat(chroma, CV_8UC1, u);
+  planes[2] = Mat(chroma, CV_8UC1, u + chroma.area());
+}
+
+// see .h for more details
+Scalar yuv_color(const Scalar& bgr) {
+
+  double b = bgr[0], g = bgr[1], r = bgr[2];
+
+  // JFIF (BT.601 full range), matching the encoder
+  return Scalar(0.299*r + 0.587*g + 0.114*b,
+                128.0 - 0.168736*r - 0.331264*g + 0.5*b,
+                128.0 + 0.5*r - 0.418688*g - 0.081312*b);
+}
+
+typedef struct {
+  struct jpeg_error_mgr mgr;
+  jmp_buf jump;
+} jpeg_error_t;
+
+/* @brief libjpeg exits the process on errors by default, return instead
+ */
+static void jpeg_error_exit(j_common_ptr cinfo) {
+
+  jpeg_error_t* err = (jpeg_error_t*) cinfo->err;
+  (*cinfo->err->output_message)(cinfo);
+  longjmp(err->jump, 1);
+}
+
+/* @brief Compresses the I420 planes into a buffer libjpeg allocates
+ *
+ * The buffer belongs to the caller, also when an error longjmp()s back
+ * here: libjpeg updates *mem after the setjmp(), so it must not be a
+ * local of this function (its value would be indeterminate after the
+ * jump).
+ *
+ * @param mem, mem_size, the output buffer, NULL and 0 on the call, to
+ *        free() by the caller in every case
+ * @return false on a libjpeg error
+ */
+static bool encode_planes(Mat planes[3], Size size, int quality,
+                          unsigned char** mem, unsigned long* mem_size) {
+
+  struct jpeg_compress_struct cinfo;
+  jpeg_error_t err;
+
+  cinfo.err = jpeg_std_error(&err.mgr);
+  err.mgr.error_exit = jpeg_error_exit;
+  if (setjmp(err.jump)) {
+    jpeg_destroy_compress(&cinfo);
+    return false;
+  }
+
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, mem, mem_size);
+
+  cinfo.image_width = size.width;
+  cinfo.image_height = size.height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_YCbCr;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_colorspace(&cinfo, JCS_YCbCr);
+  jpeg_set_quality(&cinfo, quality, TRUE);
+
+  // the planes as they are, 2x2 subsampled chroma
+  cinfo.raw_data_in = TRUE;
+  cinfo.comp_info[0].h_samp_factor = 2;
+  cinfo.comp_info[0].v_samp_factor = 2;
+  cinfo.comp_info[1].h_samp_factor = 1;
+  cinfo.comp_info[1].v_samp_factor = 1;
+  cinfo.comp_info[2].h_samp_factor = 1;
+  cinfo.comp_info[2].v_samp_factor = 1;
+
+  jpeg_start_compress(&cinfo, TRUE);
+
+  // one MCU row: 16 luma rows, 8 rows of each chroma plane, the last rows
+  // are repeated to fill up the bottom MCU
+  JSAMPROW y_rows[16], u_rows[8], v_rows[8];
+  JSAMPARRAY rows[3] = {y_rows, u_rows, v_rows};
+  int chroma_h = size.height/2;
+
+  for (int row = 0; row < size.height; row += 16) {
+    for (int i = 0; i < 16; i++) {
+      y_rows[i] = planes[0].ptr(std::min(row + i, size.height - 1));
+    }
+    for (int i = 0; i < 8; i++) {
+      int r = std::min(row/2 + i, chroma_h - 1);
+      u_rows[i] = planes[1].ptr(r);
+      v_rows[i] = planes[2].ptr(r);
+    }
+    jpeg_write_raw_data(&cinfo, rows, 16);
+  }
+
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  return true;
+}
+
+
+// see .h for more details
+bool yuv_encode_jpeg(const Mat& i420, int quality, std::vector<uchar>& jpeg) {
+
+  Size size = yuv_size(i420);
+
+  if (size.width % 16 != 0 || !i420.isContinuous()) {
+    Mat bgr;
+    cvtColor(i420, bgr, COLOR_YUV2BGR_I420);
+    std::vector<int> params(2);
+    params[0] = IMWRITE_JPEG_QUALITY;
+    params[1] = quality;
+    return imencode(".jpg", bgr, jpeg, params);
+  }
+
+  Mat planes[3];
+  yuv_planes(const_cast<Mat&>(i420), planes);
+
+  unsigned char* mem = NULL;
+  unsigned long mem_size = 0;
+  bool ok = encode_planes(planes, size, quality, &mem, &mem_size);
+
+  if (ok) {
+    jpeg.assign(mem, mem + mem_size);
+  } else {
+    jpeg.clear();
+  }
+  free(mem);
+  return ok;
+}
@@ -0,0 +1,70 @@
+/* ----------------------------------------------------------------------------
+ * @file yuv.h
+ * @brief YUV420 (I420) frames: plane views, colors and a JPEG encoder that
+ *        takes the planes directly
+ *
+ * An I420 frame is a single CV_8UC1 Mat of height*3/2 rows: the Y plane,
+ * then the U and V planes of (width/2)x(height/2) each, back to back. This
+ * is the layout of Y4M 4:2:0 files and of COLOR_BGR2YUV_I420.
+ *
+ * The encoder hands the planes to libjpeg as raw data (4:2:0, no color
+ * conversion, no chroma downsampling). JFIF assumes full range YCbCr, the
+ * usual limited range (16..235) video comes out with slightly less contrast
+ * than the same frame encoded from BGR.
+ *
+ * @author Jake Michael, jami1063@colorado.edu
+ * @course ECEN 5763: EMVIA, Summer 2021
+ *---------------------------------------------------------------------------*/
+
+#ifndef YUV_H
+#define YUV_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+using namespace cv;
+
+#define YUV_JPEG_QUALITY (95)   // the imencode default
+
+/* @brief The picture size of an I420 frame
+ */
+static inline Size yuv_size(const Mat& i420) {
+
+  return Size(i420.cols, i420.rows*2/3);
+}
+
+/* @brief Bytes moved per frame by the three full-frame color conversions
+ *        of the BGR path, none of which YUV420 mode does
+ *
+ * decoder I420->BGR (1.5 read + 3 written per pixel), to_gray() BGR->gray
+ * (3 + 1) and the JPEG encoder's BGR->YCbCr 4:2:0 (3 + 1.5)
+ */
+static inline double yuv_saved_bytes(Size size) {
+
+  return 13.0*size.area();
+}
+
+/* @brief Views of the Y, U and V planes of a continuous I420 frame
+ *
+ * @param i420, the frame, width and height even
+ * @param planes, set to the Y (WxH), U and V (W/2xH/2) plane headers
+ */
+void yuv_planes(Mat& i420, Mat planes[3]);
+
+/* @brief Converts a BGR color to full range Y, Cb, Cr
+ */
+Scalar yuv_color(const Scalar& bgr);
+
+/* @brief Encodes an I420 frame as a baseline 4:2:0 JPEG
+ *
+ * Falls back to a BGR conversion and imencode() when the width is not a
+ * multiple of 16 (libjpeg reads whole MCUs from every row).
+ *
+ * @param i420, the frame
+ * @param quality, JPEG quality 0..100
+ * @param jpeg, the encoded file
+ * @return false on an encoder error
+ */
+bool yuv_encode_jpeg(const Mat& i420, int quality, std::vector<uchar>& jpeg);
+
+#endif // YUV_H